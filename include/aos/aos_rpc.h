@@ -24,19 +24,124 @@
 #define AOS_RPC_NUMBER 1 << 5     // ID for send number requests.
 #define AOS_RPC_PUTCHAR 1 << 7    // ID for putchar requests.
 #define AOS_RPC_STRING 1 << 11    // ID for send string requests.
+#define AOS_RPC_MEMORY_BATCH 1 << 13  // ID for batched memory requests.
+#define AOS_RPC_BULK 1 << 15      // ID for bulk frame setup requests.
+
+// Size of the frame shared between client and init for bulk transfers.
+#define AOS_RPC_BULK_SIZE (16 * BASE_PAGE_SIZE)
+
+// Maximum number of requests in flight per channel.
+#define AOS_RPC_WINDOW 8
+// LMP buffer large enough to hold a full window of messages.
+#define AOS_RPC_BUF_WORDS (LMP_RECV_LENGTH * AOS_RPC_WINDOW)
+
+// The request tag travels in the upper half of the opcode (request) or
+// status (response) word, so that responses can arrive out of order.
+#define AOS_RPC_TAG_SHIFT 16
+#define AOS_RPC_CODE_MASK ((1 << AOS_RPC_TAG_SHIFT) - 1)
+#define AOS_RPC_TAG(word) ((word) >> AOS_RPC_TAG_SHIFT)
+#define AOS_RPC_CODE(word) ((word) & AOS_RPC_CODE_MASK)
+#define AOS_RPC_MKWORD(code, tag) ((code) | ((uintptr_t) (tag) << AOS_RPC_TAG_SHIFT))
+
+// Payload words carried by every request and response.
+#define AOS_RPC_PAYLOAD_WORDS 2
+
+/**
+ * \brief Request descriptor, preallocated per channel.
+ * On the wire: (opcode, client_id, payload).
+ */
+struct aos_rpc_request {
+    uintptr_t opcode;       // AOS_RPC_* request ID.
+    struct capref cap;      // Cap to send along, or NULL_CAP.
+    union {
+        uintptr_t words[AOS_RPC_PAYLOAD_WORDS];
+        uintptr_t number;   // AOS_RPC_NUMBER
+        char c;             // AOS_RPC_PUTCHAR
+        size_t bytes;       // AOS_RPC_MEMORY
+        struct {
+            size_t offset;
+            size_t len;
+        } bulk;             // AOS_RPC_STRING
+        struct {
+            size_t bytes;
+            size_t count;
+        } ram_batch;        // AOS_RPC_MEMORY_BATCH
+    } u;
+};
+
+/**
+ * \brief Response descriptor, preallocated per channel.
+ * On the wire: (status, err, payload).
+ */
+struct aos_rpc_response {
+    uintptr_t status;       // AOS_RPC_OK or AOS_RPC_FAILED.
+    errval_t err;           // Error code from the server.
+    struct capref cap;      // Cap received with the response, or NULL_CAP.
+    union {
+        uintptr_t words[AOS_RPC_PAYLOAD_WORDS];
+        struct {
+            uint32_t client_id;
+        } handshake;        // AOS_RPC_HANDSHAKE
+        size_t bytes;       // AOS_RPC_MEMORY, AOS_RPC_BULK
+        struct {
+            size_t count;
+        } ram_batch;        // AOS_RPC_MEMORY_BATCH
+    } u;
+};
+
+struct aos_rpc;
+
+/**
+ * \brief Completion callback for an asynchronous RPC.
+ * `resp` is only valid for the duration of the call.
+ */
+typedef void (*aos_rpc_cont_t)(struct aos_rpc *rpc,
+                               struct aos_rpc_response *resp, void *arg);
+
+/**
+ * \brief An in-flight request, indexed by its tag.
+ */
+struct aos_rpc_pending {
+    struct aos_rpc_request req;    // Request, copied at submission.
+    struct aos_rpc_response resp;  // Response, filled in on arrival.
+    aos_rpc_cont_t cont;           // Completion callback.
+    void* arg;                     // Argument for cont.
+    bool busy;                     // Whether this tag is in use.
+};
 
 struct aos_rpc {
 	uint32_t client_id;
     struct lmp_chan lc;
     struct waitset* ws;
+
+    struct aos_rpc_request req;    // Request for synchronous calls.
+    struct aos_rpc_response resp;  // Response to req, once done is set.
+    bool done;                     // Whether resp has arrived.
+
+    struct aos_rpc_pending pending[AOS_RPC_WINDOW];  // In-flight window.
+    uint8_t send_queue[AOS_RPC_WINDOW];  // Tags not yet sent, in FIFO order.
+    size_t send_head;          // Index of the first tag in send_queue.
+    size_t send_count;         // Number of tags in send_queue.
+    size_t in_flight;          // Number of busy entries in pending.
+    bool send_registered;      // Whether a send event is registered.
+    bool recv_registered;      // Whether a recv event is registered.
+
+    struct capref bulk_frame;  // Frame shared with init, set up at init time.
+    void* bulk_buf;            // Local mapping of bulk_frame, NULL until used.
+    size_t bulk_size;          // Size of bulk_frame in bytes.
 };
 
-errval_t aos_rpc_putchar_send_handler(void* void_args);
-errval_t aos_rpc_putchar_recv_handler(void* void_args);
-errval_t aos_rpc_send_number_send_handler(void* void_args);
-errval_t aos_rpc_send_number_recv_handler(void* void_args);
-errval_t aos_rpc_send_string_send_handler(void* void_args);
-errval_t aos_rpc_send_string_recv_handler(void* void_args);
+/**
+ * \brief Reset the channel's request descriptor for a new RPC.
+ */
+static inline void aos_rpc_request_init(struct aos_rpc *rpc, uintptr_t opcode)
+{
+    rpc->req.opcode = opcode;
+    rpc->req.cap = NULL_CAP;
+    for (int i = 0; i < AOS_RPC_PAYLOAD_WORDS; ++i) {
+        rpc->req.u.words[i] = 0;
+    }
+}
 
 /**
  * \brief send a number over the given channel
@@ -49,14 +154,22 @@ errval_t aos_rpc_send_number(struct aos_rpc *chan, uintptr_t val);
 errval_t aos_rpc_send_string(struct aos_rpc *chan, const char *string);
 
 /**
- * \brief RAM cap request.
+ * \brief send a buffer of `len` bytes to be printed over the given channel
+ */
+errval_t aos_rpc_send_buffer(struct aos_rpc *chan, const void *buf,
+                             size_t len);
+
+/**
+ * \brief get a pointer to the bulk buffer shared with the server
+ * Data written there can be handed over with aos_rpc_send_bulk() without
+ * any further copies.
  */
-errval_t aos_rpc_ram_send_handler(void* void_args);
+errval_t aos_rpc_bulk_buf(struct aos_rpc *chan, void **buf, size_t *size);
 
 /**
- * \brief RAM cap response.
+ * \brief hand `len` bytes at `offset` in the bulk buffer to the server
  */
-errval_t aos_rpc_ram_recv_handler(void* void_args);
+errval_t aos_rpc_send_bulk(struct aos_rpc *chan, size_t offset, size_t len);
 
 /**
  * \brief request a RAM capability with >= request_bits of size over the given
@@ -65,6 +178,16 @@ errval_t aos_rpc_ram_recv_handler(void* void_args);
 errval_t aos_rpc_get_ram_cap(struct aos_rpc *chan, size_t bytes,
                              struct capref *retcap, size_t *ret_bytes);
 
+/**
+ * \brief request `count` RAM capabilities of `bytes` each in one round trip.
+ * Each batch comes in an L2 CNode of its own, which init hands over and which
+ * is mounted into our root CNode at *retcn. On success, the caps are in slots
+ * 0 to *ret_count - 1 of it. The server may hand out fewer caps than
+ * requested. Destroying *retcn deletes any caps still left in it.
+ */
+errval_t aos_rpc_get_ram_caps(struct aos_rpc *chan, size_t bytes, size_t count,
+                              struct capref *retcn, size_t *ret_count);
+
 /**
  * \brief get one character from the serial port
  */
@@ -105,20 +228,35 @@ errval_t aos_rpc_process_get_all_pids(struct aos_rpc *chan,
                                       domainid_t **pids, size_t *pid_count);
 
 /**
- * \brief Initiate handshake by sending local cap to server.
+ * \brief General-purpose blocking RPC: send rpc->req and wait for rpc->resp.
+ */
+errval_t aos_rpc_call(struct aos_rpc *rpc);
+
+/**
+ * \brief Submit `req` without waiting for its response.
+ * `cont` is called from the channel's waitset once the response arrives.
+ * Blocks only while the channel's in-flight window is full.
+ */
+errval_t aos_rpc_call_async(struct aos_rpc *rpc,
+                            const struct aos_rpc_request *req,
+                            aos_rpc_cont_t cont, void *arg);
+
+/**
+ * \brief Dispatch events until all requests in flight have completed.
  */
-errval_t aos_rpc_handshake_send_handler(void* void_args);
+errval_t aos_rpc_wait_all(struct aos_rpc *rpc);
 
 /**
- * \brief Finalize handshake by receiving ack from server.
+ * \brief Asynchronous version of aos_rpc_get_ram_cap().
+ * The RAM cap and its size are in resp->cap and resp->u.bytes.
  */
-errval_t aos_rpc_handshake_recv_handler(void* void_args);
+errval_t aos_rpc_get_ram_cap_async(struct aos_rpc *chan, size_t bytes,
+                                   aos_rpc_cont_t cont, void *arg);
 
 /**
- * \brief General-purpose blocking RPC send-and-receive function.
+ * \brief Read the cycle counter, for performance measurements.
  */
-errval_t aos_rpc_send_and_receive(uintptr_t* args, void* send_handler,
-		void* rcv_handler);
+uint32_t perf_measurement_get_counter(void);
 
 /**
  * \brief Initialize given rpc channel.
@@ -55,6 +55,8 @@ errval_t vnode_create(struct capref dest, enum objtype type);
 errval_t frame_create(struct capref dest, size_t bytes, size_t *retbytes);
 errval_t frame_alloc(struct capref *dest, size_t bytes, size_t *retbytes);
 errval_t devframe_type(struct capref *dest, struct capref src, uint8_t bits);
+errval_t ram_forge(struct capref dest, genpaddr_t base, gensize_t bytes,
+                   coreid_t owner);
 errval_t dispatcher_create(struct capref dest);
 
 typedef void (*handler_func_t)(void *);
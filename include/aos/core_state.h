@@ -45,6 +45,12 @@ struct ram_alloc_state {
     uint64_t default_minbase;
     uint64_t default_maxlimit;
     int base_capnum;
+    struct capref batch_cn_cap; ///< CNode holding prefetched BASE_PAGE_SIZE RAM caps
+    struct capref batch_prev_cap; ///< CNode of the batch before, or NULL_CAP
+    struct cnoderef batch_cn;   ///< batch_cn_cap, to address the caps
+    cslot_t batch_next;         ///< Next unused slot in batch_cn
+    cslot_t batch_end;          ///< One past the last prefetched slot
+    bool batch_refilling;       ///< Whether batch_cn is being refilled
 };
 
 struct skb_state {
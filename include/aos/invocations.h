@@ -16,7 +16,11 @@
 #define INVOCATIONS_H
 
 #include <barrelfish_kpi/dispatcher_shared.h>
+#include <barrelfish_kpi/dispatcher_perfmon.h>
+#include <barrelfish_kpi/dispatcher_stats.h>
 #include <barrelfish_kpi/distcaps.h> // for distcap_state_t
+#include <barrelfish_kpi/platform.h>
+#include <barrelfish_kpi/cpu.h>
 #include <aos/caddr.h>
 
 #include <aos/invocations_arch.h>
@@ -194,6 +198,28 @@ static inline errval_t invoke_frame_identify(struct capref frame,
     return sysret.error;
 }
 
+/**
+ * \brief Zero more of a RAM region, so that retyping it needn't
+ *
+ * \param ram        CSpace address of RAM capability, without descendants
+ * \param budget     Maximum number of bytes to zero in this call
+ * \param ret_bytes  Returns how many bytes from the base are now zero
+ *
+ * \return Error code
+ */
+static inline errval_t invoke_ram_zero(struct capref ram, size_t budget,
+                                       size_t *ret_bytes)
+{
+    assert(get_croot_addr(ram) == CPTR_ROOTCN);
+
+    struct sysret sysret = cap_invoke2(ram, RAMCmd_Zero, budget);
+    if (ret_bytes != NULL) {
+        *ret_bytes = err_is_ok(sysret.error) ? sysret.value * BASE_PAGE_SIZE
+                                             : 0;
+    }
+    return sysret.error;
+}
+
 static inline errval_t invoke_vnode_identify(struct capref vnode,
 					     struct vnode_identity *ret)
 {
@@ -297,6 +323,60 @@ static inline errval_t invoke_dispatcher_dump_capabilities(struct capref dispcap
     return cap_invoke1(dispcap, DispatcherCmd_DumpCapabilities).error;
 }
 
+/**
+ * \brief Read a dispatcher's accounting information
+ *
+ * \param dispcap Dispatcher capability
+ * \param stats   Filled in with the dispatcher's counters
+ * \param tick_hz Filled in with the rate run time is counted at, if not NULL
+ */
+static inline errval_t invoke_dispatcher_stats(struct capref dispcap,
+                                               struct dispatcher_stats *stats,
+                                               uint32_t *tick_hz)
+{
+    struct sysret sr = cap_invoke2(dispcap, DispatcherCmd_Stats,
+                                   (uintptr_t)stats);
+    if (err_is_ok(sr.error) && tick_hz != NULL) {
+        *tick_hz = sr.value;
+    }
+    return sr.error;
+}
+
+/**
+ * \brief Program the PMU events to count while a dispatcher runs
+ *
+ * Resets the dispatcher's counts. Setting every event to PERFMON_EVENT_NONE
+ * stops counting for it.
+ *
+ * \param dispcap Dispatcher capability
+ * \param events  Event to count on each counter
+ */
+static inline errval_t
+invoke_dispatcher_perfmon_setup(struct capref dispcap,
+                                const struct perfmon_events *events)
+{
+    uintptr_t packed = 0;
+    for (int i = 0; i < PERFMON_COUNTERS; i++) {
+        packed |= (uintptr_t)events->event[i] << (8 * i);
+    }
+    return cap_invoke3(dispcap, DispatcherCmd_PerfMon, PerfMonOp_Setup,
+                       packed).error;
+}
+
+/**
+ * \brief Read what a dispatcher's PMU events counted since they were set up
+ *
+ * \param dispcap Dispatcher capability
+ * \param counts  Filled in with the count of each event
+ */
+static inline errval_t
+invoke_dispatcher_perfmon_read(struct capref dispcap,
+                               struct perfmon_counts *counts)
+{
+    return cap_invoke3(dispcap, DispatcherCmd_PerfMon, PerfMonOp_Read,
+                       (uintptr_t)counts).error;
+}
+
 /**
  * IRQ manipulations
  */
@@ -376,4 +456,125 @@ static inline errval_t invoke_kernel_get_core_id(struct capref kern_cap,
     return sysret.error;
 }
 
+/**
+ * \brief Ask the kernel for a description of the platform
+ */
+static inline errval_t invoke_kernel_get_platform_info(struct capref kern_cap,
+                                                       struct platform_info *pi)
+{
+    assert(pi != NULL);
+    return cap_invoke2(kern_cap, KernelCmd_Get_platform, (uintptr_t)pi).error;
+}
+
+/**
+ * \brief Create a capability from a raw description, owned by `owner`
+ *
+ * \param kern_cap Kernel capability
+ * \param cap      Capability to create
+ * \param dest     Empty slot to place it in
+ * \param owner    Core owning the new capability
+ */
+static inline errval_t invoke_monitor_create_cap(struct capref kern_cap,
+                                                 struct capability *cap,
+                                                 struct capref dest,
+                                                 coreid_t owner)
+{
+    return cap_invoke6(kern_cap, KernelCmd_Create_cap, get_cnode_addr(dest),
+                       get_cnode_level(dest), dest.slot, owner,
+                       (uintptr_t)cap).error;
+}
+
+/**
+ * \brief Boot another core
+ *
+ * \param kern_cap  Kernel capability
+ * \param core_id   Hardware ID of the core to boot
+ * \param cpu_type  Architecture of the core
+ * \param core_data Address of the new core's struct arm_core_data
+ */
+static inline errval_t invoke_monitor_spawn_core(struct capref kern_cap,
+                                                 coreid_t core_id,
+                                                 enum cpu_type cpu_type,
+                                                 genvaddr_t core_data)
+{
+    return cap_invoke5(kern_cap, KernelCmd_Spawn_core, core_id, cpu_type,
+                       (uintptr_t)(core_data >> 32),
+                       (uintptr_t)core_data).error;
+}
+
+/**
+ * \brief Fill in the parts of a new core's core data shared with this kernel
+ *
+ * \param kcb   KCB of the new core
+ * \param frame Frame holding the new core's struct arm_core_data
+ */
+static inline errval_t invoke_kcb_clone(struct capref kcb, struct capref frame)
+{
+    return cap_invoke3(kcb, KCBCmd_Clone, get_cap_addr(frame),
+                       get_cap_level(frame)).error;
+}
+
+/**
+ * \brief Have the local kernel signal an endpoint for a notification channel
+ *
+ * \param kern_cap Kernel capability
+ * \param ep       Endpoint to deliver an empty message to when notified
+ * \param chanid   Notification channel on this core
+ */
+static inline errval_t invoke_monitor_ipi_register(struct capref kern_cap,
+                                                   struct capref ep,
+                                                   uint16_t chanid)
+{
+    return cap_invoke4(kern_cap, KernelCmd_IPI_Register, get_cap_addr(ep),
+                       get_cap_level(ep), chanid).error;
+}
+
+/**
+ * \brief Have the kernel sample PCs into a frame, see barrelfish_kpi/profile.h
+ *
+ * \param kern_cap Kernel capability
+ * \param frame    Frame for the profile buffer, or NULL_CAP to stop
+ */
+static inline errval_t invoke_kernel_profile(struct capref kern_cap,
+                                             struct capref frame)
+{
+    if (capref_is_null(frame)) {
+        return cap_invoke3(kern_cap, KernelCmd_Profile, 0, 0).error;
+    }
+    return cap_invoke3(kern_cap, KernelCmd_Profile, get_cap_addr(frame),
+                       get_cap_level(frame)).error;
+}
+
+/**
+ * \brief Have the kernel trace events into a frame, see barrelfish_kpi/ktrace.h
+ *
+ * \param kern_cap Kernel capability
+ * \param frame    Frame for the trace buffer, or NULL_CAP to stop
+ * \param mask     KTRACE_SUBSYS_* to trace, until changed in the buffer
+ */
+static inline errval_t invoke_kernel_setup_trace(struct capref kern_cap,
+                                                 struct capref frame,
+                                                 uint32_t mask)
+{
+    if (capref_is_null(frame)) {
+        return cap_invoke4(kern_cap, KernelCmd_Setup_trace, 0, 0, 0).error;
+    }
+    return cap_invoke4(kern_cap, KernelCmd_Setup_trace, get_cap_addr(frame),
+                       get_cap_level(frame), mask).error;
+}
+
+static inline errval_t invoke_monitor_ipi_delete(struct capref kern_cap,
+                                                 uint16_t chanid)
+{
+    return cap_invoke2(kern_cap, KernelCmd_IPI_Delete, chanid).error;
+}
+
+/**
+ * \brief Raise the notification a Notify_IPI capability refers to
+ */
+static inline errval_t invoke_ipi_notify_send(struct capref notify_cap)
+{
+    return cap_invoke1(notify_cap, NotifyCmd_Send).error;
+}
+
 #endif // INVOCATIONS_H
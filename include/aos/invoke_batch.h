@@ -0,0 +1,61 @@
+/**
+ * \file
+ * \brief Batched capability invocations
+ *
+ * Queues capability invocations in user memory and has the kernel run them
+ * with a single system call. Chains of small invocations, such as retype,
+ * copy, map and delete, otherwise pay for one trap each.
+ *
+ * Queued invocations only take effect once the batch is flushed, either
+ * explicitly or because it filled up when adding to it. The invocations
+ * run in the order they were added, and the first one to fail ends the
+ * flush. Unlike cap_retype() and cap_delete(), batched invocations are not
+ * retried through the monitor, so they should only be used on capabilities
+ * that have no copies on other cores.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#ifndef BARRELFISH_INVOKE_BATCH_H
+#define BARRELFISH_INVOKE_BATCH_H
+
+#include <sys/cdefs.h>
+
+#include <barrelfish_kpi/invoke_batch.h>
+#include <aos/caddr.h>
+
+__BEGIN_DECLS
+
+/// Invocations queued for one SYSCALL_INVOKE_BATCH
+struct invoke_batch {
+    size_t count;
+    struct invoke_batch_entry entries[INVOKE_BATCH_MAX];
+};
+
+void invoke_batch_init(struct invoke_batch *b);
+errval_t invoke_batch_add(struct invoke_batch *b, struct capref to,
+                          uint8_t cmd, size_t argc, const uintptr_t *args);
+errval_t invoke_batch_flush(struct invoke_batch *b);
+
+errval_t invoke_batch_retype(struct invoke_batch *b, struct capref dest_start,
+                             struct capref src, gensize_t offset,
+                             enum objtype new_type, gensize_t objsize,
+                             size_t count);
+errval_t invoke_batch_copy(struct invoke_batch *b, struct capref dest,
+                           struct capref src);
+errval_t invoke_batch_delete(struct invoke_batch *b, struct capref cap);
+errval_t invoke_batch_vnode_map(struct invoke_batch *b, struct capref dest,
+                                struct capref src, capaddr_t slot,
+                                uint64_t attr, uint64_t off,
+                                uint64_t pte_count, struct capref mapping);
+
+__END_DECLS
+
+#endif // BARRELFISH_INVOKE_BATCH_H
@@ -0,0 +1,56 @@
+/**
+ * \file
+ * \brief Cross-core notifications delivered by inter-processor interrupt
+ *
+ * A notification channel is an endpoint registered with the local kernel
+ * under a small per-core channel ID. Invoking a Notify_IPI capability for
+ * that core and channel ID, from any core, raises an SGI on the target core,
+ * whose kernel turns it into an empty LMP message on the endpoint. Cross-core
+ * channels use this to let an idle receiver block on its waitset instead of
+ * polling.
+ *
+ * Registering channels and creating Notify_IPI capabilities needs the kernel
+ * capability, so for now only init can set these up.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#ifndef BARRELFISH_IPI_NOTIFY_H
+#define BARRELFISH_IPI_NOTIFY_H
+
+#include <sys/cdefs.h>
+
+#include <aos/waitset.h>
+
+__BEGIN_DECLS
+
+struct lmp_endpoint;
+struct ump_chan;
+
+/// One end of a notification channel pair
+struct ipi_notify {
+    struct lmp_endpoint *ep;    ///< Endpoint signalled by the local kernel
+    struct capref epcap;        ///< Capability for ep
+    uint16_t chanid;            ///< Local channel ID ep is registered under
+    struct capref remote;       ///< Notify_IPI capability for the other end
+};
+
+errval_t ipi_notify_init(struct ipi_notify *in, uint16_t chanid);
+errval_t ipi_notify_connect(struct ipi_notify *in, coreid_t core,
+                            uint16_t chanid);
+errval_t ipi_notify_raise(struct ipi_notify *in);
+errval_t ipi_notify_register(struct ipi_notify *in, struct waitset *ws,
+                             struct event_closure closure);
+void ipi_notify_ack(struct ipi_notify *in);
+void ipi_notify_ump(struct ump_chan *uc, void *arg);
+
+__END_DECLS
+
+#endif // BARRELFISH_IPI_NOTIFY_H
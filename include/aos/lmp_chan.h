@@ -113,6 +113,22 @@ static inline errval_t lmp_chan_recv(struct lmp_chan *lc,
     return lmp_endpoint_recv(lc->endpoint, &msg->buf, cap);
 }
 
+/**
+ * \brief Receive all pending messages from an LMP channel, up to `max`
+ *
+ * Non-blocking. If one of the messages carried a cap, a fresh receive slot
+ * is allocated for the channel, once for the whole batch.
+ *
+ * \param lc    LMP channel
+ * \param msgs  Array of `max` message buffers, to be filled-in
+ * \param caps  Array of `max` caprefs, filled-in with the cap received with
+ *              each message, or NULL_CAP
+ * \param max   Maximum number of messages to receive
+ * \param count Filled-in with the number of messages received
+ */
+errval_t lmp_chan_recv_many(struct lmp_chan *lc, struct lmp_recv_msg *msgs,
+                            struct capref *caps, size_t max, size_t *count);
+
 /**
  * \brief Check if a channel has data to receive
  */
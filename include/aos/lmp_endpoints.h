@@ -75,6 +75,9 @@ bool lmp_endpoint_can_recv(struct lmp_endpoint *ep);
 void lmp_endpoints_poll_disabled(dispatcher_handle_t handle);
 errval_t lmp_endpoint_recv(struct lmp_endpoint *ep, struct lmp_recv_buf *buf,
                            struct capref *cap);
+errval_t lmp_endpoint_recv_many(struct lmp_endpoint *ep,
+                                struct lmp_recv_msg *msgs, struct capref *caps,
+                                size_t max, size_t *count);
 errval_t lmp_endpoint_register(struct lmp_endpoint *ep, struct waitset *ws,
                                struct event_closure closure);
 errval_t lmp_endpoint_deregister(struct lmp_endpoint *ep);
@@ -19,6 +19,7 @@
 #include <errors/errno.h>
 #include <aos/capabilities.h>
 #include <aos/slab.h>
+#include <aos/thread_sync.h>
 #include <barrelfish_kpi/paging_arm_v7.h>
 
 typedef int paging_flags_t;
@@ -88,6 +89,10 @@ struct paging_state {
     // Callbacks for child processes' caps.
     mapping_cb_t mapping_cb;
     void* mapping_state;
+
+    // Guards the vregion list and pagetables. Taken recursively, as slab
+    // refills map memory through this same state.
+    struct thread_mutex mutex;
 };
 
 struct thread;
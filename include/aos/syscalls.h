@@ -61,6 +61,22 @@ errval_t sys_getchar(char *c);
  * \brief get time elapsed (in milliseconds) since system boot.
  */
 uint64_t sys_get_absolute_time(void);
+
+struct invoke_batch_entry;
+
+/**
+ * \brief Run a list of capability invocations in one system call.
+ *
+ * Stops at the first invocation that fails. See barrelfish_kpi/invoke_batch.h.
+ *
+ * \param entries Invocation descriptors; their results are filled-in
+ * \param count   Number of descriptors
+ * \param done    If non-NULL, filled-in with the number processed
+ *
+ * \return Error of the failing invocation, or #SYS_ERR_OK.
+ */
+errval_t sys_invoke_batch(struct invoke_batch_entry *entries, size_t count,
+                          size_t *done);
 __END_DECLS
 
 #endif //LIBBARRELFISH_SYSCALL_H
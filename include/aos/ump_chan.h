@@ -0,0 +1,139 @@
+/**
+ * \file
+ * \brief Bidirectional UMP channel over a shared frame
+ *
+ * A UMP channel lets two dispatchers on different cores exchange messages
+ * through memory they both have mapped. The frame is split in two halves,
+ * one per direction. Each half is a ring of cache-line sized messages
+ * followed by one acknowledgement line written by the receiver.
+ */
+
+/*
+ * Copyright (c) 2009, 2010, 2011, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Haldeneggsteig 4, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#ifndef BARRELFISH_UMP_CHAN_H
+#define BARRELFISH_UMP_CHAN_H
+
+#include <sys/cdefs.h>
+
+#include <aos/waitset.h>
+#include <aos/static_assert.h>
+#include <barrelfish_kpi/asm_inlines_arch.h>
+
+__BEGIN_DECLS
+
+/// Size of a UMP message, and the alignment of the shared buffer
+#define UMP_MSG_BYTES           64
+/// Machine words in a UMP message, including the control word
+#define UMP_MSG_WORDS           (UMP_MSG_BYTES / sizeof(uintptr_t))
+/// Payload words in a UMP message
+#define UMP_PAYLOAD_WORDS       (UMP_MSG_WORDS - 1)
+
+/// Control word: epoch bit, set by the sender, toggles on every ring wrap
+#define UMP_CTRL_EPOCH          ((uintptr_t)1)
+/// Control word: payload length in words
+#define UMP_CTRL_LEN_SHIFT      1
+#define UMP_CTRL_LEN_MASK       ((uintptr_t)0x1f)
+
+/// A single message slot, occupying one cache line
+struct ump_msg {
+    uintptr_t words[UMP_PAYLOAD_WORDS];
+    volatile uintptr_t ctrl;    ///< Written last by the sender
+} __attribute__((aligned(UMP_MSG_BYTES)));
+
+STATIC_ASSERT(sizeof(struct ump_msg) == UMP_MSG_BYTES, "UMP message size");
+
+/// A received UMP message
+struct ump_recv_msg {
+    size_t len;                             ///< Payload length in words
+    uintptr_t words[UMP_PAYLOAD_WORDS];     ///< Payload
+};
+
+/// One direction of a UMP channel
+struct ump_ring {
+    struct ump_msg *msgs;           ///< Message slots
+    volatile uint32_t *ack;         ///< Receiver's position, in its own line
+    size_t nslots;                  ///< Number of message slots
+    uint32_t seq;                   ///< Next sequence number to send/receive
+    uint32_t acked;                 ///< Last position seen/written on the ack line
+};
+
+struct ump_chan;
+
+/// Called after a send, to wake the receiver on the other core
+typedef void (*ump_notify_fn_t)(struct ump_chan *uc, void *arg);
+
+/// A bidirectional UMP channel
+struct ump_chan {
+    struct waitset_chanstate recv_waitset;  ///< Polled by the waitset (recv)
+    struct ump_ring send, recv;
+
+    ump_notify_fn_t notify;         ///< Optional notification, e.g. an IPI
+    void *notify_arg;
+};
+
+errval_t ump_chan_init(struct ump_chan *uc, void *buf, size_t size,
+                       bool first_half);
+void ump_chan_destroy(struct ump_chan *uc);
+errval_t ump_chan_send(struct ump_chan *uc, const uintptr_t *words, size_t len);
+errval_t ump_chan_recv(struct ump_chan *uc, struct ump_recv_msg *msg);
+errval_t ump_chan_register_recv(struct ump_chan *uc, struct waitset *ws,
+                                struct event_closure closure);
+errval_t ump_chan_deregister_recv(struct ump_chan *uc);
+
+/**
+ * \brief Install a hook run after each send, to notify the receiver
+ *
+ * Without a hook the receiver only sees messages when it polls.
+ *
+ * \param uc  UMP channel
+ * \param fn  Notification function, or NULL to disable
+ * \param arg Argument passed to fn
+ */
+static inline void ump_chan_set_notify(struct ump_chan *uc, ump_notify_fn_t fn,
+                                       void *arg)
+{
+    uc->notify = fn;
+    uc->notify_arg = arg;
+}
+
+/// Epoch bit the current sequence number is expected to carry
+static inline uintptr_t ump_ring_epoch(struct ump_ring *r)
+{
+    // the buffer starts zeroed, so the first lap must use epoch 1
+    return ((r->seq / r->nslots) & 1) ^ UMP_CTRL_EPOCH;
+}
+
+/**
+ * \brief Check if a channel has data to receive
+ */
+static inline bool ump_chan_can_recv(struct ump_chan *uc)
+{
+    struct ump_ring *r = &uc->recv;
+    struct ump_msg *m = &r->msgs[r->seq % r->nslots];
+    return (m->ctrl & UMP_CTRL_EPOCH) == ump_ring_epoch(r);
+}
+
+/**
+ * \brief Check if a message can be sent without overrunning the receiver
+ */
+static inline bool ump_chan_can_send(struct ump_chan *uc)
+{
+    struct ump_ring *r = &uc->send;
+    if (r->seq - r->acked < r->nslots) {
+        return true;
+    }
+    r->acked = *r->ack;
+    dmb();  // don't reuse a slot before the receiver's reads of it are done
+    return r->seq - r->acked < r->nslots;
+}
+
+__END_DECLS
+
+#endif // BARRELFISH_UMP_CHAN_H
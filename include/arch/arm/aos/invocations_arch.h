@@ -120,6 +120,16 @@ static inline struct sysret cap_invoke(struct capref to, uintptr_t argc, uintptr
  * \return Error code
  */
 STATIC_ASSERT(ObjType_Num < 0xFFFF, "retype invocation argument packing does not truncate enum objtype");
+
+/// Pack the destination level and new type of a retype into one argument
+static inline uintptr_t invoke_retype_pack_type(enum cnode_type to_level,
+                                                enum objtype newtype)
+{
+    assert(newtype < ObjType_Num);
+    assert(to_level <= 0xF);
+    return ((uint32_t)to_level << 16) | newtype;
+}
+
 static inline errval_t
 invoke_cnode_retype(struct capref root, capaddr_t src_cspace, capaddr_t cap,
                     gensize_t offset, enum objtype newtype, gensize_t objsize,
@@ -128,17 +138,29 @@ invoke_cnode_retype(struct capref root, capaddr_t src_cspace, capaddr_t cap,
 {
     assert(cap != CPTR_NULL);
 
-    assert(newtype < ObjType_Num);
     assert(offset <= 0xFFFFFFFF);
     assert(objsize <= 0xFFFFFFFF);
     assert(count <= 0xFFFFFFFF);
-    assert(to_level <= 0xF);
 
     return cap_invoke10(root, CNodeCmd_Retype, src_cspace, cap, offset,
-                        ((uint32_t)to_level << 16) | newtype,
+                        invoke_retype_pack_type(to_level, newtype),
                         objsize, count, to_cspace, to, slot).error;
 }
 
+/// Pack the levels and slots of a VNode map into one argument
+static inline uintptr_t invoke_vnode_map_pack(capaddr_t slot,
+                                              enum cnode_type srclevel,
+                                              enum cnode_type mcnlevel,
+                                              cslot_t mapping_slot)
+{
+    assert(slot <= 0xffff);
+    assert(srclevel <= 0xf);
+    assert(mcnlevel <= 0xf);
+    assert(mapping_slot <= L2_CNODE_SLOTS);
+
+    return srclevel | (mcnlevel << 4) | (mapping_slot << 8) | (slot << 16);
+}
+
 static inline errval_t
 invoke_vnode_map(struct capref ptable, capaddr_t slot,
                  capaddr_t src_root, capaddr_t src,
@@ -147,18 +169,12 @@ invoke_vnode_map(struct capref ptable, capaddr_t slot,
                  capaddr_t mcnroot, capaddr_t mcnaddr,
                  enum cnode_type mcnlevel, cslot_t mapping_slot)
 {
-    assert(slot <= 0xffff);
-    assert(srclevel <= 0xf);
-    assert(mcnlevel <= 0xf);
     assert(offset <= 0xffffffff);
     assert(flags <= 0xffffffff);
     assert(pte_count <= 0xffff);
-    assert(mapping_slot <= L2_CNODE_SLOTS);
 
-    uintptr_t small_values = srclevel |
-                             (mcnlevel << 4) |
-                             (mapping_slot << 8) |
-                             (slot << 16);
+    uintptr_t small_values = invoke_vnode_map_pack(slot, srclevel, mcnlevel,
+                                                   mapping_slot);
 
     return cap_invoke9(ptable, VNodeCmd_Map, src_root, src, flags, offset,
                        pte_count, mcnroot, mcnaddr, small_values).error;
@@ -433,6 +433,7 @@ enum kernel_cmd {
     KernelCmd_Remove_kcb,         ///< remove kcb from scheduling ring
     KernelCmd_Suspend_kcb_sched,  ///< suspend/resume kcb scheduler
     KernelCmd_Get_platform,       ///< Get architecture platform
+    KernelCmd_Profile,            ///< Set up PC sampling profile buffer
     KernelCmd_Count
 };
 
@@ -450,6 +451,7 @@ enum dispatcher_cmd {
     DispatcherCmd_Vmwrite,          ///< Execute vmwrite on the current and active VMCS
     DispatcherCmd_Vmptrld,          ///< Make VMCS clear and inactive
     DispatcherCmd_Vmclear,          ///< Make VMCS current and active 
+    DispatcherCmd_Stats,            ///< Read accounting information
 };
 
 /**
@@ -471,6 +473,7 @@ enum kcb_cmd {
  */
 enum ram_cmd {
     RAMCmd_Identify,      ///< Return physical address of frame
+    RAMCmd_Zero,          ///< Zero more of the region ahead of retyping
 };
 
 /**
@@ -0,0 +1,57 @@
+/**
+ * \file
+ * \brief Per-dispatcher performance counters
+ *
+ * DispatcherCmd_PerfMon programs up to PERFMON_COUNTERS PMU events for one
+ * dispatcher. The kernel only lets them count while that dispatcher runs,
+ * including time in the kernel on its behalf, and accumulates them in its
+ * DCB across context switches.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#ifndef BARRELFISH_KPI_DISPATCHER_PERFMON_H
+#define BARRELFISH_KPI_DISPATCHER_PERFMON_H
+
+#include <stdint.h>
+
+/// Events a dispatcher can count at once
+#define PERFMON_COUNTERS        4
+
+/// Operations of DispatcherCmd_PerfMon
+enum perfmon_op {
+    PerfMonOp_Setup,    ///< Program events, and reset the counts
+    PerfMonOp_Read,     ///< Copy out the counts so far
+};
+
+/*
+ * ARMv7 common event numbers, see the ARMv7 ARM, C12.8. Cortex-A9 doesn't
+ * implement INST_RETIRED; its closest is PERFMON_EVENT_A9_INST_RENAMED.
+ */
+#define PERFMON_EVENT_NONE              0x00    ///< Counter unused
+#define PERFMON_EVENT_L1I_CACHE_REFILL  0x01
+#define PERFMON_EVENT_L1I_TLB_REFILL    0x02
+#define PERFMON_EVENT_L1D_CACHE_REFILL  0x03
+#define PERFMON_EVENT_L1D_TLB_REFILL    0x05
+#define PERFMON_EVENT_INST_RETIRED      0x08
+#define PERFMON_EVENT_BR_MIS_PRED       0x10
+#define PERFMON_EVENT_A9_INST_RENAMED   0x68
+
+/// Events to count, one per counter; PERFMON_EVENT_NONE leaves one unused
+struct perfmon_events {
+    uint8_t event[PERFMON_COUNTERS];
+};
+
+/// Counts since the events were programmed
+struct perfmon_counts {
+    uint64_t count[PERFMON_COUNTERS];
+};
+
+#endif // BARRELFISH_KPI_DISPATCHER_PERFMON_H
@@ -0,0 +1,36 @@
+/**
+ * \file
+ * \brief Per-dispatcher accounting kept by the kernel
+ *
+ * The kernel keeps these counters in each DCB, from the moment it is
+ * created, and copies them out through DispatcherCmd_Stats. Run time is in
+ * ticks of the platform's timestamp counter, whose frequency the invocation
+ * returns alongside.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#ifndef BARRELFISH_KPI_DISPATCHER_STATS_H
+#define BARRELFISH_KPI_DISPATCHER_STATS_H
+
+#include <stdint.h>
+#include <barrelfish_kpi/syscalls.h>
+
+struct dispatcher_stats {
+    uint64_t run_ticks;         ///< Time run, including in the kernel
+    uint64_t dispatches;        ///< Times switched to
+    uint64_t yields;            ///< Times it yielded, or blocked on a call
+    uint64_t preemptions;       ///< Times an interrupt switched it out
+    uint64_t lmp_sent;          ///< LMP messages sent
+    uint64_t lmp_received;      ///< LMP messages delivered to it
+    uint64_t syscalls[SYSCALL_COUNT]; ///< System calls made, by number
+};
+
+#endif // BARRELFISH_KPI_DISPATCHER_STATS_H
@@ -0,0 +1,45 @@
+/**
+ * \file
+ * \brief Descriptors for batched capability invocations
+ *
+ * SYSCALL_INVOKE_BATCH takes a user buffer of these and a count. The kernel
+ * runs the invocations in order, exactly as if each had been made with its
+ * own SYSCALL_INVOKE, writes each one's result back into its descriptor,
+ * and stops after the first one that fails. The syscall returns the error
+ * of that invocation, if any, and the number of descriptors it processed.
+ *
+ * Endpoint invocations can't be batched, as they may switch to another
+ * dispatcher.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#ifndef BARRELFISH_KPI_INVOKE_BATCH_H
+#define BARRELFISH_KPI_INVOKE_BATCH_H
+
+#include <barrelfish_kpi/types.h>
+#include <barrelfish_kpi/syscalls.h>
+
+/// Most arguments, after the command, one invocation can take
+#define INVOKE_BATCH_MAX_ARGS   10
+
+/// Most invocations in one batch
+#define INVOKE_BATCH_MAX        32
+
+struct invoke_batch_entry {
+    capaddr_t cptr;         ///< Capability to invoke
+    uint8_t level;          ///< Level of cptr
+    uint8_t cmd;            ///< Invocation command
+    uint8_t argc;           ///< Number of arguments used
+    uintptr_t args[INVOKE_BATCH_MAX_ARGS];
+    struct sysret ret;      ///< Result, filled-in by the kernel
+};
+
+#endif // BARRELFISH_KPI_INVOKE_BATCH_H
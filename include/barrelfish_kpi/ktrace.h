@@ -0,0 +1,85 @@
+/**
+ * \file
+ * \brief Layout of the kernel's event trace buffer
+ *
+ * A privileged domain hands the kernel a frame with KernelCmd_Setup_trace.
+ * The kernel of that core then appends a timestamped record to a ring in the
+ * frame for each event of a subsystem enabled in 'mask', which the domain
+ * can change at any time.
+ *
+ * The ring is a flight recorder: the kernel never waits for the reader, and
+ * overwrites the oldest records once it's full. 'head' counts the records
+ * written, record n is at records[n % nrecords], and nrecords is a power of
+ * two. A reader copies the records it wants, then reads 'head' again; any
+ * record older than that head less nrecords may have been overwritten while
+ * it was being copied.
+ *
+ * Records name dispatchers by their index in 'dispatchers', which the kernel
+ * fills in the first time a dispatcher appears in the trace.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#ifndef BARRELFISH_KPI_KTRACE_H
+#define BARRELFISH_KPI_KTRACE_H
+
+#include <stdint.h>
+#include <barrelfish_kpi/shared_buffer.h>
+
+#define KTRACE_MAGIC            0x4b545243      ///< "KTRC"
+
+/// Dispatchers a trace can tell apart, others show up as KTRACE_DISP_NONE
+#define KTRACE_MAX_DISPATCHERS  64
+
+/// Dispatcher index for none, e.g. when the core is idle
+#define KTRACE_DISP_NONE        0xff
+
+/// Subsystems, for the enable mask
+#define KTRACE_SUBSYS_SYSCALL   0x01
+#define KTRACE_SUBSYS_LMP       0x02
+#define KTRACE_SUBSYS_DISPATCH  0x04
+#define KTRACE_SUBSYS_IRQ       0x08
+#define KTRACE_SUBSYS_WAKEUP    0x10
+#define KTRACE_SUBSYS_ALL       0x1f
+
+enum ktrace_event {
+    KTraceSyscall = 1,  ///< Syscall entry; arg: r0 as cap_invoke() sets it
+    KTraceSyscallRet,   ///< Syscall return; arg: error
+    KTraceLmpSend,      ///< LMP message delivered; disp: sender, peer:
+                        ///< receiver, arg: payload words
+    KTraceNotify,       ///< IPI notification raised; arg: core << 16 | channel
+    KTraceDispatch,     ///< Switched to disp, none for idle
+    KTraceIrq,          ///< Interrupt taken; arg: IRQ number
+    KTraceWakeup,       ///< disp woken up from a timed wait
+};
+
+struct ktrace_record {
+    uint64_t ts;                        ///< timestamp_read() ticks
+    uint8_t event;                      ///< enum ktrace_event
+    uint8_t disp;                       ///< Index in dispatchers[]
+    uint8_t peer;                       ///< Index in dispatchers[]
+    uint8_t reserved;
+    uint32_t arg;
+};
+
+struct ktrace_buffer {
+    uint32_t magic;                     ///< KTRACE_MAGIC, once set up
+    uint32_t nrecords;                  ///< Size of records[]
+    volatile uint32_t head;             ///< Records written
+    volatile uint32_t mask;             ///< Subsystems traced
+    uint32_t tick_hz;                   ///< Rate of timestamps
+    uint32_t core;                      ///< Core traced
+    volatile uint32_t ndispatchers;     ///< Entries used in dispatchers[]
+    uint32_t reserved;
+    struct shared_buffer_dispatcher dispatchers[KTRACE_MAX_DISPATCHERS];
+    struct ktrace_record records[];
+};
+
+#endif // BARRELFISH_KPI_KTRACE_H
@@ -36,6 +36,9 @@ typedef enum lmp_send_flag {
     LMP_FLAG_SYNC       = 1 << 0,
     LMP_FLAG_YIELD      = 1 << 1,
     LMP_FLAG_GIVEAWAY   = 1 << 2,
+    /// Switch to the receiver and block until a message arrives for us.
+    /// Serves both as a client's call and as a server's reply-and-receive.
+    LMP_FLAG_CALL       = 1 << 3,
 } lmp_send_flags_t;
 
 #define LMP_SEND_FLAGS_DEFAULT (LMP_FLAG_SYNC | LMP_FLAG_YIELD)
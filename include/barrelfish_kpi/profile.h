@@ -0,0 +1,67 @@
+/**
+ * \file
+ * \brief Layout of the kernel's PC sampling profile buffer
+ *
+ * A privileged domain hands the kernel a frame with KernelCmd_Profile. On
+ * every timer interrupt, the kernel then records which dispatcher was
+ * interrupted and its PC and LR in a ring of samples in that frame, which
+ * the domain maps and drains.
+ *
+ * The kernel only writes 'head', and the draining domain only writes
+ * 'tail'; both count samples since profiling started, and sample n is at
+ * samples[n % nsamples]. If the ring is full, the kernel drops samples and
+ * counts them in 'dropped' instead.
+ *
+ * Samples name dispatchers by their index in 'dispatchers', which the
+ * kernel fills in the first time it samples one. The name there is the one
+ * in the dispatcher's shared structure, which spawn sets to the binary name,
+ * so that samples can be symbolised against that binary.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#ifndef BARRELFISH_KPI_PROFILE_H
+#define BARRELFISH_KPI_PROFILE_H
+
+#include <stdint.h>
+#include <barrelfish_kpi/shared_buffer.h>
+
+#define PROFILE_MAGIC           0x50524f46      ///< "PROF"
+
+/// Dispatchers a profile can tell apart, samples of others are dropped
+#define PROFILE_MAX_DISPATCHERS 32
+
+/// Dispatcher index of samples taken while the core was idle
+#define PROFILE_DISP_IDLE       0xffff
+
+/// Sample flags
+#define PROFILE_SAMPLE_DISABLED 0x1     ///< Dispatcher was disabled
+
+struct profile_sample {
+    uint32_t pc;
+    uint32_t lr;
+    uint16_t disp;                      ///< Index in dispatchers[]
+    uint16_t flags;
+};
+
+struct profile_buffer {
+    uint32_t magic;                     ///< PROFILE_MAGIC, once set up
+    uint32_t nsamples;                  ///< Size of samples[]
+    volatile uint32_t head;             ///< Samples written
+    volatile uint32_t tail;             ///< Samples consumed
+    volatile uint32_t dropped;          ///< Samples lost to a full ring
+    volatile uint32_t ndispatchers;     ///< Entries used in dispatchers[]
+    uint32_t tick_ms;                   ///< Time between samples
+    uint32_t reserved;
+    struct shared_buffer_dispatcher dispatchers[PROFILE_MAX_DISPATCHERS];
+    struct profile_sample samples[];
+};
+
+#endif // BARRELFISH_KPI_PROFILE_H
@@ -0,0 +1,29 @@
+/**
+ * \file
+ * \brief Parts common to the buffers the kernel fills in user frames
+ *
+ * The profile and event trace buffers name dispatchers by their index in a
+ * table of these, which the kernel fills in the first time it sees one.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#ifndef BARRELFISH_KPI_SHARED_BUFFER_H
+#define BARRELFISH_KPI_SHARED_BUFFER_H
+
+#include <stdint.h>
+#include <barrelfish_kpi/dispatcher_shared.h>
+
+struct shared_buffer_dispatcher {
+    uint32_t dcb;                       ///< Kernel's tag for it
+    char name[DISP_NAME_LEN];           ///< Not NUL-terminated if full
+};
+
+#endif // BARRELFISH_KPI_SHARED_BUFFER_H
@@ -34,7 +34,10 @@ enum debug_message {
     DEBUG_FEIGN_FRAME_CAP,
     DEBUG_TRACE_PMEM_CTRL,
     DEBUG_GET_APIC_ID,
-    DEBUG_CREATE_IRQ_SRC_CAP
+    DEBUG_CREATE_IRQ_SRC_CAP,
+    DEBUG_CAP_LOOKUP_CACHE_RESET,
+    DEBUG_CAP_LOOKUP_CACHE_HITS_READ,
+    DEBUG_CAP_LOOKUP_CACHE_COUNT_READ
 };
 
 #endif //BARRELFISH_KPI_SYS_DEBUG_H
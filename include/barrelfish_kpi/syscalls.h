@@ -60,7 +60,10 @@ struct sysret {
 #define SYSCALL_ARMv7_CACHE_CLEAN    8    ///< Clean (write back) by VA
 #define SYSCALL_ARMv7_CACHE_INVAL    9    ///< Invalidate (discard) by VA
 
-#define SYSCALL_COUNT               12     ///< Number of syscalls [0..SYSCALL_COUNT - 1]
+/* Batched capability invocations, see barrelfish_kpi/invoke_batch.h */
+#define SYSCALL_INVOKE_BATCH        12    ///< Invoke a list of caps
+
+#define SYSCALL_COUNT               13     ///< Number of syscalls [0..SYSCALL_COUNT - 1]
 
 /*
  * To understand system calls it might be helpful to know that there
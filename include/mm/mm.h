@@ -20,6 +20,7 @@
 #include <aos/types.h>
 #include <aos/capabilities.h>
 #include <aos/slab.h>
+#include <aos/thread_sync.h>
 #include "slot_alloc.h"
 
 __BEGIN_DECLS
@@ -50,6 +51,7 @@ struct mmnode {
  */
 struct mm {
     struct slab_allocator slabs; ///< Slab allocator used for allocating nodes
+    slab_refill_func_t slab_refill; ///< Slab refill function, called unlocked
     slot_alloc_t slot_alloc;     ///< Slot allocator for allocating cspace
     slot_refill_t slot_refill;   ///< Slot allocator refill function
     void *slot_alloc_inst;       ///< Opaque instance pointer for slot allocator
@@ -59,6 +61,10 @@ struct mm {
 
     bool slabs_refilling;
     bool slots_refilling;
+
+    /// Guards all of the above. Taken recursively, since refilling slots
+    /// may allocate from this same instance.
+    struct thread_mutex lock;
 };
 
 errval_t mm_init(struct mm *mm, enum objtype objtype,
@@ -31,15 +31,14 @@ context_switch(struct dcb *dcb) {
     assert(dcb != NULL);
     assert(dcb->vspace != 0);
 
-    paging_context_switch(dcb->vspace);
+    /* The CONTEXTID register holds the ASID in its low 8 bits, and a
+     * process ID the debugger can tell dispatchers apart by above that.
+     * We use the physical address of the dispatcher control block, whose
+     * low 10 bits are zero. */
+    uint32_t contextidr = (((uint32_t)dcb) & ~MASK(8)) | paging_asid_get(dcb);
+    paging_context_switch(dcb->vspace, contextidr);
     context_switch_counter++;
 
-    /* Write the CONTEXTID register, so that the debugger can tell dispatchers
-     * apart.  We use the physical address of the dispatcher control block.
-     * Note that the low 10 bits of dcb are zero, and the lower 8 bits of the
-     * register hold the ASID, which we're not yet using. */
-    cp15_write_contextidr(((uint32_t)dcb) & ~MASK(8));
-
     assert(dcb->disp_cte.cap.type == ObjType_Frame);
 
     /*
@@ -19,8 +19,11 @@
 #include <misc.h>
 #include <stdio.h>
 #include <wakeup.h>
+#include <timer.h>
 #include <irq.h>
 #include <gic.h>
+#include <ktrace.h>
+#include <profile.h>
 
 void handle_user_page_fault(lvaddr_t fault_address,
                             arch_registers_state_t* save_area,
@@ -293,6 +296,20 @@ void handle_irq_kernel(arch_registers_state_t* save_area,
     handle_irq(save_area, fault_pc, NULL);
 }
 
+/**
+ * \brief Pick what runs after an interrupt, counting a preemption if it
+ * isn't the dispatcher that was interrupted.
+ */
+static void __attribute__((noreturn)) irq_reschedule(void)
+{
+    struct dcb *interrupted = dcb_current;
+    struct dcb *next = schedule();
+    if (interrupted != NULL && next != interrupted) {
+        interrupted->stats.preemptions++;
+    }
+    dispatch(next);
+}
+
 void handle_irq(arch_registers_state_t* save_area, 
                 uintptr_t fault_pc, 
                 struct dispatcher_shared_arm *disp)
@@ -319,23 +336,38 @@ void handle_irq(arch_registers_state_t* save_area,
     // Retrieve the current IRQ number
     uint32_t irq = 0;
     irq = gic_get_active_irq();
+    ktrace(KTRACE_SUBSYS_IRQ, KTraceIrq, dcb_current, NULL, irq);
     debug(SUBSYS_DISPATCH, "IRQ %"PRIu32" while %s\n", irq,
           dcb_current->disabled ? "disabled": "enabled" );
     
+#ifdef CONFIG_ONESHOT_TIMER
+    // there's no tick to keep kernel_now current, see timer.c
+    kernel_now = timer_now();
+#endif
+
     // Offer it to the timer
     if (timer_interrupt(irq)) {
         // Timer interrupt, timer_interrupt() acks it at the timer.
         assert(kernel_ticks_enabled);
+        profile_sample(save_area, fault_pc);
+#ifndef CONFIG_ONESHOT_TIMER
         kernel_now += kernel_timeslice;
+#endif
         wakeup_check(kernel_now);
-        dispatch(schedule());
+        irq_reschedule();
     }
     // this is the (still) unacknowledged startup interrupt sent by the BSP
     // we just acknowledge it here
     else if(irq == 1)
     {
         gic_ack_irq(irq);
-        dispatch(schedule());
+        irq_reschedule();
+    }
+    // another core raised a notification for a channel on this one
+    else if (irq == IPI_NOTIFY_SGI) {
+        gic_ack_irq(irq);
+        ipi_handle_notify();
+        irq_reschedule();
     }
     else {
         gic_ack_irq(irq);
@@ -24,6 +24,9 @@
 #include <arch/arm/syscall_arm.h>
 #include <kcb.h>
 #include <arch/arm/gic.h>
+#include <cp15.h>
+#include <global.h>
+#include <ktrace.h>
 
 /**
  * \brief User-space IRQ dispatch table.
@@ -168,3 +171,119 @@ void send_user_interrupt(int irq)
     dispatch(schedule());
 #endif
 }
+
+/**
+ * \brief Endpoints listening on this core's IPI notification channels.
+ *
+ * Another core raising a notification for a channel sets its bit in our
+ * mailbox in the shared global state, and sends us #IPI_NOTIFY_SGI.
+ */
+static struct cte notify_dispatch[IPI_NOTIFY_CHANS];
+
+errval_t ipi_register_notification(capaddr_t ep, uint8_t level,
+                                   unsigned int chanid)
+{
+    struct cte *recv;
+    errval_t err;
+
+    if (chanid >= IPI_NOTIFY_CHANS) {
+        return SYS_ERR_IPI_NOTIFY_CHANID;
+    }
+
+    err = caps_lookup_slot(&dcb_current->cspace.cap, ep, level, &recv,
+                           CAPRIGHTS_WRITE);
+    if (err_is_fail(err)) {
+        return err_push(err, SYS_ERR_IRQ_LOOKUP);
+    }
+
+    assert(recv != NULL);
+
+    if (recv->cap.type != ObjType_EndPoint) {
+        return SYS_ERR_IRQ_NOT_ENDPOINT;
+    }
+    if (recv->cap.u.endpoint.listener == NULL) {
+        return SYS_ERR_IRQ_NO_LISTENER;
+    }
+
+    if (notify_dispatch[chanid].cap.type != ObjType_Null) {
+        printk(LOG_NOTE, "replacing listener for notification channel %u\n",
+               chanid);
+    }
+    return caps_copy_to_cte(&notify_dispatch[chanid], recv, false, 0, 0);
+}
+
+errval_t ipi_delete_notification(unsigned int chanid)
+{
+    if (chanid >= IPI_NOTIFY_CHANS) {
+        return SYS_ERR_IPI_NOTIFY_CHANID;
+    }
+    notify_dispatch[chanid].cap.type = ObjType_Null;
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief Signal a notification channel on another (or this) core.
+ *
+ * Notifications raised while the target still has one pending for the same
+ * channel are merged, and only the first of them sends an SGI.
+ */
+errval_t ipi_raise_notify(coreid_t coreid, unsigned int chanid)
+{
+    if (coreid >= IPI_NOTIFY_MAX_CORES || coreid >= gic_cpu_count()) {
+        return SYS_ERR_CORE_NOT_FOUND;
+    }
+    if (chanid >= IPI_NOTIFY_CHANS) {
+        return SYS_ERR_IPI_NOTIFY_CHANID;
+    }
+
+    ktrace(KTRACE_SUBSYS_LMP, KTraceNotify, dcb_current, NULL,
+           (coreid << 16) | chanid);
+
+    uint32_t bit = 1U << (chanid % 32);
+    uint32_t old = __atomic_fetch_or(
+            &global->notify.pending[coreid][chanid / 32], bit,
+            __ATOMIC_SEQ_CST);
+    if (old & bit) {
+        return SYS_ERR_OK;
+    }
+
+    // the mailbox write must reach the target before the interrupt does
+    dsb();
+    gic_raise_softirq(1U << coreid, IPI_NOTIFY_SGI);
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief Turn pending IPI notifications for this core into endpoint events.
+ *
+ * Each pending channel gets an empty LMP message on its endpoint, which
+ * wakes the listener and triggers its waitset.
+ */
+void ipi_handle_notify(void)
+{
+    assert(my_core_id < IPI_NOTIFY_MAX_CORES);
+
+    for (int w = 0; w < IPI_NOTIFY_CHANS / 32; w++) {
+        uint32_t pending = __atomic_exchange_n(
+                &global->notify.pending[my_core_id][w], 0, __ATOMIC_SEQ_CST);
+
+        while (pending != 0) {
+            int chanid = w * 32 + __builtin_ctz(pending);
+            pending &= pending - 1;
+
+            struct capability *cap = &notify_dispatch[chanid].cap;
+            if (cap->type == ObjType_Null) {
+                printk(LOG_DEBUG, "notification for unused channel %d\n",
+                       chanid);
+                continue;
+            }
+
+            assert(cap->type == ObjType_EndPoint);
+            errval_t err = lmp_deliver_notification(cap);
+            // a full endpoint already has a notification waiting
+            if (err_is_fail(err) && err_no(err) != SYS_ERR_LMP_BUF_OVERFLOW) {
+                printk(LOG_ERR, "Unexpected error delivering notification\n");
+            }
+        }
+    }
+}
@@ -0,0 +1,118 @@
+/**
+ * \file
+ * \brief Timer-driven PC sampling profiler.
+ *
+ * While a profile buffer is set up, every timer interrupt records where the
+ * interrupted dispatcher was, see barrelfish_kpi/profile.h. The kernel
+ * itself is never sampled, as it only takes interrupts while idle. With
+ * CONFIG_ONESHOT_TIMER, timer interrupts only come at scheduling events, so
+ * for an unbiased profile, build with the periodic tick.
+ *
+ * Only 'tail' is read back from the buffer, everything else the kernel keeps
+ * to itself and just publishes there.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <kernel.h>
+#include <string.h>
+#include <barrelfish_kpi/profile.h>
+#include <dispatch.h>
+#include <profile.h>
+#include <shared_buffer.h>
+
+/// The buffer, or NULL if we're not profiling
+static struct profile_buffer *profile_buf;
+
+static void profile_stopped(void)
+{
+    profile_buf = NULL;
+}
+
+static struct shared_buffer profile_shared = { .stopped = profile_stopped };
+
+/// Size of profile_buf->samples, samples written and samples dropped
+static uint32_t profile_nsamples;
+static uint32_t profile_head;
+static uint32_t profile_dropped;
+
+/**
+ * \brief Start sampling into a frame of the calling dispatcher.
+ *
+ * Replaces the buffer of an earlier call. A cptr of 0 just stops sampling.
+ */
+errval_t profile_setup(capaddr_t frame, uint8_t level)
+{
+    errval_t err = shared_buffer_setup(&profile_shared, frame, level,
+                                       sizeof(struct profile_buffer) +
+                                       sizeof(struct profile_sample));
+    if (err_is_fail(err) || profile_shared.base == NULL) {
+        return err;
+    }
+
+    struct profile_buffer *buf = profile_shared.base;
+    memset(buf, 0, sizeof(*buf));
+    profile_nsamples = (profile_shared.bytes - sizeof(*buf)) /
+                       sizeof(struct profile_sample);
+    profile_head = profile_dropped = 0;
+    buf->nsamples = profile_nsamples;
+    buf->tick_ms = kernel_timeslice;
+    buf->magic = PROFILE_MAGIC;
+    shared_buffer_set_dispatchers(&profile_shared, buf->dispatchers,
+                                  &buf->ndispatchers, PROFILE_MAX_DISPATCHERS);
+    profile_buf = buf;
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief Record where the current dispatcher was interrupted.
+ *
+ * \param save_area Its saved registers, or NULL if the core was idle
+ * \param fault_pc  Where it was interrupted
+ */
+void profile_sample(arch_registers_state_t *save_area, uintptr_t fault_pc)
+{
+    struct profile_buffer *buf = profile_buf;
+    if (buf == NULL) {
+        return;
+    }
+    // the frame must still be ours, see shared_buffer_cte_cleanup()
+    assert(profile_shared.frame.cap.type == ObjType_Frame);
+
+    // tail is the reader's, so clamp it to what we've written
+    uint32_t head = profile_head;
+    uint32_t used = head - buf->tail;
+    if (used > profile_nsamples) {
+        used = profile_nsamples;
+    }
+    if (used == profile_nsamples) {
+        buf->dropped = ++profile_dropped;
+        return;
+    }
+
+    struct profile_sample s = { .pc = fault_pc };
+    if (dcb_current == NULL || save_area == NULL) {
+        s.disp = PROFILE_DISP_IDLE;
+    } else {
+        int i = shared_buffer_disp_index(&profile_shared, dcb_current);
+        if (i < 0) {
+            buf->dropped = ++profile_dropped;
+            return;
+        }
+        s.disp = i;
+        s.lr = save_area->named.lr;
+        s.flags = dcb_current->disabled ? PROFILE_SAMPLE_DISABLED : 0;
+    }
+
+    buf->samples[head % profile_nsamples] = s;
+    // the sample must be visible before the head says it's there
+    profile_head = head + 1;
+    __atomic_store_n(&buf->head, profile_head, __ATOMIC_RELEASE);
+}
@@ -65,3 +65,35 @@ uint32_t a9_gt_read_high(void)
 {
     return cortex_a9_gt_TimerCounterHigh_rd(&a9_gt);
 }
+
+/*
+ * Raise the global timer interrupt once the counter reaches t.
+ */
+void a9_gt_set_comparator(uint64_t t)
+{
+    // Comparison is disabled while the two halves are written, as the TRM
+    // recommends.
+    cortex_a9_gt_TimerControl_comp_enable_wrf(&a9_gt, 0x0);
+    cortex_a9_gt_TimerControl_auto_increment_wrf(&a9_gt, 0x0);
+
+    // Early revisions only fire when the counter equals the comparator, so
+    // make sure it's still ahead once comparison is on again.
+    uint64_t now = a9_gt_read();
+    if(t < now + A9_GT_MIN_DELTA) {
+        t = now + A9_GT_MIN_DELTA;
+    }
+    cortex_a9_gt_TimerComparatorLow_wr(&a9_gt, (uint32_t)t);
+    cortex_a9_gt_TimerComparatorHigh_wr(&a9_gt, (uint32_t)(t >> 32));
+
+    cortex_a9_gt_TimerControl_int_enable_wrf(&a9_gt, 0x1);
+    cortex_a9_gt_TimerControl_comp_enable_wrf(&a9_gt, 0x1);
+}
+
+/*
+ * Stop comparing, and clear any pending event.
+ */
+void a9_gt_disarm(void)
+{
+    cortex_a9_gt_TimerControl_comp_enable_wrf(&a9_gt, 0x0);
+    cortex_a9_gt_TimerIntStat_event_flag_wrf(&a9_gt, 0x1);
+}
@@ -23,6 +23,7 @@
 #include <paging_kernel_arch.h>
 #include <serial.h>
 #include <stdio.h>
+#include <string.h>
 
 #define MSG(format, ...) printk( LOG_NOTE, "ARMv7-A: "format, ## __VA_ARGS__ )
 
@@ -261,6 +262,7 @@ void boot_bsp_core(void *pointer, void *cpu_driver_entry,
     /* The spinlocks are in the BSS, and thus already zeroed, but it's polite
      * to explicitly initialize them here... */
     spinlock_init(&global->locks.print);
+    memset(&global->notify, 0, sizeof(global->notify));
 
     MSG("Boot driver invoked as: %s\n", cmdline);
 
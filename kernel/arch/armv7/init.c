@@ -27,8 +27,10 @@
 #include <init.h>
 #include <kcb.h>
 #include <kernel_multiboot.h>
+#include <microbenchmarks.h>
 #include <offsets.h>
 #include <paging_kernel_arch.h>
+#include <perfmon.h>
 #include <platform.h>
 #include <serial.h>
 #include <startup_arch.h>
@@ -71,6 +73,7 @@ static struct cmdarg cmdargs[] = {
     { "periphbase",  ArgType_UInt, { .uinteger = (void *)0 } },
     { "timerirq"  ,  ArgType_UInt, { .uinteger = (void *)0 } },
     { "cntfrq"  ,    ArgType_UInt, { .uinteger = (void *)0 } },
+    { "microbenchmarks", ArgType_Bool, { .boolean = (void *)0 } },
     { NULL, 0, { NULL } }
 };
 
@@ -85,6 +88,7 @@ init_cmdargs(void) {
     cmdargs[6].var.uinteger= &periphbase;
     cmdargs[7].var.uinteger= &timerirq;
     cmdargs[8].var.uinteger= &cntfrq;
+    cmdargs[9].var.boolean=  &kernel_microbenchmarks;
 }
 
 /**
@@ -136,6 +140,7 @@ static void perf_measurement_init(void) {
     /* Program PMU and enable all counters */
     __asm__ volatile("mcr p15, 0, %0, c9, c12, 0" :: "r"(1 | 16));
     __asm__ volatile("mcr p15, 0, %0, c9, c12, 1" :: "r"(0x8000000f));
+    perfmon_init();
 }
 
 /**
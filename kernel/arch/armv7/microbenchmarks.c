@@ -0,0 +1,560 @@
+/**
+ * \file
+ * \brief ARMv7 kernel microbenchmarks.
+ *
+ * These time the kernel paths that user-level code pays for most often: a
+ * null system call, LMP delivery, capability lookup, retype, mapping and
+ * unmapping a page, switching between dispatchers, and cache and TLB
+ * maintenance. With "microbenchmarks=true" on the kernel command line, they
+ * run on the BSP once init has been created, before it first runs.
+ *
+ * Everything they work on is created, as init's own objects are, in memory
+ * set aside for them before init gets the rest: a dispatcher with its own
+ * vspace and endpoint, a page table and a frame to map into it, and RAM to
+ * retype. Lookups go through init's CSpace, whose layout is fixed.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetsstrasse 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <kernel.h>
+#include <stdio.h>
+#include <string.h>
+#include <barrelfish_kpi/init.h>
+#include <barrelfish_kpi/lmp.h>
+#include <barrelfish_kpi/syscalls.h>
+#include <cache.h>
+#include <capabilities.h>
+#include <cp15.h>
+#include <dispatch.h>
+#include <microbenchmarks.h>
+#include <paging_kernel_arch.h>
+#include <schedule.h>
+
+/*
+ * The arena, in the order arch_microbenchmarks_init() carves it up. The L1
+ * table comes first, as the arena is aligned for it, and everything after it
+ * is a whole number of pages.
+ */
+#define MB_VSPACE_BYTES     ARM_L1_ALIGN
+#define MB_CNODE_BYTES      OBJSIZE_L2CNODE
+#define MB_RETYPE_CN_BYTES  OBJSIZE_L2CNODE
+#define MB_DCB_BYTES        BASE_PAGE_SIZE
+#define MB_DISPFRAME_BYTES  (2 * BASE_PAGE_SIZE)
+#define MB_PTABLE_BYTES     BASE_PAGE_SIZE
+#define MB_FRAME_BYTES      BASE_PAGE_SIZE
+#define MB_RETYPE_MAX       L2_CNODE_SLOTS
+#define MB_RAM_BYTES        (MB_RETYPE_MAX * BASE_PAGE_SIZE)
+
+const size_t arch_microbenchmarks_arena_bytes =
+    MB_VSPACE_BYTES + MB_CNODE_BYTES + MB_RETYPE_CN_BYTES + MB_DCB_BYTES +
+    MB_DISPFRAME_BYTES + MB_PTABLE_BYTES + MB_FRAME_BYTES + MB_RAM_BYTES;
+
+/* Slots of the benchmarks' own CNode */
+#define MB_SLOT_DISPATCHER  0
+#define MB_SLOT_DISPFRAME   1
+#define MB_SLOT_EP_BASE     2   ///< Endpoint as retyped from the dispatcher
+#define MB_SLOT_EP          3   ///< ... and minted with its buffer
+#define MB_SLOT_VSPACE      4
+#define MB_SLOT_PTABLE      5
+#define MB_SLOT_PTABLE_MAP  6   ///< Page table in the vspace
+#define MB_SLOT_FRAME       7
+#define MB_SLOT_FRAME_MAP   8   ///< Frame in the page table
+#define MB_SLOT_RAM         9
+#define MB_SLOT_RETYPE_CN   10
+
+/// The endpoint buffer sits in the second page of the dispatcher frame
+#define MB_EP_OFFSET        BASE_PAGE_SIZE
+#define MB_EP_BUFLEN        (2 * (LMP_MSG_LENGTH + LMP_RECV_HEADER_LENGTH))
+
+/// Where the page table goes in the vspace
+#define MB_PTABLE_L1_SLOT   1
+
+#define MB_MAP_FLAGS        (KPI_PAGING_FLAGS_READ | KPI_PAGING_FLAGS_WRITE)
+
+static struct cte mb_cnode;
+static struct dcb *mb_init_dcb, *mb_dcb;
+
+static inline struct cte *mb_slot(cslot_t slot)
+{
+    return caps_locate_slot(get_address(&mb_cnode.cap), slot);
+}
+
+static int mb_fail(const char *what, errval_t err)
+{
+    printk(LOG_ERR, "%s: %"PRIuERRV"\n", what, err);
+    return -1;
+}
+
+/**
+ * \brief Create the objects the benchmarks work on, in 'arena'.
+ *
+ * 'arena' holds arch_microbenchmarks_arena_bytes, aligned for an L1 table,
+ * and 'init_dcb' is init's, not yet run.
+ */
+void arch_microbenchmarks_init(lpaddr_t arena, struct dcb *init_dcb)
+{
+    errval_t err;
+    lpaddr_t next = arena;
+
+    assert((arena & (ARM_L1_ALIGN - 1)) == 0);
+    mb_init_dcb = init_dcb;
+
+    lpaddr_t vspace = next;
+    next += MB_VSPACE_BYTES;
+    err = caps_create_new(ObjType_L2CNode, next, OBJSIZE_L2CNODE,
+                          OBJSIZE_L2CNODE, my_core_id, &mb_cnode);
+    assert(err_is_ok(err));
+    next += MB_CNODE_BYTES;
+    err = caps_create_new(ObjType_L2CNode, next, OBJSIZE_L2CNODE,
+                          OBJSIZE_L2CNODE, my_core_id,
+                          mb_slot(MB_SLOT_RETYPE_CN));
+    assert(err_is_ok(err));
+    next += MB_RETYPE_CN_BYTES;
+
+    // A dispatcher that never runs, but can be switched to and sent to
+    err = caps_create_new(ObjType_Dispatcher, next, 1UL << OBJBITS_DISPATCHER,
+                          0, my_core_id, mb_slot(MB_SLOT_DISPATCHER));
+    assert(err_is_ok(err));
+    mb_dcb = mb_slot(MB_SLOT_DISPATCHER)->cap.u.dispatcher.dcb;
+    next += MB_DCB_BYTES;
+
+    err = caps_create_new(ObjType_Frame, next, MB_DISPFRAME_BYTES,
+                          MB_DISPFRAME_BYTES, my_core_id,
+                          mb_slot(MB_SLOT_DISPFRAME));
+    assert(err_is_ok(err));
+    err = caps_copy_to_cte(&mb_dcb->disp_cte, mb_slot(MB_SLOT_DISPFRAME),
+                           false, 0, 0);
+    assert(err_is_ok(err));
+    mb_dcb->disp = local_phys_to_mem(next);
+    next += MB_DISPFRAME_BYTES;
+
+    struct dispatcher_shared_generic *disp =
+        get_dispatcher_shared_generic(mb_dcb->disp);
+    disp->disabled = true;
+    strncpy(disp->name, "microbench", DISP_NAME_LEN);
+    mb_dcb->disabled = true;
+
+    err = caps_retype(ObjType_EndPoint, 0, 1, &mb_cnode.cap, MB_SLOT_EP_BASE,
+                      mb_slot(MB_SLOT_DISPATCHER), 0, false);
+    assert(err_is_ok(err));
+    err = caps_copy_to_cnode(&mb_cnode, MB_SLOT_EP, mb_slot(MB_SLOT_EP_BASE),
+                             true, MB_EP_OFFSET, MB_EP_BUFLEN);
+    assert(err_is_ok(err));
+
+    // Its vspace, with one page table to map the frame into
+    err = caps_create_new(ObjType_VNode_ARM_l1, vspace, MB_VSPACE_BYTES,
+                          MB_VSPACE_BYTES, my_core_id,
+                          mb_slot(MB_SLOT_VSPACE));
+    assert(err_is_ok(err));
+    mb_dcb->vspace = vspace;
+
+    err = caps_create_new(ObjType_VNode_ARM_l2, next, ARM_L2_TABLE_BYTES,
+                          ARM_L2_TABLE_BYTES, my_core_id,
+                          mb_slot(MB_SLOT_PTABLE));
+    assert(err_is_ok(err));
+    next += MB_PTABLE_BYTES;
+    err = caps_copy_to_vnode(mb_slot(MB_SLOT_VSPACE), MB_PTABLE_L1_SLOT,
+                             mb_slot(MB_SLOT_PTABLE), MB_MAP_FLAGS, 0, 1,
+                             mb_slot(MB_SLOT_PTABLE_MAP));
+    assert(err_is_ok(err));
+
+    err = caps_create_new(ObjType_Frame, next, MB_FRAME_BYTES, MB_FRAME_BYTES,
+                          my_core_id, mb_slot(MB_SLOT_FRAME));
+    assert(err_is_ok(err));
+    next += MB_FRAME_BYTES;
+
+    err = caps_create_new(ObjType_RAM, next, MB_RAM_BYTES, MB_RAM_BYTES,
+                          my_core_id, mb_slot(MB_SLOT_RAM));
+    assert(err_is_ok(err));
+    next += MB_RAM_BYTES;
+
+    assert(next - arena == arch_microbenchmarks_arena_bytes);
+}
+
+/*
+ * A system call that does nothing. From the kernel, this is the trap and the
+ * return, without saving the caller's registers to its dispatcher.
+ */
+static int mb_null_syscall(struct microbench *mb)
+{
+    for (int i = 0; i < MICROBENCH_ITERATIONS; i++) {
+        uint32_t start = microbench_ticks();
+        register uintptr_t r0 __asm("r0") = SYSCALL_NOP;
+        __asm volatile("svc #0" : "+r" (r0) : : "lr", "cc", "memory");
+        microbench_record(microbench_ticks() - start);
+    }
+    return 0;
+}
+
+/*
+ * LMP delivery of a full-length message from init to the benchmarks'
+ * dispatcher, through the general and the fast path. The buffer is emptied,
+ * untimed, before each message.
+ */
+
+static uintptr_t mb_lmp_payload[LMP_MSG_LENGTH];
+
+static int mb_lmp_run(bool fast)
+{
+    struct capability *ep = &mb_slot(MB_SLOT_EP)->cap;
+    struct lmp_endpoint_kern *recv_ep =
+        (void *)((uint8_t *)mb_dcb->disp + MB_EP_OFFSET);
+    errval_t err = SYS_ERR_OK;
+
+    for (int i = 0; i < MICROBENCH_ITERATIONS; i++) {
+        recv_ep->delivered = recv_ep->consumed = 0;
+
+        uint32_t start = microbench_ticks();
+        if (fast) {
+            if (!lmp_deliver_fast(ep, mb_lmp_payload, LMP_MSG_LENGTH - 1,
+                                  &mb_lmp_payload[LMP_MSG_LENGTH - 1], 1)) {
+                err = SYS_ERR_LMP_BUF_OVERFLOW;
+            }
+        } else {
+            err = lmp_deliver(ep, mb_init_dcb, mb_lmp_payload, LMP_MSG_LENGTH,
+                              CPTR_NULL, 0, false);
+        }
+        microbench_record(microbench_ticks() - start);
+        if (err_is_fail(err)) {
+            break;
+        }
+    }
+
+    // delivery made it runnable, but there's nothing there to run
+    scheduler_remove(mb_dcb);
+    return err_is_ok(err) ? 0 : mb_fail("lmp deliver", err);
+}
+
+static int mb_lmp_deliver(struct microbench *mb)
+{
+    return mb_lmp_run(false);
+}
+
+static int mb_lmp_deliver_fast(struct microbench *mb)
+{
+    return mb_lmp_run(true);
+}
+
+/*
+ * LMP delivery copy costs. Both deliver a full-length message into a ring
+ * the size of a default LMP endpoint buffer, starting at a position that
+ * moves through the ring, as successive messages would.
+ */
+
+#define MB_LMP_RING_WORDS (2 * (LMP_MSG_LENGTH + LMP_RECV_HEADER_LENGTH))
+
+static uintptr_t mb_lmp_ring[MB_LMP_RING_WORDS];
+
+// Message registers as the syscall path sees them.
+static struct registers_arm_syscall_args mb_lmp_regs;
+
+/// Slow path: gather registers into a temporary, copy with per-word wrap.
+static int mb_lmp_slow(struct microbench *mb)
+{
+    struct registers_arm_syscall_args *sa = &mb_lmp_regs;
+    uint32_t pos = 0;
+    for (int i = 0; i < MICROBENCH_ITERATIONS; i++) {
+        uint32_t start = microbench_ticks();
+        uintptr_t msg_words[LMP_MSG_LENGTH];
+        msg_words[0] = sa->arg3;
+        msg_words[1] = sa->arg4;
+        msg_words[2] = sa->arg5;
+        msg_words[3] = sa->arg6;
+        msg_words[4] = sa->arg7;
+        msg_words[5] = sa->arg8;
+        msg_words[6] = sa->arg9;
+        msg_words[7] = sa->arg10;
+        msg_words[8] = sa->arg11;
+        mb_lmp_ring[pos] = LMP_MSG_LENGTH;
+        if (++pos == MB_LMP_RING_WORDS) {
+            pos = 0;
+        }
+        pos = lmp_ring_copy(mb_lmp_ring, MB_LMP_RING_WORDS, pos, msg_words,
+                            LMP_MSG_LENGTH);
+        microbench_record(microbench_ticks() - start);
+    }
+    return 0;
+}
+
+/// Fast path: one bounds check, copy straight from the registers.
+static int mb_lmp_fast(struct microbench *mb)
+{
+    struct registers_arm_syscall_args *sa = &mb_lmp_regs;
+    uint32_t pos = 0;
+    for (int i = 0; i < MICROBENCH_ITERATIONS; i++) {
+        uint32_t start = microbench_ticks();
+        uint32_t end = pos + LMP_RECV_HEADER_LENGTH + LMP_MSG_LENGTH;
+        if (end > MB_LMP_RING_WORDS) {
+            pos = 0;
+            end = LMP_RECV_HEADER_LENGTH + LMP_MSG_LENGTH;
+        }
+        mb_lmp_ring[pos] = LMP_MSG_LENGTH;
+        lmp_ring_copy_contig(&mb_lmp_ring[pos + LMP_RECV_HEADER_LENGTH],
+                             (const uintptr_t *)&sa->arg3, LMP_MSG_LENGTH - 1,
+                             (const uintptr_t *)&sa->arg11, 1);
+        pos = end;
+        microbench_record(microbench_ticks() - start);
+    }
+    return 0;
+}
+
+/*
+ * Looking up init's dispatcher capability through its CSpace, as an
+ * invocation does. Without a current dispatcher, every lookup walks both
+ * levels; with one, all but the first come from its lookup cache.
+ */
+
+#define MB_LOOKUP_CPTR \
+    ((ROOTCN_SLOT_TASKCN << L2_CNODE_BITS) | TASKCN_SLOT_DISPATCHER)
+
+static int mb_lookup_run(void)
+{
+    struct capability *rootcn = &mb_init_dcb->cspace.cap;
+    struct cte *cte;
+
+    for (int i = 0; i < MICROBENCH_ITERATIONS; i++) {
+        uint32_t start = microbench_ticks();
+        errval_t err = caps_lookup_slot(rootcn, MB_LOOKUP_CPTR, 2, &cte,
+                                        CAPRIGHTS_READ);
+        microbench_record(microbench_ticks() - start);
+        if (err_is_fail(err)) {
+            return mb_fail("caps_lookup_slot", err);
+        }
+    }
+    return 0;
+}
+
+static int mb_lookup(struct microbench *mb)
+{
+    assert(dcb_current == NULL);
+    return mb_lookup_run();
+}
+
+static int mb_lookup_cached(struct microbench *mb)
+{
+    dcb_current = mb_dcb;
+    int r = mb_lookup_run();
+    dcb_current = NULL;
+    return r;
+}
+
+/*
+ * Retyping RAM into 'count' page-sized RAM capabilities. RAM isn't zeroed on
+ * retype, so this is the cost of the checks and the mapping database. The
+ * new capabilities are deleted, untimed, after each retype.
+ */
+static int mb_retype_run(size_t count)
+{
+    struct cte *ram = mb_slot(MB_SLOT_RAM);
+    struct capability *dest_cn = &mb_slot(MB_SLOT_RETYPE_CN)->cap;
+    errval_t err;
+
+    assert(count <= MB_RETYPE_MAX);
+    for (int i = 0; i < MICROBENCH_ITERATIONS; i++) {
+        uint32_t start = microbench_ticks();
+        err = caps_retype(ObjType_RAM, BASE_PAGE_SIZE, count, dest_cn, 0, ram,
+                          0, false);
+        microbench_record(microbench_ticks() - start);
+        if (err_is_fail(err)) {
+            return mb_fail("caps_retype", err);
+        }
+
+        for (cslot_t slot = 0; slot < count; slot++) {
+            err = caps_delete(caps_locate_slot(get_address(dest_cn), slot));
+            if (err_is_fail(err)) {
+                return mb_fail("caps_delete", err);
+            }
+        }
+    }
+    return 0;
+}
+
+static int mb_retype_1(struct microbench *mb)
+{
+    return mb_retype_run(1);
+}
+
+static int mb_retype_16(struct microbench *mb)
+{
+    return mb_retype_run(16);
+}
+
+static int mb_retype_256(struct microbench *mb)
+{
+    return mb_retype_run(256);
+}
+
+/*
+ * Mapping a page into an installed page table, and unmapping it again as
+ * user-level code does: unmap, then delete the mapping capability. Each
+ * benchmark does both, and times its half.
+ */
+static int mb_vnode_run(bool time_map)
+{
+    struct cte *ptable = mb_slot(MB_SLOT_PTABLE);
+    struct cte *frame = mb_slot(MB_SLOT_FRAME);
+    struct cte *mapping = mb_slot(MB_SLOT_FRAME_MAP);
+    errval_t err;
+
+    for (int i = 0; i < MICROBENCH_ITERATIONS; i++) {
+        uint32_t start = microbench_ticks();
+        err = caps_copy_to_vnode(ptable, 0, frame, MB_MAP_FLAGS, 0, 1, mapping);
+        uint32_t mapped = microbench_ticks();
+        if (err_is_fail(err)) {
+            return mb_fail("caps_copy_to_vnode", err);
+        }
+
+        err = page_mappings_unmap(&ptable->cap, mapping);
+        if (err_is_ok(err)) {
+            err = caps_delete(mapping);
+        }
+        uint32_t unmapped = microbench_ticks();
+        if (err_is_fail(err)) {
+            return mb_fail("unmap", err);
+        }
+
+        microbench_record(time_map ? mapped - start : unmapped - mapped);
+    }
+    return 0;
+}
+
+static int mb_vnode_map(struct microbench *mb)
+{
+    return mb_vnode_run(true);
+}
+
+static int mb_vnode_unmap(struct microbench *mb)
+{
+    return mb_vnode_run(false);
+}
+
+/*
+ * Switching the address space and dispatcher between init and the
+ * benchmarks' dispatcher, back and forth. Saving and restoring user
+ * registers isn't included, as there are none yet. The first two switches
+ * give both their ASIDs, and aren't timed. Init's is the last one switched
+ * to.
+ */
+static int mb_context_switch(struct microbench *mb)
+{
+    context_switch(mb_dcb);
+    context_switch(mb_init_dcb);
+
+    for (int i = 0; i < MICROBENCH_ITERATIONS; i++) {
+        struct dcb *dcb = (i % 2 == 0) ? mb_dcb : mb_init_dcb;
+        uint32_t start = microbench_ticks();
+        context_switch(dcb);
+        microbench_record(microbench_ticks() - start);
+    }
+    context_switch(mb_init_dcb);
+    return 0;
+}
+
+/*
+ * Cache and TLB maintenance. The page ones work on the benchmarks' frame,
+ * which is dirtied, untimed, before each; all wait for the operation to
+ * complete.
+ */
+
+static uint8_t *mb_frame(void)
+{
+    return (uint8_t *)local_phys_to_mem(
+        gen_phys_to_local_phys(get_address(&mb_slot(MB_SLOT_FRAME)->cap)));
+}
+
+static int mb_cache_range_run(enum armv7_cache_range_op op)
+{
+    uint8_t *page = mb_frame();
+
+    for (int i = 0; i < MICROBENCH_ITERATIONS; i++) {
+        memset(page, i, BASE_PAGE_SIZE);
+
+        uint32_t start = microbench_ticks();
+        cache_range_op(page, page + BASE_PAGE_SIZE - 1, op);
+        dsb();
+        microbench_record(microbench_ticks() - start);
+    }
+    return 0;
+}
+
+static int mb_clean_pou(struct microbench *mb)
+{
+    return mb_cache_range_run(CLEAN_TO_POU);
+}
+
+static int mb_clean_poc(struct microbench *mb)
+{
+    return mb_cache_range_run(CLEAN_TO_POC);
+}
+
+static int mb_invalidate_poc(struct microbench *mb)
+{
+    return mb_cache_range_run(INVALIDATE_TO_POC);
+}
+
+static int mb_dcache_all(struct microbench *mb)
+{
+    uint8_t *page = mb_frame();
+
+    for (int i = 0; i < MICROBENCH_ITERATIONS; i++) {
+        memset(page, i, BASE_PAGE_SIZE);
+
+        uint32_t start = microbench_ticks();
+        invalidate_data_caches_pouu(true);
+        dsb();
+        microbench_record(microbench_ticks() - start);
+    }
+    return 0;
+}
+
+static int mb_icache_all(struct microbench *mb)
+{
+    for (int i = 0; i < MICROBENCH_ITERATIONS; i++) {
+        uint32_t start = microbench_ticks();
+        invalidate_instruction_cache();
+        dsb();
+        microbench_record(microbench_ticks() - start);
+    }
+    return 0;
+}
+
+static int mb_tlb_all(struct microbench *mb)
+{
+    for (int i = 0; i < MICROBENCH_ITERATIONS; i++) {
+        uint32_t start = microbench_ticks();
+        invalidate_tlb();
+        microbench_record(microbench_ticks() - start);
+    }
+    return 0;
+}
+
+struct microbench arch_benchmarks[] = {
+    { .name = "null syscall", .run_func = mb_null_syscall },
+    { .name = "lmp deliver", .run_func = mb_lmp_deliver },
+    { .name = "lmp deliver (fast path)", .run_func = mb_lmp_deliver_fast },
+    { .name = "lmp deliver copy (slow path)", .run_func = mb_lmp_slow },
+    { .name = "lmp deliver copy (fast path)", .run_func = mb_lmp_fast },
+    { .name = "cap lookup", .run_func = mb_lookup },
+    { .name = "cap lookup (cached)", .run_func = mb_lookup_cached },
+    { .name = "retype 1 page", .run_func = mb_retype_1 },
+    { .name = "retype 16 pages", .run_func = mb_retype_16 },
+    { .name = "retype 256 pages", .run_func = mb_retype_256 },
+    { .name = "vnode map", .run_func = mb_vnode_map },
+    { .name = "vnode unmap", .run_func = mb_vnode_unmap },
+    { .name = "context switch", .run_func = mb_context_switch },
+    { .name = "clean 4k to PoU", .run_func = mb_clean_pou },
+    { .name = "clean 4k to PoC", .run_func = mb_clean_poc },
+    { .name = "invalidate 4k to PoC", .run_func = mb_invalidate_poc },
+    { .name = "clean+invalidate D-cache", .run_func = mb_dcache_all },
+    { .name = "invalidate I-cache", .run_func = mb_icache_all },
+    { .name = "invalidate TLB", .run_func = mb_tlb_all },
+};
+
+size_t arch_benchmarks_size = ARRAY_LENGTH(arch_benchmarks);
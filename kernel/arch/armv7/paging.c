@@ -7,6 +7,7 @@
  * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
  */
 
+#include <bitmacros.h>
 #include <kernel.h>
 #include <dispatch.h>
 #include <cache.h>
@@ -51,6 +52,8 @@ paging_set_flags(union arm_l2_entry *entry, uintptr_t kpi_paging_flags)
         entry->small_page.ap10 |=
             (kpi_paging_flags & KPI_PAGING_FLAGS_WRITE) ? 3 : 0;
         entry->small_page.ap2 = 0;
+        /* User mappings belong to the ASID of their vspace. */
+        entry->small_page.not_global = 1;
 }
 
 static void map_kernel_section_hi(lvaddr_t va, union arm_l1_entry l1);
@@ -109,29 +112,92 @@ bool paging_mmu_enabled(void)
     return true;
 }
 
+/**
+ * \brief Return whether the current user vspace may read, or write, the page
+ * at 'vaddr'.
+ *
+ * Asks the MMU to translate the address with user permissions, so the answer
+ * is the same as for an access the dispatcher makes itself.
+ */
+bool paging_user_page_accessible(lvaddr_t vaddr, bool write)
+{
+    if (write) {
+        cp15_write_ats1cuw(vaddr);
+    } else {
+        cp15_write_ats1cur(vaddr);
+    }
+    isb();
+    return (cp15_read_par() & 1) == 0;
+}
+
+/* ASIDs on this core. ASID 0 is never handed out, so that it can be used
+ * while switching page tables. */
+#define ARM_ASID_COUNT 256
+static uint32_t asid_generation;
+/* Start out of ASIDs, so that the first one handed out flushes whatever the
+ * boot page tables left in the TLB. */
+static uint32_t asid_next = ARM_ASID_COUNT;
+
+/**
+ * /brief Return the ASID for the vspace of 'dcb', allocating one if it has
+ * none in the current generation.
+ *
+ * Every dispatcher has its own vspace on this core, so the ASID is kept in
+ * its DCB.  When the ASIDs run out, they are all taken back at once: the
+ * generation is bumped, which makes every DCB's ASID stale, and the TLB is
+ * flushed.  An ASID is thus never reused without a flush in between.
+ */
+uint8_t paging_asid_get(struct dcb *dcb)
+{
+    if (dcb->asid != 0 && dcb->asid_gen == asid_generation) {
+        return dcb->asid;
+    }
+
+    if (asid_next == ARM_ASID_COUNT) {
+        asid_generation++;
+        asid_next = 1;
+        invalidate_tlb();
+    }
+
+    dcb->asid = asid_next++;
+    dcb->asid_gen = asid_generation;
+
+    /* The caches are physically tagged, so a switch needn't touch them.
+     * A vspace that is new to this core may, however, hold code that was
+     * written through another mapping, and instruction fetches must see
+     * it. */
+    invalidate_data_caches_pouu(true);
+    invalidate_instruction_cache();
+    dsb(); isb();
+
+    return dcb->asid;
+}
+
 /**
  * /brief Perform a context switch.  Reload TTBR0 with the new
- * address, and invalidate the TLBs and caches. 
+ * address, and CONTEXTIDR with the new ASID and process ID.
+ *
+ * User mappings are not global, so TLB entries for other address spaces
+ * needn't be flushed.
  */
-void paging_context_switch(lpaddr_t ttbr)
+void paging_context_switch(lpaddr_t ttbr, uint32_t contextidr)
 {
     assert(ttbr >= phys_memory_start &&
            ttbr <  phys_memory_start + RAM_WINDOW_SIZE);
     lpaddr_t old_ttbr = cp15_read_ttbr0();
+    dsb(); /* Make sure any page table updates have completed. */
     if (ttbr != old_ttbr)
     {
-        dsb(); isb(); /* Make sure any page table updates have completed. */
+        /* Go through the reserved ASID, so that no table walk pairs the
+         * new table with the old ASID, or the old table with the new one. */
+        cp15_write_contextidr(contextidr & ~MASK(8));
+        isb();
         cp15_write_ttbr0(ttbr);
-        isb(); /* The update must occur before we invalidate. */
-        /* With no ASIDs, we've got to flush everything. */
-        invalidate_tlb();
-        /* Clean and invalidate. */
-        invalidate_data_caches_pouu(true);
-        invalidate_instruction_cache();
-        /* Make sure the invalidates are completed and visible before any
-         * user-level code can execute. */
-        dsb(); isb();
+        isb();
     }
+    cp15_write_contextidr(contextidr);
+    /* The new ASID must be in use before any user-level code executes. */
+    isb();
 }
 
 /* Map the exception vectors at VECTORS_BASE. */
@@ -397,6 +463,7 @@ caps_map_l1(struct capability* dest,
             entry->section.ap10 = (kpi_paging_flags & KPI_PAGING_FLAGS_READ)? 2:0;
             entry->section.ap10 |= (kpi_paging_flags & KPI_PAGING_FLAGS_WRITE)? 3:0;
             entry->section.ap2 = 0;
+            entry->section.not_global = 1;
             entry->section.base_address = (src_lpaddr + i * BYTES_PER_SECTION) >> 20;
 
             entry++;
@@ -735,6 +802,8 @@ void paging_set_l2_entry(uintptr_t* l2e, lpaddr_t addr, uintptr_t flags)
 
     e.small_page.type = L2_TYPE_SMALL_PAGE;
     e.small_page.base_address = (addr >> 12);
+    /* These are init's mappings, see paging_set_flags(). */
+    e.small_page.not_global = 1;
 
     *l2e = e.raw;
 
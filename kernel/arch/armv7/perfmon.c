@@ -0,0 +1,130 @@
+/**
+ * \file
+ * \brief Per-dispatcher PMU event counting.
+ *
+ * The first PERFMON_COUNTERS event counters of the PMU are programmed with
+ * the events of whichever dispatcher runs, if it has any. On a switch away
+ * from it, what they counted is added to its DCB and they are cleared, so
+ * the 32-bit hardware counters only have to last one run. An overflow
+ * during that run is picked up from the overflow flags.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <kernel.h>
+#include <string.h>
+#include <bitmacros.h>
+#include <cp15.h>
+#include <dispatch.h>
+#include <perfmon.h>
+
+/// Event counters this core's PMU has
+static uint32_t pmu_counters;
+
+/**
+ * \brief Find out what the PMU has, and enable the counters we use.
+ *
+ * The PMU itself is enabled by perf_measurement_init().
+ */
+void perfmon_init(void)
+{
+    pmu_counters = (cp15_read_pmcr() >> 11) & 0x1f;
+    if (pmu_counters >= PERFMON_COUNTERS) {
+        cp15_write_pmcntenset(MASK(PERFMON_COUNTERS));
+    }
+}
+
+static inline bool perfmon_active(struct dcb *dcb)
+{
+    return dcb != NULL && dcb->perfmon.on;
+}
+
+/// Add what the counters counted to 'dcb', and clear them
+static void perfmon_save(struct dcb *dcb)
+{
+    uint32_t overflow = cp15_read_pmovsr();
+    for (int i = 0; i < PERFMON_COUNTERS; i++) {
+        if (dcb->perfmon.events.event[i] == PERFMON_EVENT_NONE) {
+            continue;
+        }
+        cp15_write_pmselr(i);
+        isb();
+        uint64_t n = cp15_read_pmxevcntr();
+        if (overflow & BIT(i)) {
+            n += (uint64_t)1 << 32;
+        }
+        cp15_write_pmxevcntr(0);
+        dcb->perfmon.counts.count[i] += n;
+    }
+    cp15_write_pmovsr(MASK(PERFMON_COUNTERS));
+}
+
+/// Program the counters with the events of 'dcb', starting from 0
+static void perfmon_load(struct dcb *dcb)
+{
+    for (int i = 0; i < PERFMON_COUNTERS; i++) {
+        cp15_write_pmselr(i);
+        isb();
+        cp15_write_pmxevtyper(dcb->perfmon.events.event[i]);
+        cp15_write_pmxevcntr(0);
+    }
+    cp15_write_pmovsr(MASK(PERFMON_COUNTERS));
+}
+
+/**
+ * \brief Hand the counters from one dispatcher to the next.
+ *
+ * Either may be NULL, for the idle loop.
+ */
+void perfmon_switch(struct dcb *from, struct dcb *to)
+{
+    if (perfmon_active(from)) {
+        perfmon_save(from);
+    }
+    if (perfmon_active(to)) {
+        perfmon_load(to);
+    }
+}
+
+/**
+ * \brief Set the events to count for 'dcb', and reset its counts.
+ */
+errval_t perfmon_setup(struct dcb *dcb, const struct perfmon_events *events)
+{
+    if (pmu_counters < PERFMON_COUNTERS) {
+        return SYS_ERR_PERFMON_NOT_AVAILABLE;
+    }
+
+    dcb->perfmon.events = *events;
+    memset(&dcb->perfmon.counts, 0, sizeof(dcb->perfmon.counts));
+    dcb->perfmon.on = false;
+    for (int i = 0; i < PERFMON_COUNTERS; i++) {
+        if (events->event[i] != PERFMON_EVENT_NONE) {
+            dcb->perfmon.on = true;
+        }
+    }
+
+    // a dispatcher setting up its own events starts counting right away
+    if (dcb == dcb_current && dcb->perfmon.on) {
+        perfmon_load(dcb);
+    }
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief Read the counts of 'dcb', including its current run if it's running.
+ */
+void perfmon_read(struct dcb *dcb, struct perfmon_counts *counts)
+{
+    if (dcb == dcb_current && perfmon_active(dcb)) {
+        perfmon_save(dcb);
+    }
+    *counts = dcb->perfmon.counts;
+}
@@ -21,6 +21,7 @@
 #include <init.h>
 #include <paging_kernel_arch.h>
 #include <platform.h>
+#include <timer.h>
 
 #define MSG(format, ...) \
     printk( LOG_NOTE, "CortexA15 platform: "format, ## __VA_ARGS__ )
@@ -87,8 +88,14 @@ timers_init(int timeslice) {
     /* Enable the interrupt. */
     gic_enable_interrupt(timerirq, 0, 0, 0, 0);
 
+#ifdef CONFIG_ONESHOT_TIMER
+    /* Tickless: the first timeout is set for the first event, see
+     * arch_set_timer(). */
+    timer_reset();
+#else
     /* Set the first timeout. */
     a15_gt_timeout(timeslice_ticks);
+#endif
 
     /* We use the system counter for timestamps, which doesn't need any
      * further initialisation. */
@@ -109,10 +116,28 @@ timer_interrupt(uint32_t irq) {
     if(irq == timerirq) {
         gic_ack_irq(irq);
 
+#ifdef CONFIG_ONESHOT_TIMER
+        /* The timer stays asserted until the compare value moves on, and
+         * it's re-armed for the next event. */
+        a15_gt_disarm();
+        timer_expired();
+#else
         /* Reset the timeout. */
         a15_gt_timeout(timeslice_ticks);
+#endif
         return 1;
     }
 
     return 0;
 }
+
+#ifdef CONFIG_ONESHOT_TIMER
+void
+arch_set_timer(systime_t t) {
+    if(t == TIMER_INF) {
+        a15_gt_disarm();
+    } else {
+        a15_gt_set_comparator(timer_to_timestamp(t));
+    }
+}
+#endif
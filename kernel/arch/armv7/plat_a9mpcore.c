@@ -23,6 +23,7 @@
 #include <init.h>
 #include <paging_kernel_arch.h>
 #include <platform.h>
+#include <timer.h>
 
 #define MSG(format, ...) \
     printk( LOG_NOTE, "CortexA9 platform: "format, ## __VA_ARGS__ )
@@ -55,11 +56,13 @@ platform_get_gt_address(void) {
     return platform_get_private_region() + A9MPCORE_TIMER_GBL_OFFSET;
 }
 
+#ifndef CONFIG_ONESHOT_TIMER
 static lpaddr_t
 platform_get_lt_address(void) {
     assert(paging_mmu_enabled());
     return platform_get_private_region() + A9MPCORE_TIMER_LCL_OFFSET;
 }
+#endif
 
 /* On the A9, we need to initialise the snoop control unit. */
 void
@@ -77,19 +80,15 @@ platform_get_core_count(void) {
     return gic_cpu_count();
 }
 
+#ifndef CONFIG_ONESHOT_TIMER
 static cortex_a9_pit_t tsc;
+#endif
 
 /* See TRM 4.2.3 */
 #define LOCAL_TIMER_IRQ 29
 
 void
 timers_init(int timeslice) {
-    /* Time slice counter: use the Cortex-A9 Local Timer
-       (see Cortex-A9 MPCore TRM 4.1). */
-    lvaddr_t lcl_base =
-        paging_map_device(platform_get_lt_address(), A9MPCORE_TIMER_LCL_SIZE);
-    cortex_a9_pit_initialize(&tsc, (mackerel_addr_t)lcl_base);
-
     /* Global timer: use the Cortex-A9 Global Timer
        (see Cortex-A9 MPCore TRM 4.3). */
     a9_gt_init(platform_get_gt_address());
@@ -97,10 +96,23 @@ timers_init(int timeslice) {
     /* Discover the clock rate. */
     a9_probe_tsc();
     assert(tsc_hz != 0);
+    MSG("System counter frequency is %uHz.\n", tsc_hz);
+
+#ifdef CONFIG_ONESHOT_TIMER
+    /* Tickless: the global timer's comparator goes off for the next event,
+     * see arch_set_timer(). */
+    MSG("Tickless, timer interrupt is %u.\n", A9_GT_IRQ);
+    timer_reset();
+    gic_enable_interrupt(A9_GT_IRQ, 0, 0, 0, 0);
+#else
+    /* Time slice counter: use the Cortex-A9 Local Timer
+       (see Cortex-A9 MPCore TRM 4.1). */
+    lvaddr_t lcl_base =
+        paging_map_device(platform_get_lt_address(), A9MPCORE_TIMER_LCL_SIZE);
+    cortex_a9_pit_initialize(&tsc, (mackerel_addr_t)lcl_base);
 
     /* Write counter reload value.  Divide by 1000, as timeslice is in ms. */
     uint32_t reload = (timeslice * tsc_hz) / 1000;
-    MSG("System counter frequency is %uHz.\n", tsc_hz);
     MSG("Timeslice interrupt every %u ticks (%dms).\n", reload, timeslice);
     cortex_a9_pit_TimerLoad_wr(&tsc, reload);
 
@@ -116,6 +128,7 @@ timers_init(int timeslice) {
     gic_enable_interrupt(LOCAL_TIMER_IRQ, 0, 0, 0, 0);
     /* Enable the timer. */
     cortex_a9_pit_TimerControl_timer_enable_wrf(&tsc, 1);
+#endif
 }
 
 uint64_t
@@ -128,6 +141,31 @@ timestamp_freq(void) {
     return tsc_hz;
 }
 
+#ifdef CONFIG_ONESHOT_TIMER
+void
+arch_set_timer(systime_t t) {
+    if(t == TIMER_INF) {
+        a9_gt_disarm();
+    } else {
+        a9_gt_set_comparator(timer_to_timestamp(t));
+    }
+}
+
+bool
+timer_interrupt(uint32_t irq) {
+    if(irq == A9_GT_IRQ) {
+        /* Stop the comparator, it's re-armed for the next event. */
+        a9_gt_disarm();
+        timer_expired();
+
+        /* Ack the interrupt at the controller. */
+        gic_ack_irq(irq);
+        return 1;
+    }
+
+    return 0;
+}
+#else
 bool
 timer_interrupt(uint32_t irq) {
     if(irq == LOCAL_TIMER_IRQ) {
@@ -141,3 +179,4 @@ timer_interrupt(uint32_t irq) {
 
     return 0;
 }
+#endif
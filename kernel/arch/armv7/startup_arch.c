@@ -29,6 +29,7 @@
 #include <startup_arch.h>
 #include <global.h>
 #include <kcb.h>
+#include <microbenchmarks.h>
 #include <gic.h>
 
 #define CNODE(cte)              get_address(&cte->cap)
@@ -480,7 +481,9 @@ static void init_page_tables(void)
 
     MSG("Calling paging_context_switch with address = %"PRIxLVADDR"\n",
            mem_to_local_phys((lvaddr_t) init_l1));
-    paging_context_switch(mem_to_local_phys((lvaddr_t)init_l1));
+    /* Init gets its ASID when it is first dispatched, which also flushes
+     * whatever we put in the TLB under the reserved one until then. */
+    paging_context_switch(mem_to_local_phys((lvaddr_t)init_l1), 0);
 }
 
 /* Locate the first device region below 4GB listed in the multiboot memory
@@ -752,11 +755,24 @@ void arm_kernel_startup(void)
         /* Initial KCB was allocated by the boot driver. */
         assert(kcb_current);
 
+        /* Set aside what the microbenchmarks need before init gets the
+         * rest of RAM. */
+        lpaddr_t mb_arena = 0;
+        if (kernel_microbenchmarks) {
+            mb_arena = bsp_alloc_phys_aligned(arch_microbenchmarks_arena_bytes,
+                                              ARM_L1_ALIGN);
+        }
+
         // Bring up init
         init_dcb =
             spawn_bsp_init(BSP_INIT_MODULE_NAME,
                            bsp_alloc_phys,
                            bsp_alloc_phys_aligned);
+
+        if (kernel_microbenchmarks) {
+            arch_microbenchmarks_init(mb_arena, init_dcb);
+            microbenchmarks_run_all();
+        }
     } else {
         MSG("Doing non-BSP related bootup \n");
 
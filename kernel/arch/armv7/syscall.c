@@ -11,22 +11,27 @@
 
 #include <barrelfish_kpi/lmp.h>
 #include <barrelfish_kpi/syscalls.h>
+#include <barrelfish_kpi/invoke_batch.h>
 #include <barrelfish_kpi/sys_debug.h>
 #include <mdb/mdb_tree.h>
 
 #include <irq.h>
+#include <ktrace.h>
 
 #include <paging_kernel_arch.h>
 #include <dispatch.h>
 #include <exec.h>
 #include <serial.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys_debug.h>
 #include <syscall.h>
 #include <arch/arm/syscall_arm.h>
 #include <useraccess.h>
 #include <platform.h>
+#include <profile.h>
 #include <startup_arch.h>
+#include <timer.h>
 
 // helper macros  for invocation handler definitions
 #define INVOCATION_HANDLER(func) \
@@ -96,15 +101,34 @@ handle_dispatcher_properties(
                                      sa->arg5, sa->arg6, sa->arg7, weight);
 }
 
-static struct sysret
-handle_dispatcher_perfmon(
-    struct capability* to,
-    arch_registers_state_t* context,
-    int argc
-    )
+INVOCATION_HANDLER(handle_dispatcher_perfmon)
 {
-    /* XXX - implement this? */
-    return SYSRET(SYS_ERR_PERFMON_NOT_AVAILABLE);
+    INVOCATION_PRELUDE(4);
+    assert(kernel_cap->type == ObjType_Dispatcher);
+
+    struct dcb *dcb = kernel_cap->u.dispatcher.dcb;
+    switch (sa->arg2) {
+    case PerfMonOp_Setup: {
+        // one event per byte, counter 0 in the lowest
+        struct perfmon_events events;
+        for (int i = 0; i < PERFMON_COUNTERS; i++) {
+            events.event[i] = (sa->arg3 >> (8 * i)) & 0xff;
+        }
+        return SYSRET(perfmon_setup(dcb, &events));
+    }
+
+    case PerfMonOp_Read: {
+        struct perfmon_counts *counts = (struct perfmon_counts *)sa->arg3;
+        if (!access_ok(ACCESS_WRITE, (lvaddr_t)counts, sizeof(*counts))) {
+            return SYSRET(SYS_ERR_INVALID_USER_BUFFER);
+        }
+        perfmon_read(dcb, counts);
+        return SYSRET(SYS_ERR_OK);
+    }
+
+    default:
+        return SYSRET(SYS_ERR_INVARGS_SYSCALL);
+    }
 }
 
 static struct sysret
@@ -132,6 +156,17 @@ handle_ram_identify (
     return SYSRET(SYS_ERR_OK);
 }
 
+/// Zero up to arg2 more bytes of a RAM region, see caps_zero_ram()
+INVOCATION_HANDLER(handle_ram_zero)
+{
+    INVOCATION_PRELUDE(3);
+    assert(kernel_cap->type == ObjType_RAM);
+
+    size_t pages;
+    errval_t err = caps_zero_ram(cte_for_cap(kernel_cap), sa->arg2, &pages);
+    return (struct sysret) { .error = err, .value = pages };
+}
+
 static struct sysret
 handle_frame_identify(
     struct capability* to,
@@ -834,6 +869,42 @@ static struct sysret handle_irq_table_delete( struct capability* to,
 }
 
 
+INVOCATION_HANDLER(monitor_ipi_register)
+{
+    INVOCATION_PRELUDE(5);
+
+    capaddr_t ep    = sa->arg2;
+    uint8_t level   = sa->arg3;
+    unsigned chanid = sa->arg4;
+
+    return SYSRET(ipi_register_notification(ep, level, chanid));
+}
+
+INVOCATION_HANDLER(monitor_profile)
+{
+    INVOCATION_PRELUDE(4);
+    return SYSRET(profile_setup(sa->arg2, sa->arg3));
+}
+
+INVOCATION_HANDLER(monitor_setup_trace)
+{
+    INVOCATION_PRELUDE(5);
+    return SYSRET(ktrace_setup(sa->arg2, sa->arg3, sa->arg4));
+}
+
+INVOCATION_HANDLER(monitor_ipi_delete)
+{
+    INVOCATION_PRELUDE(3);
+    return SYSRET(ipi_delete_notification(sa->arg2));
+}
+
+INVOCATION_HANDLER(handle_ipi_notify_send)
+{
+    assert(kernel_cap->type == ObjType_Notify_IPI);
+    return SYSRET(ipi_raise_notify(kernel_cap->u.notify_ipi.coreid,
+                                   kernel_cap->u.notify_ipi.chanid));
+}
+
 static struct sysret dispatcher_dump_ptables(
     struct capability* to,
     arch_registers_state_t* context,
@@ -862,6 +933,20 @@ static struct sysret dispatcher_dump_capabilities(struct capability *cap,
     return SYSRET(err);
 }
 
+INVOCATION_HANDLER(handle_dispatcher_stats)
+{
+    INVOCATION_PRELUDE(3);
+    assert(kernel_cap->type == ObjType_Dispatcher);
+
+    struct dispatcher_stats *stats = (struct dispatcher_stats *)sa->arg2;
+    if (!access_ok(ACCESS_WRITE, (lvaddr_t)stats, sizeof(*stats))) {
+        return SYSRET(SYS_ERR_INVALID_USER_BUFFER);
+    }
+
+    *stats = kernel_cap->u.dispatcher.dcb->stats;
+    return (struct sysret){ .error = SYS_ERR_OK, .value = timestamp_freq() };
+}
+
 static struct sysret handle_idcap_identify(struct capability *to,
                                            arch_registers_state_t *context,
                                            int argc)
@@ -965,7 +1050,8 @@ static invocation_t invocations[ObjType_Num][CAP_MAX_CMD] = {
         [DispatcherCmd_Properties]  = handle_dispatcher_properties,
         [DispatcherCmd_PerfMon]     = handle_dispatcher_perfmon,
         [DispatcherCmd_DumpPTables]  = dispatcher_dump_ptables,
-        [DispatcherCmd_DumpCapabilities] = dispatcher_dump_capabilities
+        [DispatcherCmd_DumpCapabilities] = dispatcher_dump_capabilities,
+        [DispatcherCmd_Stats]       = handle_dispatcher_stats,
     },
     [ObjType_KernelControlBlock] = {
         [FrameCmd_Identify] = handle_kcb_identify,
@@ -975,7 +1061,8 @@ static invocation_t invocations[ObjType_Num][CAP_MAX_CMD] = {
         [FrameCmd_Identify] = handle_frame_identify,
     },
     [ObjType_RAM] = {
-        [FrameCmd_Identify] = handle_ram_identify,
+        [RAMCmd_Identify] = handle_ram_identify,
+        [RAMCmd_Zero] = handle_ram_zero,
     },
     [ObjType_DevFrame] = {
         [FrameCmd_Identify] = handle_frame_identify,
@@ -1044,16 +1131,18 @@ static invocation_t invocations[ObjType_Num][CAP_MAX_CMD] = {
         [KernelCmd_Is_retypeable]   = monitor_handle_is_retypeable,
         [KernelCmd_Identify_cap]      = monitor_identify_cap,
         [KernelCmd_Identify_domains_cap] = monitor_identify_domains_cap,
+        [KernelCmd_IPI_Delete]        = monitor_ipi_delete,
+        [KernelCmd_IPI_Register]      = monitor_ipi_register,
         [KernelCmd_Lock_cap]          = monitor_lock_cap,
         [KernelCmd_Nullify_cap]       = monitor_nullify_cap,
+        [KernelCmd_Profile]           = monitor_profile,
         [KernelCmd_Register]          = monitor_handle_register,
         [KernelCmd_Remote_relations]  = monitor_remote_relations,
         [KernelCmd_Retype]            = monitor_handle_retype,
         [KernelCmd_Revoke_mark_relations] = monitor_handle_revoke_mark_rels,
         [KernelCmd_Revoke_mark_target] = monitor_handle_revoke_mark_tgt,
         [KernelCmd_Set_cap_owner]     = monitor_set_cap_owner,
-        /* XXX - why is this commented out? */
-        //[KernelCmd_Setup_trace]       = handle_trace_setup,
+        [KernelCmd_Setup_trace]       = monitor_setup_trace,
         [KernelCmd_Spawn_core]        = monitor_spawn_core,
         [KernelCmd_Unlock_cap]        = monitor_unlock_cap,
         [KernelCmd_Get_platform]      = monitor_get_platform,
@@ -1061,11 +1150,43 @@ static invocation_t invocations[ObjType_Num][CAP_MAX_CMD] = {
     [ObjType_IPI] = {
         [IPICmd_Send_Start]  = monitor_spawn_core,
     },
+    [ObjType_Notify_IPI] = {
+        [NotifyCmd_Send] = handle_ipi_notify_send,
+    },
     [ObjType_ID] = {
         [IDCmd_Identify] = handle_idcap_identify
     }
 };
 
+/**
+ * \brief Run the kernel's implementation of an invocation on a non-endpoint
+ * cap
+ *
+ * Always returns, even if the invocation removed the caller's own
+ * dispatcher; the caller must then check dcb_current before going back to
+ * user space.
+ */
+static struct sysret
+invoke_kernel_cap(struct capability *to, arch_registers_state_t *context,
+                  int argc)
+{
+    struct registers_arm_syscall_args* sa = &context->syscall_args;
+    struct sysret r = { .error = SYS_ERR_OK, .value = 0 };
+
+    uint8_t cmd = (sa->arg0 >> 8)  & 0xff;
+    if (cmd < CAP_MAX_CMD)
+    {
+        invocation_t invocation = invocations[to->type][cmd];
+        if (invocation)
+        {
+            return invocation(to, context, argc);
+        }
+    }
+    printk(LOG_ERR, "Bad invocation type %d cmd %d\n", to->type, cmd);
+    r.error = SYS_ERR_ILLEGAL_INVOCATION;
+    return r;
+}
+
 static struct sysret
 handle_invoke(arch_registers_state_t *context, int argc)
 {
@@ -1113,32 +1234,50 @@ handle_invoke(arch_registers_state_t *context, int argc)
                 bool yield = flags & LMP_FLAG_YIELD;
                 // is the cap (if present) to be deleted on send?
                 bool give_away = flags & LMP_FLAG_GIVEAWAY;
-
-                // Message registers in context are
-                // discontinguous for now so copy message words
-                // to temporary container. This is fixable, but
-                // not in this pass.
-                uintptr_t msg_words[LMP_MSG_LENGTH];
-                msg_words[0] = sa->arg3;
-                msg_words[1] = sa->arg4;
-                msg_words[2] = sa->arg5;
-                msg_words[3] = sa->arg6;
-                msg_words[4] = sa->arg7;
-                msg_words[5] = sa->arg8;
-                msg_words[6] = sa->arg9;
-                msg_words[7] = sa->arg10;
-                msg_words[8] = sa->arg11;
+                // does the sender want to wait for a reply (call, or
+                // reply-and-receive on the server side)?
+                bool call = flags & LMP_FLAG_CALL;
+
+                // Fast path: capless messages that fit in the receiver's
+                // ring without wrapping go straight from the saved
+                // registers. Message words 0-7 are arg3-arg10, which are
+                // contiguous; word 8 is arg11, after the frame pointer.
                 STATIC_ASSERT(LMP_MSG_LENGTH == 9, "Oops");
-
-                // try to deliver message
-                r.error = lmp_deliver(to, dcb_current, msg_words,
-                                      length_words, send_cptr, send_level, give_away);
+                STATIC_ASSERT(offsetof(struct registers_arm_syscall_args, arg10)
+                              - offsetof(struct registers_arm_syscall_args, arg3)
+                              == 7 * sizeof(uint32_t), "Oops");
+                size_t nlo = min(length_words, LMP_MSG_LENGTH - 1);
+                if (send_cptr == CPTR_NULL &&
+                    lmp_deliver_fast(to, (const uintptr_t *)&sa->arg3, nlo,
+                                     (const uintptr_t *)&sa->arg11,
+                                     length_words - nlo)) {
+                    r.error = SYS_ERR_OK;
+                } else {
+                    // Message registers in context are
+                    // discontinguous for now so copy message words
+                    // to temporary container.
+                    uintptr_t msg_words[LMP_MSG_LENGTH];
+                    msg_words[0] = sa->arg3;
+                    msg_words[1] = sa->arg4;
+                    msg_words[2] = sa->arg5;
+                    msg_words[3] = sa->arg6;
+                    msg_words[4] = sa->arg7;
+                    msg_words[5] = sa->arg8;
+                    msg_words[6] = sa->arg9;
+                    msg_words[7] = sa->arg10;
+                    msg_words[8] = sa->arg11;
+
+                    // try to deliver message
+                    r.error = lmp_deliver(to, dcb_current, msg_words,
+                                          length_words, send_cptr, send_level,
+                                          give_away);
+                }
 
                 /* Switch to reciever upon successful delivery
                  * with sync flag, or (some cases of)
                  * unsuccessful delivery with yield flag */
                 enum err_code err_code = err_no(r.error);
-                if ((sync && err_is_ok(r.error)) ||
+                if (((sync || call) && err_is_ok(r.error)) ||
                     (yield && (err_code == SYS_ERR_LMP_BUF_OVERFLOW
                                || err_code == SYS_ERR_LMP_CAPTRANSFER_DST_CNODE_LOOKUP
                                || err_code == SYS_ERR_LMP_CAPTRANSFER_DST_CNODE_INVALID
@@ -1167,6 +1306,11 @@ handle_invoke(arch_registers_state_t *context, int argc)
                         assert(context == &disp->enabled_save_area);
                         context->named.r0 = r.error;
                     }
+                    if (call && err_is_ok(r.error) && listener != dcb_current) {
+                        // Sleep until the reply comes in, which makes us
+                        // runnable again in lmp_deliver_payload().
+                        lmp_wait_for_message(dcb_current);
+                    }
                     dispatch(listener);
                 }
             }
@@ -1176,24 +1320,101 @@ handle_invoke(arch_registers_state_t *context, int argc)
         }
         else
         {
-            uint8_t cmd = (sa->arg0 >> 8)  & 0xff;
-            if (cmd < CAP_MAX_CMD)
+            r = invoke_kernel_cap(to, context, argc);
+            if (!dcb_current)
             {
-                invocation_t invocation = invocations[to->type][cmd];
-                if (invocation)
-                {
-                    r = invocation(to, context, argc);
-                    if (!dcb_current)
-                    {
-                        // dcb_current was removed, dispatch someone else
-                        assert(err_is_ok(r.error));
+                // dcb_current was removed, dispatch someone else
+                assert(err_is_ok(r.error));
+                dispatch(schedule());
+            }
+        }
+    }
+
+    return r;
+}
+
+/**
+ * \brief Run a batch of capability invocations, stopping at the first failure
+ *
+ * Each descriptor is turned into the registers of an ordinary invocation,
+ * so the handlers can't tell the difference. An invocation may unmap the
+ * buffer itself, so each descriptor is copied in, and its result written
+ * back, only after checking its own part of the buffer.
+ *
+ * No invocation in a batch may switch dispatchers, or the results of the
+ * ones before it would be lost: endpoints are refused, and every other
+ * handler returns here. The one exception is an invocation that deletes the
+ * caller's own dispatcher, which leaves nobody to return the batch to.
+ *
+ * \param batch User buffer of invocation descriptors
+ * \param count Number of descriptors
+ *
+ * \return Error of the failing invocation, if any, and in the value the
+ *         number of descriptors processed
+ */
+static struct sysret
+handle_invoke_batch(struct invoke_batch_entry *batch, size_t count)
+{
+    struct sysret r = { .error = SYS_ERR_OK, .value = 0 };
+
+    if (count > INVOKE_BATCH_MAX) {
+        return SYSRET(SYS_ERR_INVALID_USER_BUFFER);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (!access_ok(ACCESS_READ, (lvaddr_t)&batch[i], sizeof(batch[i]))) {
+            r.error = SYS_ERR_INVALID_USER_BUFFER;
+            break;
+        }
+        struct invoke_batch_entry e = batch[i];
+
+        arch_registers_state_t regs;
+        struct registers_arm_syscall_args *sa = &regs.syscall_args;
+        int argc = e.argc + 2;
+
+        if (e.argc > INVOKE_BATCH_MAX_ARGS) {
+            e.ret = SYSRET(SYS_ERR_INVARGS_SYSCALL);
+        } else {
+            memset(&regs, 0, sizeof(regs));
+            sa->arg0 = (e.level << 16) | (e.cmd << 8) | (argc << 4) |
+                       SYSCALL_INVOKE;
+            sa->arg1 = e.cptr;
+            // arguments go where cap_invoke() would have put them: arg2 to
+            // arg10 are contiguous, arg11 is after the frame pointer
+            uint32_t *args = &sa->arg2;
+            for (size_t j = 0; j < e.argc && j < 9; j++) {
+                args[j] = e.args[j];
+            }
+            sa->arg11 = e.args[9];
+
+            struct capability *to;
+            e.ret.value = 0;
+            e.ret.error = caps_lookup_cap(&dcb_current->cspace.cap, e.cptr,
+                                          e.level, &to, CAPRIGHTS_READ);
+            if (err_is_ok(e.ret.error)) {
+                if (to->type == ObjType_EndPoint) {
+                    e.ret.error = SYS_ERR_ILLEGAL_INVOCATION;
+                } else {
+                    e.ret = invoke_kernel_cap(to, &regs, argc);
+                    if (!dcb_current) {
+                        // the caller is gone, dispatch someone else
+                        assert(err_is_ok(e.ret.error));
                         dispatch(schedule());
                     }
-                    return r;
                 }
             }
-            printk(LOG_ERR, "Bad invocation type %d cmd %d\n", to->type, cmd);
-            r.error = SYS_ERR_ILLEGAL_INVOCATION;
+        }
+
+        r.value = i + 1;
+        if (!access_ok(ACCESS_WRITE, (lvaddr_t)&batch[i].ret,
+                       sizeof(batch[i].ret))) {
+            r.error = SYS_ERR_INVALID_USER_BUFFER;
+            break;
+        }
+        batch[i].ret = e.ret;
+        if (err_is_fail(e.ret.error)) {
+            r.error = e.ret.error;
+            break;
         }
     }
 
@@ -1221,6 +1442,18 @@ static struct sysret handle_debug_syscall(int msg)
             retval.value = kernel_now;
             break;
 
+        case DEBUG_CAP_LOOKUP_CACHE_RESET:
+            caps_lookup_hits = caps_lookup_count = 0;
+            break;
+
+        case DEBUG_CAP_LOOKUP_CACHE_HITS_READ:
+            retval.value = caps_lookup_hits;
+            break;
+
+        case DEBUG_CAP_LOOKUP_CACHE_COUNT_READ:
+            retval.value = caps_lookup_count;
+            break;
+
         case DEBUG_HARDWARE_TIMER_READ:
             /* XXX - timestamp syscalls should disappear on A15+, and be
              * consolidated on A9. */
@@ -1276,6 +1509,11 @@ void sys_syscall(arch_registers_state_t* context,
     }
     assert(disabled == dcb_current->disabled);
 
+#ifdef CONFIG_ONESHOT_TIMER
+    // there's no tick to keep kernel_now current, see timer.c
+    kernel_now = timer_now();
+#endif
+
     STATIC_ASSERT_OFFSETOF(struct sysret, error, 0);
 
     struct registers_arm_syscall_args* sa = &context->syscall_args;
@@ -1289,12 +1527,24 @@ void sys_syscall(arch_registers_state_t* context,
 
     struct sysret r = { .error = SYS_ERR_INVARGS_SYSCALL, .value = 0 };
 
+    if (syscall < SYSCALL_COUNT) {
+        dcb_current->stats.syscalls[syscall]++;
+    }
+    ktrace(KTRACE_SUBSYS_SYSCALL, KTraceSyscall, dcb_current, NULL, sa->arg0);
+
     switch (syscall)
     {
         case SYSCALL_INVOKE:
             r = handle_invoke(context, argc);
             break;
 
+        case SYSCALL_INVOKE_BATCH:
+            if (argc == 3) {
+                r = handle_invoke_batch((struct invoke_batch_entry *)sa->arg1,
+                                        sa->arg2);
+            }
+            break;
+
         case SYSCALL_YIELD:
             if (argc == 2)
             {
@@ -1361,6 +1611,7 @@ void sys_syscall(arch_registers_state_t* context,
 
     context->named.r0 = r.error;
     context->named.r1 = r.value;
+    ktrace(KTRACE_SUBSYS_SYSCALL, KTraceSyscallRet, dcb_current, NULL, r.error);
 
     debug(SUBSYS_SYSCALL, "syscall: Resuming; dcb->disabled=%d, disp->disabled=%d\n",
 	  dcb_current->disabled, disp->d.disabled);
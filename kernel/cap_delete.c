@@ -26,6 +26,7 @@
 #include <paging_kernel_arch.h>
 #include <mdb/mdb.h>
 #include <mdb/mdb_tree.h>
+#include <shared_buffer.h>
 #include <wakeup.h>
 
 struct cte *clear_head, *clear_tail;
@@ -192,6 +193,8 @@ cleanup_copy(struct cte *cte)
     }
     TRACE_CAP_MSG("cleaned up copy", cte);
     assert(!mdb_reachable(cte));
+    caps_lookup_cache_clear_slot(cte);
+    shared_buffer_cte_cleanup(cte);
     memset(cte, 0, sizeof(*cte));
 
     return SYS_ERR_OK;
@@ -468,10 +468,18 @@ static size_t caps_max_numobjs(enum objtype type, gensize_t srcsize, gensize_t o
 STATIC_ASSERT(49 == ObjType_Num, "Knowledge of all cap types");
 
 static errval_t caps_zero_objects(enum objtype type, lpaddr_t lpaddr,
-                                  gensize_t objsize, size_t count)
+                                  gensize_t objsize, size_t count,
+                                  bool prezeroed)
 {
     assert(type < ObjType_Num);
 
+    if (prezeroed) {
+        // caps_zero_ram() already zeroed and cleaned the memory
+        debug(SUBSYS_CAPS, "Not zeroing prezeroed memory @%#"PRIxLPADDR"\n",
+                lpaddr);
+        return SYS_ERR_OK;
+    }
+
     // Virtual address of the memory the kernel object resides in
     // XXX: A better of doing this,
     // this is creating caps that the kernel cannot address.
@@ -490,8 +498,9 @@ static errval_t caps_zero_objects(enum objtype type, lpaddr_t lpaddr,
                 (size_t)objsize * count, lpaddr);
         memset((void*)lvaddr, 0, objsize * count);
         dmb();
-        /* Clean the whole L1 - we've trashed most of it anyway. */
-        clean_data_caches_pouu();
+        cache_range_op((void *)lvaddr,
+                       (void *)(lvaddr + ((size_t)objsize * count - 1)),
+                       CLEAN_TO_POU);
         dmb();
         break;
 
@@ -528,7 +537,9 @@ static errval_t caps_zero_objects(enum objtype type, lpaddr_t lpaddr,
                 (size_t)objsize * count, lpaddr);
         memset((void*)lvaddr, 0, objsize * count);
         dmb();
-        clean_data_caches_pouu();
+        cache_range_op((void *)lvaddr,
+                       (void *)(lvaddr + ((size_t)objsize * count - 1)),
+                       CLEAN_TO_POU);
         dmb();
         break;
 
@@ -582,6 +593,9 @@ static errval_t caps_zero_objects(enum objtype type, lpaddr_t lpaddr,
  * \param objsize       For variable-sized objects, size in bytes.
  * \param count         Number of objects to be created
  *                      (count <= caps_max_numobjs(type, size, objsize))
+ * \param owner         Core that owns the new objects.
+ * \param prezeroed     The objects' memory is already zero, see
+ *                      caps_zero_ram().
  * \param dest_caps     Pointer to array of CTEs to hold created caps.
  *
  * \return Error code
@@ -592,7 +606,7 @@ STATIC_ASSERT(49 == ObjType_Num, "Knowledge of all cap types");
 
 static errval_t caps_create(enum objtype type, lpaddr_t lpaddr, gensize_t size,
                             gensize_t objsize, size_t count, coreid_t owner,
-                            struct cte *dest_caps)
+                            bool prezeroed, struct cte *dest_caps)
 {
     errval_t err;
 
@@ -634,7 +648,7 @@ static errval_t caps_create(enum objtype type, lpaddr_t lpaddr, gensize_t size,
     debug(SUBSYS_CAPS, "owner = %d, my_core_id = %d\n", owner, my_core_id);
     if (owner == my_core_id) {
         // If we're creating new local objects, they need to be cleared
-        err = caps_zero_objects(type, lpaddr, objsize, count);
+        err = caps_zero_objects(type, lpaddr, objsize, count, prezeroed);
         if (err_is_fail(err)) {
             return err;
         }
@@ -677,6 +691,7 @@ static errval_t caps_create(enum objtype type, lpaddr_t lpaddr, gensize_t size,
             // Initialize type specific fields
             temp_cap.u.ram.base = genpaddr + dest_i * objsize;
             temp_cap.u.ram.bytes = objsize;
+            temp_cap.u.ram.zeroed_pages = prezeroed ? objsize / BASE_PAGE_SIZE : 0;
             // Insert the capabilities
             err = set_cap(&dest_caps[dest_i].cap, &temp_cap);
             if (err_is_fail(err)) {
@@ -1086,6 +1101,32 @@ static errval_t caps_create(enum objtype type, lpaddr_t lpaddr, gensize_t size,
 /**
  * Look up a capability in two-level cspace rooted at `rootcn`.
  */
+/// Generation of cached cptr translations; 0 marks a never-used entry
+uint32_t caps_lookup_gen = 1;
+
+/// Level-2 lookups, and how many of them were served from the cache
+uint32_t caps_lookup_hits = 0, caps_lookup_count = 0;
+
+/**
+ * \brief Retire cached cptr translations that may go through a slot.
+ *
+ * Must be called before a slot is cleared. Only CNode capabilities can be on
+ * the path of a translation, so clearing anything else keeps the cache.
+ */
+void caps_lookup_cache_clear_slot(struct cte *cte)
+{
+    if (cte->cap.type == ObjType_L1CNode || cte->cap.type == ObjType_L2CNode) {
+        caps_lookup_gen++;
+    }
+}
+
+static inline struct cap_lookup_entry *
+caps_lookup_cache_entry(struct dcb *dcb, capaddr_t cptr)
+{
+    return &dcb->cap_cache[(cptr ^ (cptr >> L2_CNODE_BITS))
+                           % CAP_LOOKUP_CACHE_SIZE];
+}
+
 errval_t caps_lookup_slot(struct capability *rootcn, capaddr_t cptr,
                           uint8_t level, struct cte **ret, CapRights rights)
 {
@@ -1112,6 +1153,24 @@ errval_t caps_lookup_slot(struct capability *rootcn, capaddr_t cptr,
         return SYS_ERR_OK;
     }
 
+    // most lookups are for full cptrs from the running dispatcher, and hit
+    // the same few caps over and over
+    struct cap_lookup_entry *cached = NULL;
+    if (level == 2 && dcb_current != NULL) {
+        cached = caps_lookup_cache_entry(dcb_current, cptr);
+        caps_lookup_count++;
+        if (cached->gen == caps_lookup_gen && cached->cptr == cptr &&
+            cached->rootcn == rootcn && (cached->rights & rights) == rights)
+        {
+            caps_lookup_hits++;
+            if (cached->cte->cap.type == ObjType_Null) {
+                return SYS_ERR_CAP_NOT_FOUND;
+            }
+            *ret = cached->cte;
+            return SYS_ERR_OK;
+        }
+    }
+
     if (rootcn->type != ObjType_L1CNode) {
         debug(SUBSYS_CAPS, "%s: rootcn->type = %d, called from %p\n",
                 __FUNCTION__, rootcn->type,
@@ -1168,6 +1227,16 @@ errval_t caps_lookup_slot(struct capability *rootcn, capaddr_t cptr,
     }
 
     struct cte *cte = caps_locate_slot(get_address(&l2cnode->cap), l2index);
+
+    // the translation holds whether or not the slot is occupied
+    if (cached != NULL) {
+        cached->rootcn = rootcn;
+        cached->cptr = cptr;
+        cached->rights = rootcn->rights & l2cnode->cap.rights;
+        cached->gen = caps_lookup_gen;
+        cached->cte = cte;
+    }
+
     if (cte->cap.type == ObjType_Null) {
         return SYS_ERR_CAP_NOT_FOUND;
     }
@@ -1224,6 +1293,10 @@ errval_t caps_create_from_existing(struct capability *root, capaddr_t cnode_cptr
     if (err_is_fail(err)) {
         return err;
     }
+    // only the kernel can vouch for memory being zero
+    if (dest->cap.type == ObjType_RAM) {
+        dest->cap.u.ram.zeroed_pages = 0;
+    }
 
     dest->mdbnode.owner = owner;
 
@@ -1395,7 +1468,8 @@ errval_t caps_create_new(enum objtype type, lpaddr_t addr, size_t bytes,
     //}
 
     /* Create the new capabilities */
-    errval_t err = caps_create(type, addr, bytes, objsize, numobjs, owner, caps);
+    errval_t err = caps_create(type, addr, bytes, objsize, numobjs, owner,
+                               false, caps);
     if (err_is_fail(err)) {
         return err;
     }
@@ -1408,6 +1482,98 @@ errval_t caps_create_new(enum objtype type, lpaddr_t addr, size_t bytes,
     return SYS_ERR_OK;
 }
 
+/// Set the zeroed watermark of a RAM cap and of all its local copies
+static void caps_set_zeroed_pages(struct cte *cte, uint32_t pages)
+{
+    assert(cte->cap.type == ObjType_RAM);
+    cte->cap.u.ram.zeroed_pages = pages;
+
+    struct cte *next;
+    for (next = mdb_successor(cte);
+         next && is_copy(&next->cap, &cte->cap);
+         next = mdb_successor(next))
+    {
+        next->cap.u.ram.zeroed_pages = pages;
+    }
+    for (next = mdb_predecessor(cte);
+         next && is_copy(&next->cap, &cte->cap);
+         next = mdb_predecessor(next))
+    {
+        next->cap.u.ram.zeroed_pages = pages;
+    }
+}
+
+/**
+ * \brief Zero more of a RAM region ahead of it being retyped
+ *
+ * Zeroes up to `budget` bytes from the region's zeroed watermark, and cleans
+ * them to the point of unification. Objects retyped from below the watermark
+ * are then not zeroed again, so this moves the work out of the retype, and
+ * lets it be done in small steps when there is nothing else to do. The
+ * region must not have descendants, since these may have written to it.
+ *
+ * \param cte        RAM cap to zero.
+ * \param budget     Maximum number of bytes to zero, rounded up to pages.
+ * \param ret_pages  Returns the new watermark, in pages from the base.
+ */
+errval_t caps_zero_ram(struct cte *cte, size_t budget, size_t *ret_pages)
+{
+    struct capability *cap = &cte->cap;
+    assert(cap->type == ObjType_RAM);
+
+    if (distcap_is_foreign(cte) || cte->mdbnode.remote_copies ||
+        cte->mdbnode.remote_descs)
+    {
+        return SYS_ERR_RAM_ZERO_REMOTE;
+    }
+    if (has_descendants(cte)) {
+        return SYS_ERR_REVOKE_FIRST;
+    }
+
+    size_t done = cap->u.ram.zeroed_pages;
+    size_t todo = MIN(get_size(cap) / BASE_PAGE_SIZE - done,
+                      DIVIDE_ROUND_UP(budget, BASE_PAGE_SIZE));
+    if (todo > 0) {
+        size_t bytes = todo * BASE_PAGE_SIZE;
+        lpaddr_t lpaddr =
+            gen_phys_to_local_phys(get_address(cap) + done * BASE_PAGE_SIZE);
+        if (!local_phys_is_valid(lpaddr + bytes - 1)) {
+            return SYS_ERR_RAM_ZERO_UNREACHABLE;
+        }
+        lvaddr_t lvaddr = local_phys_to_mem(lpaddr);
+
+        debug(SUBSYS_CAPS, "RAM: zeroing %zu bytes @%#"PRIxLPADDR"\n",
+                bytes, lpaddr);
+        memset((void *)lvaddr, 0, bytes);
+        dmb();
+        cache_range_op((void *)lvaddr, (void *)(lvaddr + bytes - 1),
+                       CLEAN_TO_POU);
+        dmb();
+
+        done += todo;
+        caps_set_zeroed_pages(cte, done);
+    }
+
+    *ret_pages = done;
+    return SYS_ERR_OK;
+}
+
+/// Bytes of memory taken by each object of `type` created by a retype
+static gensize_t caps_retype_objbytes(enum objtype type, gensize_t objsize)
+{
+    if (type_is_vnode(type)) {
+        return vnode_objsize(type);
+    }
+    switch (type) {
+    case ObjType_Dispatcher:
+        return 1UL << OBJBITS_DISPATCHER;
+    case ObjType_KernelControlBlock:
+        return 1UL << OBJBITS_KCB;
+    default:
+        return objsize;
+    }
+}
+
 STATIC_ASSERT(49 == ObjType_Num, "Knowledge of all cap types");
 /// Retype caps
 /// Create `count` new caps of `type` from `offset` in src, and put them in
@@ -1601,15 +1767,31 @@ errval_t caps_retype(enum objtype type, gensize_t objsize, size_t count,
         }
     }
 
+    /* skip zeroing memory that caps_zero_ram() already zeroed. Once the new
+     * objects exist they may be written to, so none of the source counts
+     * as zeroed any more. */
+    bool prezeroed = false;
+    if (src_cap->type == ObjType_RAM && src_cap->u.ram.zeroed_pages > 0) {
+        prezeroed = !distcap_is_foreign(src_cte) &&
+                    !src_cte->mdbnode.remote_copies &&
+                    offset + count * caps_retype_objbytes(type, objsize) <=
+                    (gensize_t)src_cap->u.ram.zeroed_pages * BASE_PAGE_SIZE;
+    }
+
     /* create new caps */
     struct cte *dest_cte =
         caps_locate_slot(get_address(dest_cnode), dest_slot);
-    err = caps_create(type, base, size, objsize, count, my_core_id, dest_cte);
+    err = caps_create(type, base, size, objsize, count, my_core_id, prezeroed,
+                      dest_cte);
     if (err_is_fail(err)) {
         debug(SUBSYS_CAPS, "caps_retype: failed to create a dest cap\n");
         return err_push(err, SYS_ERR_RETYPE_CREATE);
     }
 
+    if (src_cap->type == ObjType_RAM && src_cap->u.ram.zeroed_pages > 0) {
+        caps_set_zeroed_pages(src_cte, 0);
+    }
+
     /* special initialisation for endpoint caps */
     if (type == ObjType_EndPoint) {
         assert(src_cap->type == ObjType_Dispatcher);
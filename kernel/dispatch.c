@@ -18,6 +18,7 @@
 #include <paging_kernel_arch.h>
 #include <dispatch.h>
 #include <kcb.h>
+#include <ktrace.h>
 #include <wakeup.h>
 #include <barrelfish_kpi/syscalls.h>
 #include <barrelfish_kpi/lmp.h>
@@ -26,6 +27,7 @@
 #include <barrelfish_kpi/registers_arch.h>
 
 #include <bitmacros.h>
+#include <platform.h> // timestamp_read()
 
 #if defined(__x86_64__) || defined(__i386__)
 #  include <arch/x86/apic.h>
@@ -125,8 +127,39 @@ fpu_lazy_bottom(struct dcb *dcb) {
 
 
 
+/// Timestamp of the last switch, up to which run time is accounted
+static uint64_t last_dispatch_ts;
+
+/**
+ * \brief Charge the time since the last switch to the dispatcher that ran,
+ * and count a switch to 'dcb'.
+ *
+ * Returning to the dispatcher that is already running isn't a switch, so
+ * its time keeps running and it costs nothing here.
+ */
+static inline void dispatch_account(struct dcb *dcb)
+{
+    if (dcb == dcb_current) {
+        return;
+    }
+
+    uint64_t now = timestamp_read();
+    if (dcb_current != NULL) {
+        dcb_current->stats.run_ticks += now - last_dispatch_ts;
+    }
+    last_dispatch_ts = now;
+
+    perfmon_switch(dcb_current, dcb);
+    ktrace(KTRACE_SUBSYS_DISPATCH, KTraceDispatch, dcb, NULL, 0);
+    if (dcb != NULL) {
+        dcb->stats.dispatches++;
+    }
+}
+
 void __attribute__ ((noreturn)) dispatch(struct dcb *dcb)
 {
+    dispatch_account(dcb);
+
 #ifdef FPU_LAZY_CONTEXT_SWITCH
     // Save state of FPU trap for this domain (treat it like normal context switched state)
     if(dcb_current != NULL && !dcb_current->is_vm_guest) {
@@ -326,6 +359,85 @@ errval_t lmp_can_deliver_payload(struct capability *ep,
     return SYS_ERR_OK;
 }
 
+/**
+ * \brief Tell the receiver of 'ep' about a newly delivered message of
+ * 'payload_len' words and make it runnable.
+ */
+static void lmp_deliver_notify(struct capability *ep, struct dcb *send,
+                               struct dcb *recv, size_t payload_len)
+{
+    struct dispatcher_shared_generic *recv_disp =
+        get_dispatcher_shared_generic(recv->disp);
+
+    if (send != NULL) {
+        send->stats.lmp_sent++;
+    }
+    recv->stats.lmp_received++;
+    ktrace(KTRACE_SUBSYS_LMP, KTraceLmpSend, send, recv, payload_len);
+
+    // tell the dispatcher that it has an outstanding message in one of its EPs
+    recv_disp->lmp_delivered += payload_len + LMP_RECV_HEADER_LENGTH;
+
+    // ... and give it a hint which one to look at
+    recv_disp->lmp_hint = ep->u.endpoint.epoffset;
+
+    // Make target runnable
+    make_runnable(recv);
+}
+
+/**
+ * \brief Deliver a capless LMP message without wrapping, if possible.
+ *
+ * The payload is given as two spans, so it can be copied straight out of
+ * the sender's saved registers even when those aren't contiguous. All the
+ * checks that lmp_can_deliver_payload() does get folded into one test on
+ * where the message ends.
+ *
+ * \param ep     Endpoint capability to send to
+ * \param lo     First 'nlo' words of the payload
+ * \param hi     Remaining 'nhi' words of the payload
+ *
+ * \return true if delivered, false if the caller must take the slow path
+ */
+bool lmp_deliver_fast(struct capability *ep, const uintptr_t *lo, size_t nlo,
+                      const uintptr_t *hi, size_t nhi)
+{
+    assert(ep != NULL);
+    assert(ep->type == ObjType_EndPoint);
+    struct dcb *recv = ep->u.endpoint.listener;
+    assert(recv != NULL);
+
+    if (recv->disp == 0 || ep->u.endpoint.epoffset == 0) {
+        return false;
+    }
+
+    struct lmp_endpoint_kern *recv_ep
+        = (void *)((uint8_t *)recv->disp + ep->u.endpoint.epoffset);
+    uint32_t epbuflen = ep->u.endpoint.epbuflen;
+    uint32_t pos = recv_ep->delivered;
+    uint32_t consumed = recv_ep->consumed;
+    size_t payload_len = nlo + nhi;
+
+    // The message must fit between pos and the end of the buffer, and must
+    // neither reach consumed nor make delivered == consumed afterwards.
+    uint32_t end = pos + LMP_RECV_HEADER_LENGTH + payload_len;
+    uint32_t limit = consumed > pos ? consumed : epbuflen + (consumed != 0);
+    if (pos >= epbuflen || consumed >= epbuflen || end >= limit) {
+        return false;
+    }
+
+    union lmp_recv_header recvheader = { .raw = 0 };
+    recvheader.x.length = payload_len;
+    recv_ep->buf[pos] = recvheader.raw;
+    lmp_ring_copy_contig(&recv_ep->buf[pos + LMP_RECV_HEADER_LENGTH],
+                         lo, nlo, hi, nhi);
+    recv_ep->delivered = end == epbuflen ? 0 : end;
+
+    // only ever called for a send by the current dispatcher
+    lmp_deliver_notify(ep, dcb_current, recv, payload_len);
+    return true;
+}
+
 /**
  * \brief Deliver the payload of an LMP message to a dispatcher.
  *
@@ -382,26 +494,40 @@ errval_t lmp_deliver_payload(struct capability *ep, struct dcb *send,
     }
 
     /* Transfer the msg */
-    for(int i = 0; i < payload_len; i++) {
-        recv_ep->buf[pos] = payload[i];
-        if (++pos == epbuflen) {
-            pos = 0;
-        }
-    }
+    pos = lmp_ring_copy(recv_ep->buf, epbuflen, pos, payload, payload_len);
 
     // update the delivered pos
     recv_ep->delivered = pos;
 
-    // tell the dispatcher that it has an outstanding message in one of its EPs
-    recv_disp->lmp_delivered += payload_len + LMP_RECV_HEADER_LENGTH;
+    lmp_deliver_notify(ep, send, recv, payload_len);
 
-    // ... and give it a hint which one to look at
-    recv_disp->lmp_hint = ep->u.endpoint.epoffset;
+    return SYS_ERR_OK;
+}
 
-    // Make target runnable
-    make_runnable(recv);
+/**
+ * \brief Block 'dcb' until an LMP message is delivered to one of its endpoints.
+ *
+ * Used by LMP calls: the sender is taken off the run queue, and delivery of
+ * the reply makes it runnable again. It stays runnable if it already has
+ * unseen messages or a pending wakeup, just like a yield without work.
+ * Blocking applies to the whole dispatcher, not just the calling thread.
+ */
+void lmp_wait_for_message(struct dcb *dcb)
+{
+    struct dispatcher_shared_generic *disp =
+        get_dispatcher_shared_generic(dcb->disp);
 
-    return SYS_ERR_OK;
+    systime_t wakeup = disp->wakeup;
+    if (disp->lmp_delivered == disp->lmp_seen
+        && (wakeup == 0 || wakeup > (kernel_now + kcb_current->kernel_off))) {
+        debug(SUBSYS_DISPATCH, "%.*s blocks for a reply\n",
+              DISP_NAME_LEN, disp->name);
+        dcb->stats.yields++;
+        scheduler_remove(dcb);
+        if (wakeup != 0) {
+            wakeup_set(dcb, wakeup);
+        }
+    }
 }
 
 /**
@@ -45,4 +45,20 @@ a15_gt_timeout(uint32_t t) {
     __asm volatile("mcr p15, 0, %0, c14, c2, 0" : : "r"(t));
 }
 
+/* Trigger a timeout interrupt once the counter reaches t. If it already has,
+ * the interrupt is raised straight away. */
+static inline void
+a15_gt_set_comparator(uint64_t t) {
+    /* Write CNTP_CVAL, the physical timer compare value register. */
+    uint32_t cval_low= (uint32_t)t, cval_high= (uint32_t)(t >> 32);
+    __asm volatile("mcrr p15, 2, %0, %1, c14" : :
+            "r"(cval_low), "r"(cval_high));
+}
+
+/* Stop the timer from triggering, see a15_gt_init(). */
+static inline void
+a15_gt_disarm(void) {
+    a15_gt_set_comparator(UINT64_MAX);
+}
+
 void a15_gt_init(void);
@@ -30,6 +30,15 @@ uint64_t a9_gt_read(void);
 uint32_t a9_gt_read_low(void);
 uint32_t a9_gt_read_high(void);
 
+/*
+ * One-shot interrupts off the comparator, for the tickless kernel.  The
+ * comparator is banked, so each core has its own.
+ */
+#define A9_GT_IRQ           27  /* private peripheral interrupt */
+#define A9_GT_MIN_DELTA     16  /* in counter ticks */
+void a9_gt_set_comparator(uint64_t t);
+void a9_gt_disarm(void);
+
 /* The Cortex-A* private timers are clocked by PERIPHCLK, which is not always
  * discoverable at runtime, so it's an optional boot parameter. */
 extern uint32_t periphclk;
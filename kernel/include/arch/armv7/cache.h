@@ -160,18 +160,29 @@ enum armv7_cache_range_op {
     INVALIDATE_TO_POC,
 };
 
+/* The smallest data cache line size, in bytes. See TRM B4.1.42. */
+static inline size_t
+cache_get_dminline(void) {
+    uint32_t ctr= cp15_read_ctr();
+    return 4 << ((ctr >> 16) & MASK(4));
+}
+
+/* Operate on every data cache line holding any of [start, end). */
 static inline void
 cache_range_op(void *start, void *end, enum armv7_cache_range_op op) {
-    for(;start < end; start++) {
+    size_t line= cache_get_dminline();
+    void *addr= (void *)((uintptr_t)start & ~(line - 1));
+
+    for(; addr < end; addr+= line) {
         switch(op) {
             case CLEAN_TO_POC:
-                clean_to_poc(start);
+                clean_to_poc(addr);
                 break;
             case CLEAN_TO_POU:
-                clean_to_pou(start);
+                clean_to_pou(addr);
                 break;
             case INVALIDATE_TO_POC:
-                invalidate_to_poc(start);
+                invalidate_to_poc(addr);
                 break;
             default:
                 panic("Invalid cache operation.\n");
@@ -61,6 +61,35 @@ static inline uint32_t cp15_read_far(void)
     return addr;
 }
 
+/**
+ * \brief Translate a virtual address as an unprivileged read (ATS1CUR),
+ * leaving the result in the PAR.
+ */
+static inline void cp15_write_ats1cur(uint32_t va)
+{
+    __asm volatile("mcr   p15, 0, %[va], c7, c8, 2" : : [va] "r" (va));
+}
+
+/**
+ * \brief Translate a virtual address as an unprivileged write (ATS1CUW),
+ * leaving the result in the PAR.
+ */
+static inline void cp15_write_ats1cuw(uint32_t va)
+{
+    __asm volatile("mcr   p15, 0, %[va], c7, c8, 3" : : [va] "r" (va));
+}
+
+/**
+ * \brief Read physical address register. Bit 0 is set if the last
+ * translation faulted.
+ */
+static inline uint32_t cp15_read_par(void)
+{
+    uint32_t par;
+    __asm volatile("mrc   p15, 0, %[par], c7, c4, 0" : [par] "=r" (par));
+    return par;
+}
+
 static inline lpaddr_t cp15_read_ttbr0(void)
 {
     lpaddr_t ttbr;
@@ -266,6 +295,61 @@ static inline void cp15_write_dccimvac(uint32_t x)
 	__asm volatile ("mcr p15, 0, %[x], c7, c14, 1" :: [x] "r" (x));
 }
 
+/* PMU cycle counter, enabled by perf_measurement_init(). */
+static inline uint32_t cp15_read_pmccntr(void)
+{
+  uint32_t x;
+  __asm volatile ("mrc p15, 0, %[x], c9, c13, 0" : [x] "=r" (x));
+  return x;
+}
+
+/* PMU event counters, see perfmon.c. */
+static inline uint32_t cp15_read_pmcr(void)
+{
+  uint32_t x;
+  __asm volatile ("mrc p15, 0, %[x], c9, c12, 0" : [x] "=r" (x));
+  return x;
+}
+
+static inline void cp15_write_pmcntenset(uint32_t x)
+{
+  __asm volatile ("mcr p15, 0, %[x], c9, c12, 1" :: [x] "r" (x));
+}
+
+static inline uint32_t cp15_read_pmovsr(void)
+{
+  uint32_t x;
+  __asm volatile ("mrc p15, 0, %[x], c9, c12, 3" : [x] "=r" (x));
+  return x;
+}
+
+static inline void cp15_write_pmovsr(uint32_t x)
+{
+  __asm volatile ("mcr p15, 0, %[x], c9, c12, 3" :: [x] "r" (x));
+}
+
+static inline void cp15_write_pmselr(uint32_t x)
+{
+  __asm volatile ("mcr p15, 0, %[x], c9, c12, 5" :: [x] "r" (x));
+}
+
+static inline void cp15_write_pmxevtyper(uint32_t x)
+{
+  __asm volatile ("mcr p15, 0, %[x], c9, c13, 1" :: [x] "r" (x));
+}
+
+static inline uint32_t cp15_read_pmxevcntr(void)
+{
+  uint32_t x;
+  __asm volatile ("mrc p15, 0, %[x], c9, c13, 2" : [x] "=r" (x));
+  return x;
+}
+
+static inline void cp15_write_pmxevcntr(uint32_t x)
+{
+  __asm volatile ("mcr p15, 0, %[x], c9, c13, 2" :: [x] "r" (x));
+}
+
 static inline void dsb(void) { __asm volatile ("dsb"); }
 static inline void dmb(void) { __asm volatile ("dmb"); }
 static inline void isb(void) { __asm volatile ("isb"); }
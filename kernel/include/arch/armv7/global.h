@@ -18,16 +18,28 @@
 
 #include <barrelfish_kpi/spinlocks_arch.h>
 
+/// Cores reachable by an IPI notification (the GIC target list is 8 bits)
+#define IPI_NOTIFY_MAX_CORES    8
+
+/// IPI notification channels per core
+#define IPI_NOTIFY_CHANS        64
+
 /**
  * \brief State shared between CPU drivers
  * By design, this should be empty. A spinlock for kernel debug printing is
- * our only concession to shared state.
+ * our only concession to shared state, along with the mailboxes that tell a
+ * core which notification channels an IPI was raised for.
  */
 struct global {
     /// Shared locks between the kernels
     struct {
         spinlock_t print;       ///< Lock for printing
     } locks;
+
+    /// Pending IPI notifications, one bit per channel of each core
+    struct {
+        uint32_t pending[IPI_NOTIFY_MAX_CORES][IPI_NOTIFY_CHANS / 32];
+    } notify;
 };
 
 extern struct global *global;
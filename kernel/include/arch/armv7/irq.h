@@ -28,4 +28,13 @@ struct kcb;
 errval_t irq_table_notify_domains(struct kcb *kcb);
 void send_user_interrupt(int irq);
 
+/// SGI used to tell another core that one of its notification channels fired
+#define IPI_NOTIFY_SGI          2
+
+errval_t ipi_register_notification(capaddr_t ep, uint8_t level,
+                                   unsigned int chanid);
+errval_t ipi_delete_notification(unsigned int chanid);
+errval_t ipi_raise_notify(coreid_t coreid, unsigned int chanid);
+void ipi_handle_notify(void);
+
 #endif // KERNEL_ARCH_ARM_IRQ_H
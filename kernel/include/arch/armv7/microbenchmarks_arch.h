@@ -0,0 +1,27 @@
+/**
+ * \file
+ * \brief ARMv7 part of the kernel microbenchmark support.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetsstrasse 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#ifndef __MICROBENCHMARKS_ARCH_H
+#define __MICROBENCHMARKS_ARCH_H
+
+#include <cp15.h>
+
+/// Read the cycle counter, once everything before has completed
+static inline uint32_t microbench_ticks(void)
+{
+    isb();
+    return cp15_read_pmccntr();
+}
+
+#endif //__MICROBENCHMARKS_ARCH_H
@@ -50,7 +50,11 @@ void paging_map_user_pages_l1(lvaddr_t table_addr, lvaddr_t vaddr, lpaddr_t padd
 
 void paging_set_l2_entry(uintptr_t* l2entry, lpaddr_t paddr, uintptr_t flags);
 
-void paging_context_switch(lpaddr_t table_addr);
+bool paging_user_page_accessible(lvaddr_t vaddr, bool write);
+
+struct dcb;
+uint8_t paging_asid_get(struct dcb *dcb);
+void paging_context_switch(lpaddr_t table_addr, uint32_t contextidr);
 
 // REVIEW: [2010-05-04 orion]
 // these were deprecated in churn, enabling now to get system running again.
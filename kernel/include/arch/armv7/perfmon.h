@@ -0,0 +1,34 @@
+/**
+ * \file
+ * \brief Per-dispatcher PMU event counting.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#ifndef __PERFMON_H__
+#define __PERFMON_H__
+
+#include <barrelfish_kpi/dispatcher_perfmon.h>
+
+struct dcb;
+
+/// A dispatcher's PMU events, and what they counted so far
+struct dcb_perfmon {
+    struct perfmon_events events;
+    struct perfmon_counts counts;
+    bool on;                        ///< Any events programmed?
+};
+
+void perfmon_init(void);
+void perfmon_switch(struct dcb *from, struct dcb *to);
+errval_t perfmon_setup(struct dcb *dcb, const struct perfmon_events *events);
+void perfmon_read(struct dcb *dcb, struct perfmon_counts *counts);
+
+#endif // __PERFMON_H__
@@ -0,0 +1,23 @@
+/**
+ * \file
+ * \brief Timer-driven PC sampling profiler.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#ifndef __PROFILE_H__
+#define __PROFILE_H__
+
+#include <barrelfish_kpi/registers_arch.h>
+
+errval_t profile_setup(capaddr_t frame, uint8_t level);
+void profile_sample(arch_registers_state_t *save_area, uintptr_t fault_pc);
+
+#endif // __PROFILE_H__
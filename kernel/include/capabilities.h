@@ -106,6 +106,7 @@ errval_t caps_retype(enum objtype type, gensize_t objsize, size_t count,
                      struct capability *dest_cnode, cslot_t dest_slot,
                      struct cte *src_cte, gensize_t offset,
                      bool from_monitor);
+errval_t caps_zero_ram(struct cte *cte, size_t budget, size_t *ret_pages);
 errval_t is_retypeable(struct cte *src_cte,
                        enum objtype src_type,
                        enum objtype dest_type,
@@ -116,6 +117,29 @@ errval_t caps_lookup_cap(struct capability *cnode_cap, capaddr_t cptr,
 errval_t caps_lookup_slot(struct capability *rootcn, capaddr_t cptr,
                           uint8_t level, struct cte **ret, CapRights rights);
 
+/// Number of cptr translations each DCB remembers
+#define CAP_LOOKUP_CACHE_SIZE   8
+
+/**
+ * \brief A remembered cptr translation, see caps_lookup_slot()
+ *
+ * The slot a cptr names can only change when a CNode capability on the path
+ * to it is cleared, and clearing any CNode capability bumps caps_lookup_gen,
+ * which retires all entries. The contents of the slot are always re-read.
+ */
+struct cap_lookup_entry {
+    struct capability *rootcn;  ///< Root CNode the lookup started from
+    capaddr_t cptr;
+    CapRights rights;           ///< Rights common to the CNodes on the path
+    uint32_t gen;               ///< Value of caps_lookup_gen when filled-in
+    struct cte *cte;            ///< Slot the cptr names
+};
+
+extern uint32_t caps_lookup_gen;
+extern uint32_t caps_lookup_hits, caps_lookup_count;
+
+void caps_lookup_cache_clear_slot(struct cte *cte);
+
 /*
  * Delete and revoke
  */
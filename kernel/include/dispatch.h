@@ -17,8 +17,10 @@
 
 #include <barrelfish_kpi/cpu.h>
 #include <barrelfish_kpi/dispatcher_shared_arch.h>
+#include <barrelfish_kpi/dispatcher_stats.h>
 #include <capabilities.h>
 #include <misc.h>
+#include <perfmon.h>
 
 extern uint64_t context_switch_counter;
 
@@ -41,14 +43,21 @@ struct dcb {
     bool                disabled;       ///< Was dispatcher disabled when last saved?
     struct cte          cspace;         ///< Cap slot for CSpace
     lpaddr_t            vspace;         ///< Address of VSpace root
+    uint8_t             asid;           ///< ASID of the VSpace on this core
+    uint32_t            asid_gen;       ///< ASID generation asid is valid in
     struct cte          disp_cte;
+    /// Recent level-2 cptr translations, see caps_lookup_slot()
+    struct cap_lookup_entry cap_cache[CAP_LOOKUP_CACHE_SIZE];
     unsigned int        faults_taken;   ///< # of disabled faults or traps taken
+    struct dispatcher_stats stats;      ///< Accounting, see dispatch()
+    struct dcb_perfmon  perfmon;        ///< PMU events, see perfmon.c
     /// Indicates whether this domain shall be executed in VM guest mode
     bool                is_vm_guest;
     struct guest        guest_desc;     ///< Descriptor of the VM Guest
     uint64_t            domain_id;      ///< ID of dispatcher's domain
     systime_t           wakeup_time;    ///< Time to wakeup this dispatcher
-    struct dcb          *wakeup_prev, *wakeup_next; ///< Next/prev in timeout queue
+    struct dcb          *wakeup_prev, *wakeup_next; ///< Next/prev in wheel slot
+    uint16_t            wakeup_slot;    ///< Wheel slot, see wakeup.c
 
     struct dcb          *next;          ///< Next DCB in schedule
     struct dcb          *prev;          ///< Previous DCB in schedule
@@ -58,6 +67,10 @@ struct dcb {
     unsigned long       wcet, period, deadline;
     unsigned short      weight;
     enum task_type      type;
+    /// Links in the run or release queue, see schedule_rbed.c
+    struct dcb          *heap_child, *heap_next, *heap_prev;
+    unsigned long       queue_seq;      ///< Tie-breaker, in queueing order
+    bool                released;       ///< In the run queue?
 #endif
 };
 
@@ -88,6 +101,43 @@ errval_t lmp_deliver(struct capability *ep, struct dcb *send,
                      uintptr_t *payload, size_t payload_len,
                      capaddr_t send_cptr, uint8_t send_bits, bool give_away);
 
+bool lmp_deliver_fast(struct capability *ep, const uintptr_t *lo, size_t nlo,
+                      const uintptr_t *hi, size_t nhi);
+void lmp_wait_for_message(struct dcb *dcb);
+
+/**
+ * \brief Copy 'len' words into an LMP endpoint ring at 'pos', wrapping
+ * around as needed. Returns the position after the last word.
+ */
+static inline uint32_t lmp_ring_copy(uintptr_t *buf, uint32_t epbuflen,
+                                     uint32_t pos, const uintptr_t *payload,
+                                     size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        buf[pos] = payload[i];
+        if (++pos == epbuflen) {
+            pos = 0;
+        }
+    }
+    return pos;
+}
+
+/**
+ * \brief Copy a message made of two spans, 'lo' and 'hi', to 'dst', which
+ * the caller has checked to have room without wrapping.
+ */
+static inline void lmp_ring_copy_contig(uintptr_t *dst,
+                                        const uintptr_t *lo, size_t nlo,
+                                        const uintptr_t *hi, size_t nhi)
+{
+    for (size_t i = 0; i < nlo; i++) {
+        dst[i] = lo[i];
+    }
+    for (size_t i = 0; i < nhi; i++) {
+        dst[nlo + i] = hi[i];
+    }
+}
+
 /// Deliver an empty LMP as a notification
 static inline errval_t lmp_deliver_notification(struct capability *ep)
 {
@@ -23,6 +23,11 @@
 struct cte;
 struct dcb;
 
+/// Wakeup timing wheel geometry, see wakeup.c
+#define WAKEUP_WHEEL_BITS       6
+#define WAKEUP_WHEEL_SLOTS      (1 << WAKEUP_WHEEL_BITS)
+#define WAKEUP_WHEEL_LEVELS     4
+
 enum sched_state {
     SCHED_RR,
     SCHED_RBED,
@@ -54,13 +59,21 @@ struct kcb {
     enum sched_state sched;
     /// RR scheduler state
     struct dcb *ring_current;
-    /// RBED scheduler state
+    /// RBED scheduler state: every queued DCB, in no particular order, and
+    /// the same DCBs split into ones released and ones to be released
     struct dcb *queue_head, *queue_tail;
+    struct dcb *run_queue, *release_queue;
+    unsigned long queue_seq;
     unsigned int u_hrt, u_srt, w_be, n_be;
     /// current time since kernel start in timeslices. This is necessary to
     /// make the scheduler work correctly
-    /// wakeup queue head
-    struct dcb *wakeup_queue_head;
+    /// wakeup timing wheel: lists of DCBs, and which of them are non-empty
+    struct dcb *wakeup_wheel[WAKEUP_WHEEL_LEVELS][WAKEUP_WHEEL_SLOTS];
+    uint64_t wakeup_occupied[WAKEUP_WHEEL_LEVELS];
+    struct dcb *wakeup_far;     ///< DCBs beyond the wheel's reach
+    systime_t wakeup_now;       ///< time the wheel has been advanced to
+    systime_t wakeup_min;       ///< earliest wakeup, if wakeup_count > 0
+    size_t wakeup_count;
     /// last value of kernel_now before shutdown/migration
     //needs to be signed because it's possible to migrate a kcb onto a cpu
     //driver whose kernel_now > this kcb's kernel_off.
@@ -84,7 +97,10 @@ static inline void print_kcb(void)
     printk(LOG_DEBUG, "  mdb_root = 0x%"PRIxLVADDR"\n", kcb_current->mdb_root);
     printk(LOG_DEBUG, "  queue_head = %p\n", kcb_current->queue_head);
     printk(LOG_DEBUG, "  queue_tail = %p\n", kcb_current->queue_tail);
-    printk(LOG_DEBUG, "  wakeup_queue_head = %p\n", kcb_current->wakeup_queue_head);
+    printk(LOG_DEBUG, "  run_queue = %p, release_queue = %p\n",
+            kcb_current->run_queue, kcb_current->release_queue);
+    printk(LOG_DEBUG, "  wakeup_count = %zu, wakeup_min = %"PRIuSYSTIME"\n",
+            kcb_current->wakeup_count, kcb_current->wakeup_min);
     printk(LOG_DEBUG, "  u_hrt = %u, u_srt = %u, w_be = %u, n_be = %u\n",
             kcb_current->u_hrt, kcb_current->u_srt, kcb_current->w_be,
             kcb_current->n_be);
@@ -0,0 +1,41 @@
+/**
+ * \file
+ * \brief Kernel event trace buffer.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#ifndef KERNEL_KTRACE_H
+#define KERNEL_KTRACE_H
+
+#include <barrelfish_kpi/ktrace.h>
+
+struct dcb;
+
+/// The buffer, or NULL if we're not tracing
+extern struct ktrace_buffer *ktrace_buf;
+
+errval_t ktrace_setup(capaddr_t frame, uint8_t level, uint32_t mask);
+void ktrace_record(enum ktrace_event event, struct dcb *disp,
+                   struct dcb *peer, uint32_t arg);
+
+/**
+ * \brief Record an event, if its subsystem is being traced.
+ */
+static inline void ktrace(uint32_t subsys, enum ktrace_event event,
+                          struct dcb *disp, struct dcb *peer, uint32_t arg)
+{
+    struct ktrace_buffer *buf = ktrace_buf;
+    if (buf != NULL && (buf->mask & subsys)) {
+        ktrace_record(event, disp, peer, arg);
+    }
+}
+
+#endif // KERNEL_KTRACE_H
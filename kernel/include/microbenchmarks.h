@@ -10,12 +10,16 @@
 #ifndef __MICROBENCHMARKS_H
 #define __MICROBENCHMARKS_H
 
+#include <microbenchmarks_arch.h>
+
 // The number of times the benchmark should run each instruction
-#define MICROBENCH_ITERATIONS 64
+#define MICROBENCH_ITERATIONS 1024
 
 struct microbench; // forward declaration
+struct dcb;
 
-/* function that executes a particular microbenchmark, storing its result
+/* function that executes a particular microbenchmark, timing each iteration
+ * with microbench_record()
  * return value should be zero on success
  */
 typedef int (* microbench_run_func)(struct microbench *);
@@ -23,12 +27,22 @@ typedef int (* microbench_run_func)(struct microbench *);
 struct microbench {
     const char * NTS name;
     microbench_run_func run_func;
-    uint64_t result;
+    size_t samples;             ///< Iterations timed
+    uint32_t min, median, p99;  ///< Cycles per iteration
 };
 
+/// Run the microbenchmarks at boot, set by "microbenchmarks" on the cmdline
+extern bool kernel_microbenchmarks;
+
+void microbench_record(uint32_t ticks);
 void microbenchmarks_run_all(void);
 
 extern struct microbench arch_benchmarks[];
 extern size_t arch_benchmarks_size;
 
+/// Bytes of physical memory arch_microbenchmarks_init() must be given
+extern const size_t arch_microbenchmarks_arena_bytes;
+
+void arch_microbenchmarks_init(lpaddr_t arena, struct dcb *init_dcb);
+
 #endif //__MICROBENCHMARKS_H
@@ -0,0 +1,59 @@
+/**
+ * \file
+ * \brief Buffers the kernel fills in frames of user domains.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#ifndef KERNEL_SHARED_BUFFER_H
+#define KERNEL_SHARED_BUFFER_H
+
+#include <capabilities.h>
+#include <barrelfish_kpi/shared_buffer.h>
+
+#define SHARED_BUFFER_MAX_DISPATCHERS   64
+
+/**
+ * \brief A frame of a user domain that the kernel writes to
+ *
+ * The domain can write to all of the frame at any time, so everything the
+ * kernel needs to find its way around the buffer is kept here, and only
+ * ever written to the frame.
+ */
+struct shared_buffer {
+    struct cte frame;           ///< Our copy of the frame capability
+    void *base;                 ///< Kernel address of the frame, or NULL
+    size_t bytes;               ///< Size of the frame
+
+    /// Called when the buffer stops being used, also if its frame is revoked
+    void (*stopped)(void);
+    struct shared_buffer *next; ///< Next buffer in use
+
+    /// The frame's dispatcher table and its count of entries used
+    struct shared_buffer_dispatcher *dispatchers;
+    volatile uint32_t *ndispatchers;
+    uint32_t maxdispatchers;
+
+    uint32_t count;             ///< Entries used in dispatchers[]
+    struct dcb *dcbs[SHARED_BUFFER_MAX_DISPATCHERS];
+    char names[SHARED_BUFFER_MAX_DISPATCHERS][DISP_NAME_LEN];
+};
+
+errval_t shared_buffer_setup(struct shared_buffer *sb, capaddr_t frame,
+                             uint8_t level, size_t minbytes);
+void shared_buffer_set_dispatchers(struct shared_buffer *sb,
+                                   struct shared_buffer_dispatcher *table,
+                                   volatile uint32_t *ndispatchers,
+                                   uint32_t max);
+void shared_buffer_stop(struct shared_buffer *sb);
+void shared_buffer_cte_cleanup(struct cte *cte);
+int shared_buffer_disp_index(struct shared_buffer *sb, struct dcb *dcb);
+
+#endif // KERNEL_SHARED_BUFFER_H
@@ -31,4 +31,9 @@ void arch_set_timer(systime_t t);
 void update_wakeup_timer(systime_t wakeup_timer);
 void update_sched_timer(systime_t sched_timer);
 
+void timer_reset(void);
+systime_t timer_now(void);
+uint64_t timer_to_timestamp(systime_t t);
+void timer_expired(void);
+
 #endif // __TIMER_H
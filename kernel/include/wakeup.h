@@ -10,11 +10,12 @@
 #ifndef KERNEL_WAKEUP_H
 #define KERNEL_WAKEUP_H
 
-/// only use for restoring state
-void wakeup_set_queue_head(struct dcb *h);
+struct kcb;
+
 void wakeup_remove(struct dcb *dcb);
 void wakeup_set(struct dcb *dcb, systime_t waketime);
 void wakeup_check(systime_t now);
 bool wakeup_is_pending(void);
+void wakeup_for_each(struct kcb *kcb, void (*func)(struct dcb *));
 
 #endif
@@ -15,6 +15,7 @@
 #include <kernel.h>
 #include <kcb.h>
 #include <dispatch.h>
+#include <wakeup.h>
 
 // this is used to pin a kcb for critical sections
 bool kcb_sched_suspended = false;
@@ -80,6 +81,15 @@ errval_t kcb_remove(struct kcb *to_remove)
     return SYS_ERR_KCB_NOT_FOUND;
 }
 
+static void wakeup_update_core_id(struct dcb *d)
+{
+    printk(LOG_NOTE, "[wakeup] updating current core id to %d for %s\n",
+            my_core_id, get_disp_name(d));
+    struct dispatcher_shared_generic *disp =
+        get_dispatcher_shared_generic(d->disp);
+    disp->curr_core_id = my_core_id;
+}
+
 void kcb_update_core_id(struct kcb *kcb)
 {
 #ifdef CONFIG_SCHEDULER_RBED
@@ -96,13 +106,7 @@ void kcb_update_core_id(struct kcb *kcb)
 #error must define scheduler policy in Config.hs
 #endif
     // do it for dcbs in wakeup queue
-    for (struct dcb *d = kcb->wakeup_queue_head; d; d=d->wakeup_next) {
-        printk(LOG_NOTE, "[wakeup] updating current core id to %d for %s\n",
-                my_core_id, get_disp_name(d));
-        struct dispatcher_shared_generic *disp =
-            get_dispatcher_shared_generic(d->disp);
-        disp->curr_core_id = my_core_id;
-    }
+    wakeup_for_each(kcb, wakeup_update_core_id);
 
     for (int i = 0; i < NDISPATCH; i++) {
         struct capability *cap = &kcb->irq_dispatch[i].cap;
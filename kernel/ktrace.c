@@ -0,0 +1,108 @@
+/**
+ * \file
+ * \brief Kernel event trace buffer.
+ *
+ * Each core's kernel traces into its own buffer, see barrelfish_kpi/ktrace.h,
+ * and it's the only writer, so appending a record needs no locking. Only
+ * 'mask' is read back from the buffer, everything else the kernel keeps to
+ * itself and just publishes there.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <kernel.h>
+#include <string.h>
+#include <dispatch.h>
+#include <ktrace.h>
+#include <platform.h>
+#include <shared_buffer.h>
+
+struct ktrace_buffer *ktrace_buf;
+
+static void ktrace_stopped(void)
+{
+    ktrace_buf = NULL;
+}
+
+static struct shared_buffer ktrace_shared = { .stopped = ktrace_stopped };
+
+/// Size of ktrace_buf->records, and records written to it
+static uint32_t ktrace_nrecords;
+static uint32_t ktrace_head;
+
+/**
+ * \brief Start tracing the subsystems in 'mask' into a frame of the calling
+ * dispatcher.
+ *
+ * Replaces the buffer of an earlier call. A cptr of 0 just stops tracing.
+ */
+errval_t ktrace_setup(capaddr_t frame, uint8_t level, uint32_t mask)
+{
+    errval_t err = shared_buffer_setup(&ktrace_shared, frame, level,
+                                       sizeof(struct ktrace_buffer) +
+                                       sizeof(struct ktrace_record));
+    if (err_is_fail(err) || ktrace_shared.base == NULL) {
+        return err;
+    }
+
+    // a power of two, so finding a record's slot is cheap
+    size_t n = (ktrace_shared.bytes - sizeof(struct ktrace_buffer)) /
+               sizeof(struct ktrace_record);
+    uint32_t nrecords = 1;
+    while (nrecords * 2 <= n) {
+        nrecords *= 2;
+    }
+
+    struct ktrace_buffer *buf = ktrace_shared.base;
+    memset(buf, 0, sizeof(*buf));
+    buf->nrecords = ktrace_nrecords = nrecords;
+    ktrace_head = 0;
+    buf->mask = mask;
+    buf->tick_hz = timestamp_freq();
+    buf->core = my_core_id;
+    buf->magic = KTRACE_MAGIC;
+    shared_buffer_set_dispatchers(&ktrace_shared, buf->dispatchers,
+                                  &buf->ndispatchers, KTRACE_MAX_DISPATCHERS);
+    ktrace_buf = buf;
+    return SYS_ERR_OK;
+}
+
+static uint8_t ktrace_disp_index(struct dcb *dcb)
+{
+    if (dcb == NULL) {
+        return KTRACE_DISP_NONE;
+    }
+    int i = shared_buffer_disp_index(&ktrace_shared, dcb);
+    return i < 0 ? KTRACE_DISP_NONE : i;
+}
+
+/**
+ * \brief Append a record to the trace, see ktrace().
+ */
+void ktrace_record(enum ktrace_event event, struct dcb *disp,
+                   struct dcb *peer, uint32_t arg)
+{
+    struct ktrace_buffer *buf = ktrace_buf;
+    uint32_t head = ktrace_head;
+    // the frame must still be ours, see shared_buffer_cte_cleanup()
+    assert(ktrace_shared.frame.cap.type == ObjType_Frame);
+
+    struct ktrace_record *r = &buf->records[head & (ktrace_nrecords - 1)];
+    r->ts = timestamp_read();
+    r->event = event;
+    r->disp = ktrace_disp_index(disp);
+    r->peer = ktrace_disp_index(peer);
+    r->reserved = 0;
+    r->arg = arg;
+
+    // the record must be complete before the head says it's there
+    ktrace_head = head + 1;
+    __atomic_store_n(&buf->head, ktrace_head, __ATOMIC_RELEASE);
+}
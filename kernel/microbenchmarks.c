@@ -2,10 +2,11 @@
  * \file
  * \brief Generic/base microbenchmark code.
  *
- * This file implements some (currently very primitive) services for
- * running and printing the results of a set of microbenchmarks.
+ * This file implements the services for running a set of microbenchmarks,
+ * and printing the minimum, median and 99th percentile of the cycles each
+ * iteration took, one comma-separated line per benchmark.
  * Most of the benchmarks themselves are defined in the architecture-specific
- * part, in arch_microbenchmarks.c.
+ * part, in arch/armv7/microbenchmarks.c.
  */
 
 /*
@@ -23,20 +24,49 @@
 #include <microbenchmarks.h>
 #include <misc.h>
 
-static uint64_t divide_round(uint64_t quotient, uint64_t divisor)
+#ifdef CONFIG_MICROBENCHMARKS
+bool kernel_microbenchmarks = true;
+#else
+bool kernel_microbenchmarks = false;
+#endif
+
+/// Cycles taken by each iteration of the benchmark being run
+static uint32_t microbench_samples[MICROBENCH_ITERATIONS];
+static size_t microbench_nsamples;
+
+/**
+ * \brief Record how long one iteration of the running benchmark took.
+ */
+void microbench_record(uint32_t ticks)
 {
-    if ((quotient % divisor) * 2 >= divisor) {
-        // round up
-        return (quotient / divisor) + 1;
-    } else {
-        return (quotient / divisor);
+    if (microbench_nsamples < MICROBENCH_ITERATIONS) {
+        microbench_samples[microbench_nsamples++] = ticks;
     }
 }
 
-static int microbench_print(struct microbench *mb, char *buf, size_t len)
+/// Sort the samples, and keep their minimum, median and 99th percentile
+static void microbench_summarise(struct microbench *mb)
 {
-    return snprintf(buf, len, "%" PRIu64 " ticks",
-                    divide_round(mb->result, MICROBENCH_ITERATIONS));
+    uint32_t *s = microbench_samples;
+    size_t n = microbench_nsamples;
+
+    // insertion sort: there are few samples, and we have no qsort()
+    for (size_t i = 1; i < n; i++) {
+        uint32_t x = s[i];
+        size_t j = i;
+        for (; j > 0 && s[j - 1] > x; j--) {
+            s[j] = s[j - 1];
+        }
+        s[j] = x;
+    }
+
+    mb->samples = n;
+    if (n > 0) {
+        mb->min = s[0];
+        mb->median = s[n / 2];
+        // nearest rank
+        mb->p99 = s[(n * 99 + 99) / 100 - 1];
+    }
 }
 
 static int microbenchmarks_run(struct microbench *benchs, size_t nbenchs)
@@ -48,41 +78,164 @@ static int microbenchmarks_run(struct microbench *benchs, size_t nbenchs)
         mb = &benchs[i];
         printk(LOG_NOTE, "Running benchmark %zu/%zu: %s\n", i + 1, nbenchs,
                mb->name);
+        microbench_nsamples = 0;
         r = mb->run_func(mb);
 
         if (r != 0) {
             printk(LOG_ERR, "%s: Error %d running %s\n", __func__, r, mb->name);
             return r;
         }
+        microbench_summarise(mb);
     }
 
     return 0;
 }
 
-static int microbenchmarks_print_all(struct microbench *benchs, size_t nbenchs)
+/// One line per benchmark, as comma-separated values
+static void microbenchmarks_print_all(struct microbench *benchs, size_t nbenchs)
 {
-    int i, r;
-    struct microbench *mb;
-    char buf[64];
+    for (size_t i = 0; i < nbenchs; i++) {
+        struct microbench *mb = &benchs[i];
+        printf("microbench,%s,%zu,%"PRIu32",%"PRIu32",%"PRIu32"\n",
+               mb->name, mb->samples, mb->min, mb->median, mb->p99);
+    }
+}
 
-    for (i = 0; i < nbenchs; i++) {
-        mb = &benchs[i];
-        r = microbench_print(mb, buf, sizeof(buf) - 1);
-        if (r <= 0 || r >= sizeof(buf)) {
-            /* FIXME: error handling */
-            return -1;
+/*
+ * memset() and memmove() on a page, as when zeroing objects and copying
+ * buffers. Before timing, each checks itself against a byte loop over short,
+ * misaligned and overlapping ranges, and fails if it gets any wrong.
+ */
+
+#define MB_MEM_BYTES BASE_PAGE_SIZE
+
+static uint8_t mb_mem_buf[2 * MB_MEM_BYTES + 128] __attribute__((aligned(64)));
+static uint8_t mb_mem_ref[sizeof(mb_mem_buf)];
+
+static void mb_mem_fill(void)
+{
+    for (size_t i = 0; i < sizeof(mb_mem_buf); i++) {
+        mb_mem_buf[i] = mb_mem_ref[i] = i * 7 + (i >> 8);
+    }
+}
+
+static bool mb_mem_same(void)
+{
+    for (size_t i = 0; i < sizeof(mb_mem_buf); i++) {
+        if (mb_mem_buf[i] != mb_mem_ref[i]) {
+            return false;
         }
-        printf("%40s: %s\n", mb->name, buf);
     }
+    return true;
+}
 
+static int mb_memset_check(void)
+{
+    for (size_t off = 0; off < 8; off++) {
+        for (size_t len = 0; len < 3 * 64; len++) {
+            mb_mem_fill();
+            memset(&mb_mem_buf[off], (int)(0x100 + len), len);
+            for (size_t i = 0; i < len; i++) {
+                mb_mem_ref[off + i] = len;
+            }
+            if (!mb_mem_same()) {
+                printk(LOG_ERR, "memset(+%zu, %zu) is wrong\n", off, len);
+                return -1;
+            }
+        }
+    }
     return 0;
 }
 
+static int mb_memmove_check(void)
+{
+    for (size_t src = 64; src < 72; src++) {
+        for (size_t dst = 0; dst < 2 * 64 + 8; dst += 3) {
+            for (size_t len = 0; len < 3 * 64; len += 5) {
+                mb_mem_fill();
+                memmove(&mb_mem_buf[dst], &mb_mem_buf[src], len);
+                if (dst < src) {
+                    for (size_t i = 0; i < len; i++) {
+                        mb_mem_ref[dst + i] = mb_mem_ref[src + i];
+                    }
+                } else {
+                    for (size_t i = len; i > 0; i--) {
+                        mb_mem_ref[dst + i - 1] = mb_mem_ref[src + i - 1];
+                    }
+                }
+                if (!mb_mem_same()) {
+                    printk(LOG_ERR, "memmove(+%zu, +%zu, %zu) is wrong\n",
+                           dst, src, len);
+                    return -1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+static int mb_memset(struct microbench *mb)
+{
+    int r = mb_memset_check();
+    if (r != 0) {
+        return r;
+    }
+
+    for (int i = 0; i < MICROBENCH_ITERATIONS; i++) {
+        uint32_t start = microbench_ticks();
+        memset(mb_mem_buf, 0, MB_MEM_BYTES);
+        microbench_record(microbench_ticks() - start);
+    }
+    return 0;
+}
+
+static int mb_memmove_run(struct microbench *mb, size_t dst, size_t src)
+{
+    int r = mb_memmove_check();
+    if (r != 0) {
+        return r;
+    }
+
+    for (int i = 0; i < MICROBENCH_ITERATIONS; i++) {
+        uint32_t start = microbench_ticks();
+        memmove(&mb_mem_buf[dst], &mb_mem_buf[src], MB_MEM_BYTES);
+        microbench_record(microbench_ticks() - start);
+    }
+    return 0;
+}
+
+static int mb_memmove(struct microbench *mb)
+{
+    return mb_memmove_run(mb, 0, MB_MEM_BYTES);
+}
+
+/// Overlapping, so copied backwards
+static int mb_memmove_overlap(struct microbench *mb)
+{
+    return mb_memmove_run(mb, 64, 0);
+}
+
+/// Source and destination differently aligned
+static int mb_memmove_unaligned(struct microbench *mb)
+{
+    return mb_memmove_run(mb, 0, MB_MEM_BYTES + 1);
+}
+
+static struct microbench kernel_benchmarks[] = {
+    { .name = "memset 4k", .run_func = mb_memset },
+    { .name = "memmove 4k", .run_func = mb_memmove },
+    { .name = "memmove 4k (overlapping)", .run_func = mb_memmove_overlap },
+    { .name = "memmove 4k (unaligned)", .run_func = mb_memmove_unaligned },
+};
+
 void microbenchmarks_run_all(void)
 {
     microbenchmarks_run(arch_benchmarks, arch_benchmarks_size);
+    microbenchmarks_run(kernel_benchmarks, ARRAY_LENGTH(kernel_benchmarks));
 
     printf("\n------------------------ Statistics ------------------------\n");
+    printf("microbench,name,samples,min,median,p99\n");
     microbenchmarks_print_all(arch_benchmarks, arch_benchmarks_size);
+    microbenchmarks_print_all(kernel_benchmarks, ARRAY_LENGTH(kernel_benchmarks));
     printf("------------------------------------------------------------\n\n");
 }
@@ -149,6 +149,7 @@ struct sysret sys_monitor_nullify_cap(capaddr_t cptr, uint8_t level)
 
     // zero-out cap entry
     assert(!mdb_reachable(cte));
+    caps_lookup_cache_clear_slot(cte);
     memset(cte, 0, sizeof(*cte));
 
     return SYSRET(SYS_ERR_OK);
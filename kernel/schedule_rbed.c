@@ -33,7 +33,8 @@
  *
  *  ->release_time is the time that the task is ready to be scheduled. RT tasks
  *  with ->release_time in the future are not effectively considered to be on
- *  the runqueue and are ignored by the scheduler.  In order to meet its
+ *  the runqueue: they wait in a release queue, ordered by ->release_time,
+ *  and are moved to the runqueue once released.  In order to meet its
  *  deadline the task needs to be scheduled no later than ->release_time +
  *  ->deadline. EDF guarantees this property, as long as the utilization rate
  *  is <= 1.
@@ -108,51 +109,150 @@ static inline unsigned long deadline(struct dcb *dcb)
     return dcb->release_time + dcb->deadline;
 }
 
-static void queue_insert(struct dcb *dcb)
+/*
+ * The run and release queues are pairing heaps, linked through the heap_*
+ * fields of the DCBs in them. A heap is a tree in which no DCB comes before
+ * its parent. Each DCB points to its first child and its next sibling, and
+ * back to its previous sibling, or to its parent if it is the first child.
+ * Insertion is O(1), and removal O(log n) amortized.
+ */
+
+typedef bool (*heap_before_fn)(struct dcb *a, struct dcb *b);
+
+/// Join two heaps, returning the new root
+static struct dcb *heap_meld(struct dcb *a, struct dcb *b,
+                             heap_before_fn before)
 {
-    // Empty queue case
-    if(kcb_current->queue_head == NULL) {
-        assert(kcb_current->queue_tail == NULL);
-        kcb_current->queue_head = kcb_current->queue_tail = queue_tail = dcb;
-        return;
+    if(a == NULL) {
+        return b;
+    }
+    if(b == NULL) {
+        return a;
+    }
+    if(before(b, a)) {
+        struct dcb *t = a;
+        a = b;
+        b = t;
     }
 
-    /* Insert into priority queue (this is doing EDF). We insert at
-     * the tail of a train of tasks with equal deadlines, as well as
-     * equal release times for best-effort tasks, so that trains of
-     * best-effort tasks with equal deadlines (and those released at
-     * the same time) get scheduled in a round-robin fashion. The
-     * release time equality check is important, as best-effort tasks
-     * have lazily allocated deadlines. In some circumstances (like
-     * when another task blocks), this might otherwise cause a wrong
-     * yielding behavior when old deadlines are encountered.
-     */
-    struct dcb *prev = NULL;
-    for(struct dcb *i = kcb_current->queue_head; i != NULL; prev = i, i = i->next) {
-        // Skip over equal, smaller release times if best-effort
-        if(dcb->type == TASK_TYPE_BEST_EFFORT &&
-           dcb->release_time >= i->release_time) {
-            continue;
-        }
+    b->heap_prev = a;
+    b->heap_next = a->heap_child;
+    if(a->heap_child != NULL) {
+        a->heap_child->heap_prev = b;
+    }
+    a->heap_child = b;
+    return a;
+}
 
-        // Skip over equal deadlines
-        if(deadline(dcb) >= deadline(i)) {
-            continue;
+/// Join a list of sibling heaps into one, pairwise from left to right, and
+/// the results from right to left
+static struct dcb *heap_merge_pairs(struct dcb *first, heap_before_fn before)
+{
+    struct dcb *pairs = NULL;
+    while(first != NULL) {
+        struct dcb *a = first, *b = first->heap_next;
+        first = b != NULL ? b->heap_next : NULL;
+
+        a->heap_next = a->heap_prev = NULL;
+        if(b != NULL) {
+            b->heap_next = b->heap_prev = NULL;
         }
+        // heap_next of a root is free to chain the melded pairs
+        struct dcb *m = heap_meld(a, b, before);
+        m->heap_next = pairs;
+        pairs = m;
+    }
+
+    struct dcb *root = NULL;
+    while(pairs != NULL) {
+        struct dcb *m = pairs;
+        pairs = m->heap_next;
+        m->heap_next = NULL;
+        root = heap_meld(root, m, before);
+    }
+    return root;
+}
 
-        dcb->next = i;
-        if(prev == NULL) {      // Insert before head
-            kcb_current->queue_head = dcb;
-        } else {                // Insert inside queue
-            prev->next = dcb;
+static void heap_insert(struct dcb **root, struct dcb *dcb,
+                        heap_before_fn before)
+{
+    dcb->heap_child = dcb->heap_next = dcb->heap_prev = NULL;
+    *root = heap_meld(*root, dcb, before);
+}
+
+static void heap_remove(struct dcb **root, struct dcb *dcb,
+                        heap_before_fn before)
+{
+    struct dcb *children = heap_merge_pairs(dcb->heap_child, before);
+    if(dcb == *root) {
+        *root = children;
+    } else {
+        if(dcb->heap_prev->heap_child == dcb) {
+            dcb->heap_prev->heap_child = dcb->heap_next;
+        } else {
+            dcb->heap_prev->heap_next = dcb->heap_next;
         }
+        if(dcb->heap_next != NULL) {
+            dcb->heap_next->heap_prev = dcb->heap_prev;
+        }
+        *root = heap_meld(*root, children, before);
+    }
+    dcb->heap_child = dcb->heap_next = dcb->heap_prev = NULL;
+}
 
-        return;
+/* Order of the run queue (this is doing EDF). Tasks with equal deadlines,
+ * as well as equal release times, run in the order they were queued, so that
+ * trains of best-effort tasks with equal deadlines (and those released at
+ * the same time) get scheduled in a round-robin fashion. The release time
+ * comes before queueing order, as best-effort tasks have lazily allocated
+ * deadlines. In some circumstances (like when another task blocks), this
+ * might otherwise cause a wrong yielding behavior when old deadlines are
+ * encountered.
+ */
+static bool run_before(struct dcb *a, struct dcb *b)
+{
+    if(deadline(a) != deadline(b)) {
+        return deadline(a) < deadline(b);
     }
+    if(a->release_time != b->release_time) {
+        return a->release_time < b->release_time;
+    }
+    return (long)(a->queue_seq - b->queue_seq) < 0;
+}
 
-    // Insert after queue tail
-    kcb_current->queue_tail->next = dcb;
+/// Order of the release queue
+static bool release_before(struct dcb *a, struct dcb *b)
+{
+    if(a->release_time != b->release_time) {
+        return a->release_time < b->release_time;
+    }
+    return (long)(a->queue_seq - b->queue_seq) < 0;
+}
+
+/**
+ * \brief Insert 'dcb' into the run queue if it is released, or into the
+ * release queue otherwise.
+ */
+static void queue_insert(struct dcb *dcb)
+{
+    // Append to the list of all queued tasks
+    dcb->next = NULL;
+    dcb->prev = kcb_current->queue_tail;
+    if(kcb_current->queue_tail == NULL) {
+        assert(kcb_current->queue_head == NULL);
+        kcb_current->queue_head = dcb;
+    } else {
+        kcb_current->queue_tail->next = dcb;
+    }
     kcb_current->queue_tail = queue_tail = dcb;
+
+    dcb->queue_seq = kcb_current->queue_seq++;
+    dcb->released = dcb->release_time <= kernel_now;
+    if(dcb->released) {
+        heap_insert(&kcb_current->run_queue, dcb, run_before);
+    } else {
+        heap_insert(&kcb_current->release_queue, dcb, release_before);
+    }
 }
 
 /**
@@ -171,27 +271,37 @@ static void queue_remove(struct dcb *dcb)
         return;
     }
 
-    if(dcb == kcb_current->queue_head) {
-        kcb_current->queue_head = dcb->next;
-        if(kcb_current->queue_head == NULL) {
-            kcb_current->queue_tail = queue_tail =  NULL;
-        }
-
-        goto out;
+    if(dcb->released) {
+        heap_remove(&kcb_current->run_queue, dcb, run_before);
+    } else {
+        heap_remove(&kcb_current->release_queue, dcb, release_before);
     }
 
-    for(struct dcb *i = kcb_current->queue_head; i != NULL; i = i->next) {
-        if(i->next == dcb) {
-            i->next = i->next->next;
-            if(kcb_current->queue_tail == dcb) {
-                kcb_current->queue_tail = queue_tail = i;
-            }
-            break;
-        }
+    if(dcb->prev != NULL) {
+        dcb->prev->next = dcb->next;
+    } else {
+        kcb_current->queue_head = dcb->next;
     }
+    if(dcb->next != NULL) {
+        dcb->next->prev = dcb->prev;
+    } else {
+        kcb_current->queue_tail = queue_tail = dcb->prev;
+    }
+    dcb->next = dcb->prev = NULL;
+}
 
- out:
-    dcb->next = NULL;
+/**
+ * \brief Move tasks whose release time has come to the run queue.
+ */
+static void queue_release(void)
+{
+    struct dcb *dcb;
+    while((dcb = kcb_current->release_queue) != NULL &&
+          dcb->release_time <= kernel_now) {
+        heap_remove(&kcb_current->release_queue, dcb, release_before);
+        dcb->released = true;
+        heap_insert(&kcb_current->run_queue, dcb, run_before);
+    }
 }
 
 #if 0
@@ -275,6 +385,31 @@ static void adjust_weights(void)
 }
 #endif
 
+#ifdef CONFIG_ONESHOT_TIMER
+/**
+ * \brief Time of the next event the scheduler has to look at while 'todisp'
+ * runs.
+ *
+ * That is when 'todisp' runs out of budget, or when the next task is
+ * released and might preempt it. A best-effort task with nothing else to run
+ * only gets a fresh budget when it runs out, which can wait until then.
+ */
+static systime_t next_sched_event(struct dcb *todisp)
+{
+    systime_t next = TIMER_INF;
+    if(kcb_current->release_queue != NULL) {
+        next = kcb_current->release_queue->release_time;
+    }
+
+    bool alone = todisp == kcb_current->run_queue && todisp->heap_child == NULL;
+    if(!alone || todisp->type != TASK_TYPE_BEST_EFFORT) {
+        assert(todisp->etime <= todisp->wcet);
+        next = MIN(next, todisp->last_dispatch + (todisp->wcet - todisp->etime));
+    }
+    return next;
+}
+#endif
+
 static void set_best_effort_wcet(struct dcb *dcb)
 {
     unsigned int u_actual = do_resource_allocation(dcb);
@@ -312,31 +447,10 @@ struct dcb *schedule(void)
     }
 
  start_over:
-    todisp = kcb_current->queue_head;
-
-#ifndef SCHEDULER_SIMULATOR
-#define PRINT_NAME(d) \
-    do { \
-        if (!(d) || !(d)->disp) { \
-            debug(SUBSYS_DISPATCH, "todisp == NULL\n"); \
-            break; \
-        } \
-        struct dispatcher_shared_generic *dst = \
-            get_dispatcher_shared_generic(d->disp); \
-        debug(SUBSYS_DISPATCH, "looking at '%s', release_time=%lu, kernel_now=%zu\n", \
-                dst->name, d->release_time, kernel_now); \
-    }while(0)
-#else
-#define PRINT_NAME(d) do{}while(0)
-#endif
-
-    // Skip over all tasks released in the future, they're technically not
-    // in the schedule yet. We just have them to reduce book-keeping.
-    while(todisp != NULL && todisp->release_time > kernel_now) {
-        PRINT_NAME(todisp);
-        todisp = todisp->next;
-    }
-#undef PRINT_NAME
+    // Tasks released in the future aren't in the schedule yet, they wait in
+    // the release queue until then.
+    queue_release();
+    todisp = kcb_current->run_queue;
 
     // nothing to dispatch
     if(todisp == NULL) {
@@ -344,11 +458,19 @@ struct dcb *schedule(void)
         debug(SUBSYS_DISPATCH, "schedule: no dcb runnable\n");
 #endif
         lastdisp = NULL;
+        #ifdef CONFIG_ONESHOT_TIMER
+        // sleep until the next release; wakeups have a timer of their own
+        update_sched_timer(kcb_current->release_queue != NULL ?
+                           kcb_current->release_queue->release_time :
+                           TIMER_INF);
+        #endif
         return NULL;
     }
 
     // Lazy resource allocation for best-effort processes
     if(todisp->type == TASK_TYPE_BEST_EFFORT) {
+        // This changes our deadline, so take us out of the heap meanwhile
+        heap_remove(&kcb_current->run_queue, todisp, run_before);
         set_best_effort_wcet(todisp);
 
         /* We might've shortened the deadline into the past (eg. when
@@ -358,6 +480,7 @@ struct dcb *schedule(void)
         if(deadline(todisp) < kernel_now) {
             todisp->release_time = kernel_now;
         }
+        heap_insert(&kcb_current->run_queue, todisp, run_before);
     }
 
     // Assert we never miss a hard deadline
@@ -373,6 +496,9 @@ struct dcb *schedule(void)
     // Dispatch first guy in schedule if not over budget
     if(todisp->etime < todisp->wcet) {
         todisp->last_dispatch = kernel_now;
+        #ifdef CONFIG_ONESHOT_TIMER
+        update_sched_timer(next_sched_event(todisp));
+        #endif
 
         // If nothing changed, run whatever ran last (task might have
         // yielded to another), unless it is blocked
@@ -382,11 +508,6 @@ struct dcb *schedule(void)
 
         // Remember who we run next
         lastdisp = todisp;
-        #ifdef CONFIG_ONESHOT_TIMER
-        // we might be able to do better than that...
-        // (e.g., check if there is only one task in the queue)
-        update_sched_timer(kernel_now + (todisp->wcet - todisp->etime));
-        #endif
         return todisp;
     }
 
@@ -472,6 +593,13 @@ void make_runnable(struct dcb *dcb)
     /* assert(dcb->release_time >= kernel_now); */
     dcb->etime = 0;
     queue_insert(dcb);
+
+    #ifdef CONFIG_ONESHOT_TIMER
+    // whatever is running may have had no timer set, as it was alone
+    if(lastdisp != NULL) {
+        update_sched_timer(next_sched_event(lastdisp));
+    }
+    #endif
 }
 
 /**
@@ -548,15 +676,22 @@ void scheduler_yield(struct dcb *dcb)
 void scheduler_reset_time(void)
 {
     kernel_now = 0;
+    #ifdef CONFIG_ONESHOT_TIMER
+    timer_reset();
+    #endif
 
     // XXX: Currently, we just re-release everything now
     struct kcb *k = kcb_current;
     do {
         printk(LOG_NOTE, "clearing kcb %p\n", k);
+        // everything is released now, and in queueing order
+        k->run_queue = k->release_queue = NULL;
         for(struct dcb *i = k->queue_head; i != NULL; i = i->next) {
             i->release_time = 0;
             i->etime = 0;
             i->last_dispatch = 0;
+            i->released = true;
+            heap_insert(&k->run_queue, i, run_before);
         }
         k = k->next;
     }while(k && k!=kcb_current);
@@ -581,6 +716,8 @@ void scheduler_convert(void)
             printf("kcb_current->ring_current: %p\n", kcb_current->ring_current);
             printf("kcb_current->ring_current->prev: %p\n", kcb_current->ring_current->prev);
             struct dcb *i = kcb_current->ring_current;
+            kcb_current->queue_head = kcb_current->queue_tail = queue_tail = NULL;
+            kcb_current->run_queue = kcb_current->release_queue = NULL;
             do {
                 printf("converting %p\n", i);
                 i->type = TASK_TYPE_BEST_EFFORT;
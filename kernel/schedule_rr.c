@@ -27,6 +27,9 @@ struct dcb *schedule(void)
 {
     // empty ring
     if(kcb_current->ring_current == NULL) {
+        #ifdef CONFIG_ONESHOT_TIMER
+        update_sched_timer(TIMER_INF);
+        #endif
         return NULL;
     }
 
@@ -35,7 +38,9 @@ struct dcb *schedule(void)
 
     kcb_current->ring_current = kcb_current->ring_current->next;
     #ifdef CONFIG_ONESHOT_TIMER
-    update_sched_timer(kernel_now + kernel_timeslice);
+    // nothing to switch to, so no need for a timeslice
+    bool alone = kcb_current->ring_current->next == kcb_current->ring_current;
+    update_sched_timer(alone ? TIMER_INF : kernel_now + kernel_timeslice);
     #endif
     return ring_current;
 }
@@ -57,6 +62,11 @@ void make_runnable(struct dcb *dcb)
         dcb->next = kcb_current->ring_current->next;
         kcb_current->ring_current->next->prev = dcb;
         kcb_current->ring_current->next = dcb;
+
+        #ifdef CONFIG_ONESHOT_TIMER
+        // whatever is running may have had no timeslice, as it was alone
+        update_sched_timer(kernel_now + kernel_timeslice);
+        #endif
     }
 }
 
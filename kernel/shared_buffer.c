@@ -0,0 +1,177 @@
+/**
+ * \file
+ * \brief Buffers the kernel fills in frames of user domains.
+ *
+ * Used by the profiler and the event tracer. The kernel keeps a copy of the
+ * buffer's frame capability, so that the memory can't be reused while it
+ * still writes to it. A revoke deletes that copy as well, so the kernel
+ * stops using a buffer when its copy is cleaned up.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <kernel.h>
+#include <string.h>
+#include <capabilities.h>
+#include <cap_predicates.h>
+#include <dispatch.h>
+#include <shared_buffer.h>
+
+/// Buffers in use
+static struct shared_buffer *shared_buffers;
+
+/// Take 'sb' out of use, and tell its owner
+static void shared_buffer_unlink(struct shared_buffer *sb)
+{
+    for (struct shared_buffer **p = &shared_buffers; *p != NULL;
+         p = &(*p)->next) {
+        if (*p == sb) {
+            *p = sb->next;
+            sb->next = NULL;
+            break;
+        }
+    }
+    sb->base = NULL;
+    if (sb->stopped != NULL) {
+        sb->stopped();
+    }
+}
+
+/**
+ * \brief Stop using the buffer, and drop our copy of its frame capability.
+ */
+void shared_buffer_stop(struct shared_buffer *sb)
+{
+    shared_buffer_unlink(sb);
+    if (sb->frame.cap.type != ObjType_Null) {
+        errval_t err = caps_delete(&sb->frame);
+        if (err_is_fail(err)) {
+            printk(LOG_WARN, "dropping shared buffer failed: %"PRIuERRV"\n",
+                   err);
+        }
+        memset(&sb->frame, 0, sizeof(sb->frame));
+    }
+}
+
+/**
+ * \brief Use a frame of the calling dispatcher of at least 'minbytes' as the
+ * buffer, in place of the one of an earlier call.
+ *
+ * A cptr of 0 just stops using the old one.
+ */
+errval_t shared_buffer_setup(struct shared_buffer *sb, capaddr_t frame,
+                             uint8_t level, size_t minbytes)
+{
+    errval_t err;
+
+    shared_buffer_stop(sb);
+    if (frame == 0) {
+        return SYS_ERR_OK;
+    }
+
+    struct cte *cte;
+    err = caps_lookup_slot(&dcb_current->cspace.cap, frame, level, &cte,
+                           CAPRIGHTS_READ_WRITE);
+    if (err_is_fail(err)) {
+        return err_push(err, SYS_ERR_SHARED_BUFFER_FRAME);
+    }
+    if (cte->cap.type != ObjType_Frame) {
+        return SYS_ERR_SHARED_BUFFER_FRAME_INVALID;
+    }
+
+    lpaddr_t base = gen_phys_to_local_phys(get_address(&cte->cap));
+    size_t bytes = get_size(&cte->cap);
+    if (bytes < minbytes || !local_phys_is_valid(base + bytes - 1)) {
+        return SYS_ERR_SHARED_BUFFER_FRAME_SIZE;
+    }
+
+    err = caps_copy_to_cte(&sb->frame, cte, false, 0, 0);
+    if (err_is_fail(err)) {
+        return err;
+    }
+
+    sb->base = (void *)local_phys_to_mem(base);
+    sb->bytes = bytes;
+    sb->dispatchers = NULL;
+    sb->ndispatchers = NULL;
+    sb->maxdispatchers = 0;
+    sb->next = shared_buffers;
+    shared_buffers = sb;
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief Called as 'cte' is cleaned up, to stop using the buffer whose frame
+ * capability it holds, if any.
+ *
+ * Our copy is only ever deleted by us or by a revoke, and after a revoke the
+ * frame's memory can be handed out again.
+ */
+void shared_buffer_cte_cleanup(struct cte *cte)
+{
+    for (struct shared_buffer *sb = shared_buffers; sb != NULL;
+         sb = sb->next) {
+        if (&sb->frame == cte) {
+            printk(LOG_NOTE, "shared buffer frame revoked, stopping\n");
+            shared_buffer_unlink(sb);
+            return;
+        }
+    }
+}
+
+/**
+ * \brief Set where in the buffer its table of 'max' dispatchers is, and
+ * start with an empty one.
+ */
+void shared_buffer_set_dispatchers(struct shared_buffer *sb,
+                                   struct shared_buffer_dispatcher *table,
+                                   volatile uint32_t *ndispatchers,
+                                   uint32_t max)
+{
+    assert(max <= SHARED_BUFFER_MAX_DISPATCHERS);
+    sb->dispatchers = table;
+    sb->ndispatchers = ndispatchers;
+    sb->maxdispatchers = max;
+    sb->count = 0;
+    memset(sb->dcbs, 0, sizeof(sb->dcbs));
+    *ndispatchers = 0;
+}
+
+/**
+ * \brief Index of 'dcb' in the buffer's dispatcher table, adding it if it's
+ * new.
+ *
+ * \return The index, or -1 if the table is full
+ */
+int shared_buffer_disp_index(struct shared_buffer *sb, struct dcb *dcb)
+{
+    // a DCB can be freed and reused for another dispatcher, which won't
+    // have the same name
+    const char *name = get_disp_name(dcb);
+    for (uint32_t i = 0; i < sb->count; i++) {
+        if (sb->dcbs[i] == dcb &&
+            strncmp(sb->names[i], name, DISP_NAME_LEN) == 0) {
+            return i;
+        }
+    }
+    uint32_t n = sb->count;
+    if (n >= sb->maxdispatchers) {
+        return -1;
+    }
+
+    sb->dcbs[n] = dcb;
+    strncpy(sb->names[n], name, DISP_NAME_LEN);
+    sb->dispatchers[n].dcb = (uint32_t)(uintptr_t)dcb;
+    memcpy(sb->dispatchers[n].name, sb->names[n], DISP_NAME_LEN);
+    sb->count = n + 1;
+    // the entry must be complete before the count says it's there
+    __atomic_store_n(sb->ndispatchers, sb->count, __ATOMIC_RELEASE);
+    return n;
+}
@@ -111,6 +111,8 @@ sys_dispatcher_setup(struct capability *to, capaddr_t cptr, uint8_t level,
         return SYSRET(SYS_ERR_DISP_VSPACE_INVALID);
     }
     dcb->vspace = gen_phys_to_local_phys(get_address(vroot));
+    // a new vspace needs a new ASID, see paging_asid_get()
+    dcb->asid = 0;
 
     /* 3. set dispatcher frame pointer */
     struct cte *dispcte;
@@ -629,6 +631,8 @@ struct sysret sys_yield(capaddr_t target)
         /* FIXME: check rights? */
     }
 
+    dcb_current->stats.yields++;
+
     // Since we've done a yield, we explicitly ensure that the
     // dispatcher is upcalled the next time (on the understanding that
     // this is what the dispatcher wants), otherwise why call yield?
@@ -6,6 +6,10 @@
  * wakeup infrastructure. Each of these subsystems is responsible for updating
  * their timer value. When an update happens, we update the hardware timer if
  * the previous (global) timer has changed.
+ *
+ * With the one-shot timer, the kernel is tickless: kernel_now follows the
+ * platform's timestamp counter, and the hardware timer only goes off for the
+ * next wakeup or scheduling event, if there is one.
  */
 
 /*
@@ -19,12 +23,16 @@
 
 #include <timer.h>
 #include <kernel.h>
+#include <platform.h> // timestamp_read()
 
 /* these are systime_t i.e., absolute time values in ms */
 static systime_t next_sched_timer = TIMER_INF;   //< timer for scheduler
 static systime_t next_wakeup_timer = TIMER_INF;  //< timer for wakeups
 static systime_t last_timer;                     //< last set timer
 
+static uint64_t ts_base;    //< timestamp at which kernel_now was 0
+static uint32_t ts_per_ms;  //< timestamp ticks per ms
+
 #define MIN(x,y) ((x<y) ? (x) : (y))
 
 static void update_timer(void)
@@ -62,3 +70,42 @@ void update_sched_timer(systime_t t)
     update_timer();
 }
 
+
+/**
+ * \brief Make kernel_now follow the timestamp counter from its current value
+ *
+ * Called once the platform timers are up, and whenever kernel_now is reset.
+ */
+void timer_reset(void)
+{
+    ts_per_ms = timestamp_freq() / 1000;
+    assert(ts_per_ms != 0);
+    ts_base = timestamp_read() - (uint64_t)kernel_now * ts_per_ms;
+}
+
+/**
+ * \brief Current time in ms, for kernel_now
+ */
+systime_t timer_now(void)
+{
+    return (timestamp_read() - ts_base) / ts_per_ms;
+}
+
+/**
+ * \brief Convert an absolute time in ms to a timestamp counter value
+ */
+uint64_t timer_to_timestamp(systime_t t)
+{
+    return ts_base + t * ts_per_ms;
+}
+
+/**
+ * \brief Note that the hardware timer went off, and is no longer armed
+ *
+ * Called by the platform's timer interrupt handler, so that the next update
+ * programs the hardware again, even if it is for the same time.
+ */
+void timer_expired(void)
+{
+    last_timer = TIMER_INF;
+}
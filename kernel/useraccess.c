@@ -14,16 +14,31 @@
 
 #include <kernel.h>
 #include <useraccess.h>
+#include <paging_kernel_arch.h>
+#include <barrelfish_kpi/paging_arch.h>
 
 /**
  * Check the validity of the user space buffer.
  *
+ * The buffer must lie below the kernel window, and every page of it must be
+ * mapped in the current vspace with the user rights the access needs.
+ *
  * \param type   Type of access to check: ACCESS_WRITE or ACCESS_READ.
  * \param buffer Pointer to beginning of buffer.
  * \param size   Size of buffer.
  */
 bool access_ok(uint8_t type, lvaddr_t buffer, size_t size)
 {
-    // FIXME: Implement!
+    lvaddr_t end = buffer + size;
+    if (end < buffer || end > KERNEL_OFFSET) {
+        return false;
+    }
+
+    for (lvaddr_t page = buffer & ~(lvaddr_t)(BASE_PAGE_SIZE - 1);
+         page < end; page += BASE_PAGE_SIZE) {
+        if (!paging_user_page_accessible(page, type == ACCESS_WRITE)) {
+            return false;
+        }
+    }
     return true;
 }
@@ -1,6 +1,20 @@
 /**
  * \file
  * \brief DCB wakeup queue management
+ *
+ * Sleeping DCBs are kept in a hierarchical timing wheel. Level L has
+ * WAKEUP_WHEEL_SLOTS slots of 2^(L * WAKEUP_WHEEL_BITS) ms each. A DCB goes
+ * into the slot for its wakeup time on the lowest level where that slot is
+ * less than a full turn ahead of the time the wheel was last advanced to, so
+ * arming and cancelling a wakeup are O(1). When the wheel is advanced past a
+ * slot, its DCBs are either woken up, or, if their time in the slot hasn't
+ * come yet, moved down to a finer level. The few wakeups more than a turn of
+ * the top level ahead are kept on a separate list, which is sorted out again
+ * each time the top level moves on.
+ *
+ * The earliest wakeup time is kept up to date for update_wakeup_timer().
+ * Within a level, slots from the current one onwards are in time order, so
+ * finding it only means looking into the first occupied slot of each level.
  */
 
 /*
@@ -14,41 +28,156 @@
 
 #include <kernel.h>
 #include <dispatch.h>
-#include <kcb.h> // kcb_current->wakeup_queue_head
+#include <kcb.h> // kcb_current->wakeup_wheel
+#include <ktrace.h>
 #include <timer.h> // update_wakeup_timer()
 #include <wakeup.h>
 
-/* wrapper to change the head, and update the next wakeup tick */
-void wakeup_set_queue_head(struct dcb *h)
+#define SLOT_MASK       (WAKEUP_WHEEL_SLOTS - 1)
+/// wakeup_slot of DCBs on the wakeup_far list
+#define SLOT_FAR        (WAKEUP_WHEEL_LEVELS * WAKEUP_WHEEL_SLOTS)
+
+static inline unsigned level_shift(unsigned level)
 {
-    kcb_current->wakeup_queue_head = h;
+    return level * WAKEUP_WHEEL_BITS;
+}
+
+/* tell the timer about a new earliest wakeup */
+static void set_wakeup_min(systime_t t)
+{
+    kcb_current->wakeup_min = t;
     #ifdef CONFIG_ONESHOT_TIMER
-    // we changed the first dcb in the wakeup queue, which means
-    // that we need to update the next tick value
-    systime_t next_wakeup = h ? h->wakeup_time : TIMER_INF;
-    update_wakeup_timer(next_wakeup);
+    update_wakeup_timer(kcb_current->wakeup_count > 0 ? t : TIMER_INF);
     #endif
 }
-static inline void set_queue_head(struct dcb *h)
+
+static void slot_insert(struct dcb *dcb)
+{
+    struct kcb *k = kcb_current;
+    systime_t t = MAX(dcb->wakeup_time, k->wakeup_now);
+
+    // take the lowest level on which the slot for t is less than a full
+    // turn ahead of the current one, so slots stay in time order from it
+    unsigned level = 0;
+    while (level < WAKEUP_WHEEL_LEVELS - 1 &&
+           (t >> level_shift(level)) - (k->wakeup_now >> level_shift(level))
+               >= WAKEUP_WHEEL_SLOTS) {
+        level++;
+    }
+    systime_t ahead = (t >> level_shift(level)) -
+                      (k->wakeup_now >> level_shift(level));
+
+    struct dcb **head;
+    if (ahead >= WAKEUP_WHEEL_SLOTS) {
+        // beyond the top level; these are looked at again whenever it turns
+        head = &k->wakeup_far;
+        dcb->wakeup_slot = SLOT_FAR;
+    } else {
+        unsigned slot = (t >> level_shift(level)) & SLOT_MASK;
+        head = &k->wakeup_wheel[level][slot];
+        dcb->wakeup_slot = level * WAKEUP_WHEEL_SLOTS + slot;
+        k->wakeup_occupied[level] |= (uint64_t)1 << slot;
+    }
+
+    dcb->wakeup_prev = NULL;
+    dcb->wakeup_next = *head;
+    if (*head != NULL) {
+        (*head)->wakeup_prev = dcb;
+    }
+    *head = dcb;
+}
+
+static void slot_remove(struct dcb *dcb)
+{
+    struct kcb *k = kcb_current;
+    unsigned level = dcb->wakeup_slot / WAKEUP_WHEEL_SLOTS;
+    unsigned slot = dcb->wakeup_slot % WAKEUP_WHEEL_SLOTS;
+    bool far = dcb->wakeup_slot == SLOT_FAR;
+
+    if (dcb->wakeup_prev == NULL) {
+        struct dcb **head = far ? &k->wakeup_far : &k->wakeup_wheel[level][slot];
+        assert(*head == dcb);
+        *head = dcb->wakeup_next;
+        if (!far && dcb->wakeup_next == NULL) {
+            k->wakeup_occupied[level] &= ~((uint64_t)1 << slot);
+        }
+    } else {
+        assert(dcb->wakeup_prev->wakeup_next == dcb);
+        dcb->wakeup_prev->wakeup_next = dcb->wakeup_next;
+    }
+    if (dcb->wakeup_next != NULL) {
+        assert(dcb->wakeup_next->wakeup_prev == dcb);
+        dcb->wakeup_next->wakeup_prev = dcb->wakeup_prev;
+    }
+    dcb->wakeup_prev = dcb->wakeup_next = NULL;
+}
+
+/// Append a list of DCBs to another, returning the result
+static struct dcb *list_join(struct dcb *list, struct dcb *more)
 {
-    wakeup_set_queue_head(h);
+    if (list == NULL) {
+        return more;
+    }
+    struct dcb *tail = list;
+    while (tail->wakeup_next != NULL) {
+        tail = tail->wakeup_next;
+    }
+    tail->wakeup_next = more;
+    return list;
+}
+
+/// Detach and return the list in a slot
+static struct dcb *slot_take(unsigned level, unsigned slot)
+{
+    struct kcb *k = kcb_current;
+    struct dcb *list = k->wakeup_wheel[level][slot];
+    k->wakeup_wheel[level][slot] = NULL;
+    k->wakeup_occupied[level] &= ~((uint64_t)1 << slot);
+    return list;
+}
+
+/// Find the earliest wakeup time in the wheel
+static systime_t find_wakeup_min(void)
+{
+    struct kcb *k = kcb_current;
+    systime_t min = TIMER_INF;
+
+    for (struct dcb *d = k->wakeup_far; d != NULL; d = d->wakeup_next) {
+        if (d->wakeup_time < min) {
+            min = d->wakeup_time;
+        }
+    }
+
+    for (unsigned level = 0; level < WAKEUP_WHEEL_LEVELS; level++) {
+        uint64_t occupied = k->wakeup_occupied[level];
+        if (occupied == 0) {
+            continue;
+        }
+        // rotate the current slot to bit 0, and take the first one set
+        unsigned cur = (k->wakeup_now >> level_shift(level)) & SLOT_MASK;
+        uint64_t rotated = cur == 0 ? occupied :
+            (occupied >> cur) | (occupied << (WAKEUP_WHEEL_SLOTS - cur));
+        unsigned slot = (cur + __builtin_ctzll(rotated)) & SLOT_MASK;
+
+        for (struct dcb *d = k->wakeup_wheel[level][slot]; d != NULL;
+             d = d->wakeup_next) {
+            if (d->wakeup_time < min) {
+                min = d->wakeup_time;
+            }
+        }
+    }
+    return min;
 }
 
 void wakeup_remove(struct dcb *dcb)
 {
     if (dcb->wakeup_time != 0) {
-        if (dcb->wakeup_prev == NULL) {
-            assert(kcb_current->wakeup_queue_head == dcb);
-            set_queue_head(dcb->wakeup_next);
-        } else {
-            assert(dcb->wakeup_prev->wakeup_next == dcb);
-            dcb->wakeup_prev->wakeup_next = dcb->wakeup_next;
+        slot_remove(dcb);
+        kcb_current->wakeup_count--;
+        if (dcb->wakeup_time == kcb_current->wakeup_min) {
+            set_wakeup_min(find_wakeup_min());
         }
-        if (dcb->wakeup_next != NULL) {
-            assert(dcb->wakeup_next->wakeup_prev == dcb);
-            dcb->wakeup_next->wakeup_prev = dcb->wakeup_prev;
-        }
-        dcb->wakeup_prev = dcb->wakeup_next = NULL;
+        dcb->wakeup_time = 0;
     }
 
     // No-Op if not in queue...
@@ -64,47 +193,90 @@ void wakeup_set(struct dcb *dcb, systime_t waketime)
     wakeup_remove(dcb);
 
     dcb->wakeup_time = waketime;
-
-    for (struct dcb *d = kcb_current->wakeup_queue_head, *p = NULL; ; p = d, d = d->wakeup_next) {
-        if (d == NULL || d->wakeup_time > waketime) {
-            if (p == NULL) { // insert at head
-                assert(d == kcb_current->wakeup_queue_head);
-                dcb->wakeup_prev = NULL;
-                dcb->wakeup_next = d;
-                if (d != NULL) {
-                    d->wakeup_prev = dcb;
-                }
-                set_queue_head(dcb);
-            } else {
-                dcb->wakeup_next = d;
-                dcb->wakeup_prev = p;
-                p->wakeup_next = dcb;
-                if (d != NULL) {
-                    d->wakeup_prev = dcb;
-                }
-            }
-            break;
-        }
+    slot_insert(dcb);
+    if (kcb_current->wakeup_count++ == 0 ||
+        waketime < kcb_current->wakeup_min) {
+        set_wakeup_min(waketime);
     }
 }
 
 /// Check for wakeups, given the current time
 void wakeup_check(systime_t now)
 {
-    struct dcb *d = kcb_current->wakeup_queue_head, *next = NULL;
-    for (; d != NULL && d->wakeup_time <= now; d = next) {
-        next = d->wakeup_next;
-        d->wakeup_time = 0;
-        d->wakeup_prev = d->wakeup_next = NULL;
-        make_runnable(d);
+    struct kcb *k = kcb_current;
+
+    if (k->wakeup_count == 0) {
+        k->wakeup_now = now;
+        return;
+    }
+    if (now < k->wakeup_min) {
+        return;
+    }
+
+    // the slots to visit on each level are those from the one we got to
+    // last time, up to the one for now. If kernel_now was reset, visit all
+    // of them, and place everything again from now.
+    systime_t last = k->wakeup_now;
+    k->wakeup_now = now;
+    struct dcb *due = NULL;
+    for (unsigned level = 0; level < WAKEUP_WHEEL_LEVELS; level++) {
+        systime_t from = last >> level_shift(level);
+        systime_t to = now >> level_shift(level);
+        if (now < last || to - from >= WAKEUP_WHEEL_SLOTS - 1) {
+            from = 0;
+            to = WAKEUP_WHEEL_SLOTS - 1;
+        }
+        for (systime_t i = from; i <= to; i++) {
+            unsigned slot = i & SLOT_MASK;
+            if (!(k->wakeup_occupied[level] & ((uint64_t)1 << slot))) {
+                continue;
+            }
+            // chain what we take on wakeup_next until it's all re-placed
+            due = list_join(slot_take(level, slot), due);
+        }
     }
-    if (d != NULL) {
-        d->wakeup_prev = NULL;
+    unsigned top = level_shift(WAKEUP_WHEEL_LEVELS - 1);
+    if (now < last || (now >> top) != (last >> top)) {
+        due = list_join(k->wakeup_far, due);
+        k->wakeup_far = NULL;
     }
-    set_queue_head(d);
+
+    // wake up what's due, and move the rest down the wheel
+    for (struct dcb *d = due, *next; d != NULL; d = next) {
+        next = d->wakeup_next;
+        if (d->wakeup_time <= now) {
+            d->wakeup_time = 0;
+            d->wakeup_prev = d->wakeup_next = NULL;
+            k->wakeup_count--;
+            ktrace(KTRACE_SUBSYS_WAKEUP, KTraceWakeup, d, NULL, 0);
+            make_runnable(d);
+        } else {
+            slot_insert(d);
+        }
+    }
+
+    set_wakeup_min(find_wakeup_min());
 }
 
 bool wakeup_is_pending(void)
 {
-    return kcb_current->wakeup_queue_head != NULL;
+    return kcb_current->wakeup_count != 0;
+}
+
+/**
+ * \brief Call 'func' on each DCB waiting for a wakeup in 'kcb'
+ */
+void wakeup_for_each(struct kcb *kcb, void (*func)(struct dcb *))
+{
+    for (unsigned level = 0; level < WAKEUP_WHEEL_LEVELS; level++) {
+        for (unsigned slot = 0; slot < WAKEUP_WHEEL_SLOTS; slot++) {
+            for (struct dcb *d = kcb->wakeup_wheel[level][slot]; d != NULL;
+                 d = d->wakeup_next) {
+                func(d);
+            }
+        }
+    }
+    for (struct dcb *d = kcb->wakeup_far; d != NULL; d = d->wakeup_next) {
+        func(d);
+    }
 }
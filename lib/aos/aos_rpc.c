@@ -15,512 +15,427 @@
 #include <aos/aos_rpc.h>
 #include <string.h>
 
-// defined at the end
-uint32_t perf_measurement_get_counter(void);
+static void aos_rpc_send_handler(void* arg);
+static void aos_rpc_recv_handler(void* arg);
+static void aos_rpc_sync_cont(struct aos_rpc *rpc,
+        struct aos_rpc_response *resp, void *arg);
 
 /**
- * \brief Number handler.
+ * \brief Retire a tag and run its completion callback.
  */
-errval_t aos_rpc_send_number_send_handler(void* void_args)
+static void aos_rpc_complete(struct aos_rpc* rpc, uint8_t tag)
 {
-    // 0. get cycle counter value
-    uint32_t cycle_counter_begin = perf_measurement_get_counter();
-
-    uintptr_t* args = (uintptr_t*) void_args;
-
-    // TODO: implement functionality to send a number ofer the channel
-    // given channel and wait until the ack gets returned.
-    struct aos_rpc *rpc = (struct aos_rpc*) args[0];
-    uintptr_t *number = (uintptr_t*) args[1];
-    CHECK("aos_rpc.c#aos_rpc_send_number_handler: lmp_chan_send3",
-            lmp_chan_send3(&rpc->lc, LMP_FLAG_SYNC, NULL_CAP,
-                    AOS_RPC_NUMBER, 0, *number));
-
-    // N. get new cycle counter value, show result
-    uint32_t cycle_counter_end = perf_measurement_get_counter();
-    if (cycle_counter_end > cycle_counter_begin) {  // otherwise it overflowed and doesn't make much sense
-        debug_printf(" *** performance measurement: aos_rpc_send_number_send: %u cycles\n", cycle_counter_end - cycle_counter_begin);
+    struct aos_rpc_pending* p = &rpc->pending[tag];
+    assert(p->busy);
+
+    // Free the tag before the callback, so it can submit again.
+    p->busy = false;
+    --rpc->in_flight;
+    if (p->cont != NULL) {
+        p->cont(rpc, &p->resp, p->arg);
     }
-
-    return SYS_ERR_OK;
 }
 
 /**
- * \brief Number response.
+ * \brief Make sure we get notified of incoming responses.
  */
-errval_t aos_rpc_send_number_recv_handler(void* void_args)
+static errval_t aos_rpc_arm_recv(struct aos_rpc* rpc)
 {
-    // 0. get cycle counter value
-    uint32_t cycle_counter_begin = perf_measurement_get_counter();
-
-    uintptr_t* args = (uintptr_t*) void_args;
-
-    struct aos_rpc* rpc = (struct aos_rpc*) args[0];
-    struct lmp_recv_msg msg = LMP_RECV_MSG_INIT;
-
-    struct capref cap;
-    errval_t err = lmp_chan_recv(&rpc->lc, &msg, &cap);
-    if (err_is_fail(err) && lmp_err_is_transient(err)) {
-        // Reregister.
-        lmp_chan_register_recv(&rpc->lc, rpc->ws,
-                MKCLOSURE((void*) aos_rpc_send_number_recv_handler, args));
-    }
-
-    assert(msg.buf.msglen == 1);
-
-    assert(msg.words[0] == AOS_RPC_OK);
-    // No need to reregister, we got our RAM.
-
-    // N. get new cycle counter value, show result
-    uint32_t cycle_counter_end = perf_measurement_get_counter();
-    if (cycle_counter_end > cycle_counter_begin) {  // otherwise it overflowed and doesn't make much sense
-        debug_printf(" *** performance measurement: aos_rpc_send_number_recv: %u cycles\n", cycle_counter_end - cycle_counter_begin);
+    if (rpc->recv_registered || rpc->in_flight == 0) {
+        return SYS_ERR_OK;
     }
-
-    return err;
-}
-
-errval_t aos_rpc_send_number(struct aos_rpc *chan, uintptr_t val)
-{
-    // TODO: implement functionality to send a number ofer the channel
-    // given channel and wait until the ack gets returned.
-    uintptr_t* args = (uintptr_t*) malloc(2 * sizeof(uintptr_t));
-    args[0] = (uintptr_t) ((struct aos_rpc*) malloc(sizeof(struct aos_rpc)));
-    *((struct aos_rpc*) args[0]) = *chan;
-    args[1] = (uintptr_t) ((uintptr_t*) malloc(sizeof(uintptr_t)));
-    *((uintptr_t*) args[1]) = val;
-
-    CHECK("aos_rpc.c#aos_rpc_send_number: aos_rpc_send_and_receive",
-            aos_rpc_send_and_receive(args, aos_rpc_send_number_send_handler,
-                    aos_rpc_send_number_recv_handler));
-
-    free((uintptr_t*) args[1]);
-    free((struct aos_rpc*) args[0]);
-    free(args);
+    CHECK("aos_rpc.c#aos_rpc_arm_recv: lmp_chan_register_recv",
+            lmp_chan_register_recv(&rpc->lc, rpc->ws,
+                    MKCLOSURE(aos_rpc_recv_handler, rpc)));
+    rpc->recv_registered = true;
     return SYS_ERR_OK;
 }
 
 /**
- * \brief String handler.
+ * \brief Make sure we get notified once queued requests can be sent.
  */
-errval_t aos_rpc_send_string_send_handler(void* void_args)
+static errval_t aos_rpc_arm_send(struct aos_rpc* rpc)
 {
-    uintptr_t* args = (uintptr_t*) void_args;
-    
-    // TODO: implement functionality to send a number ofer the channel
-    // given channel and wait until the ack gets returned.
-    struct aos_rpc *rpc = (struct aos_rpc*) args[0];
-
-    CHECK("aos_rpc.c#aos_rpc_send_string_handler: lmp_chan_send9",
-            lmp_chan_send9(&rpc->lc, LMP_FLAG_SYNC, NULL_CAP,
-                    AOS_RPC_STRING, rpc->client_id, *((uintptr_t*) args[7]),
-                    *((uintptr_t*) args[1]), *((uintptr_t*) args[2]), 
-                    *((uintptr_t*) args[3]), *((uintptr_t*) args[4]),
-                    *((uintptr_t*) args[5]), *((uintptr_t*) args[6])));
-
+    if (rpc->send_registered || rpc->send_count == 0) {
+        return SYS_ERR_OK;
+    }
+    CHECK("aos_rpc.c#aos_rpc_arm_send: lmp_chan_register_send",
+            lmp_chan_register_send(&rpc->lc, rpc->ws,
+                    MKCLOSURE(aos_rpc_send_handler, rpc)));
+    rpc->send_registered = true;
     return SYS_ERR_OK;
 }
 
 /**
- * \brief String response.
+ * \brief Send all queued requests.
+ * Only the last one of a batch yields to the server. If that's a lone
+ * synchronous call and no other thread could run meanwhile, we block in the
+ * kernel until the reply is delivered instead of getting scheduled again
+ * just to find nothing to do. The kernel blocks the whole dispatcher, so
+ * with other threads runnable, we just yield.
  */
-errval_t aos_rpc_send_string_recv_handler(void* void_args)
+static void aos_rpc_send_handler(void* arg)
 {
-    uintptr_t* args = (uintptr_t*) void_args;
-    
-    struct aos_rpc* rpc = (struct aos_rpc*) args[0];
-    struct lmp_recv_msg msg = LMP_RECV_MSG_INIT;
-
-    struct capref cap;
-    errval_t err = lmp_chan_recv(&rpc->lc, &msg, &cap);
-    if (err_is_fail(err) && lmp_err_is_transient(err)) {
-        // Reregister.
-        lmp_chan_register_recv(&rpc->lc, rpc->ws,
-                MKCLOSURE((void*) aos_rpc_send_string_recv_handler, args));
-    }
+    struct aos_rpc* rpc = (struct aos_rpc*) arg;
+    rpc->send_registered = false;
+
+    while (rpc->send_count > 0) {
+        uint8_t tag = rpc->send_queue[rpc->send_head];
+        struct aos_rpc_request* req = &rpc->pending[tag].req;
+        lmp_send_flags_t flags = rpc->send_count == 1 ? LMP_FLAG_SYNC : 0;
+        if (rpc->send_count == 1 && rpc->in_flight == 1
+                && rpc->pending[tag].cont == aos_rpc_sync_cont
+                && !thread_others_runnable()) {
+            flags |= LMP_FLAG_CALL;
+        }
 
-    assert(msg.buf.msglen == 1);
+        errval_t err = lmp_chan_send4(&rpc->lc, flags, req->cap,
+                AOS_RPC_MKWORD(req->opcode, tag), rpc->client_id,
+                req->u.words[0], req->u.words[1]);
+        if (err_is_fail(err) && lmp_err_is_transient(err)) {
+            // Try again next time the channel is ready to send.
+            break;
+        }
 
-    assert(msg.words[0] == AOS_RPC_OK);
-    // No need to reregister, we got our RAM.
-    return err;
-}
+        rpc->send_head = (rpc->send_head + 1) % AOS_RPC_WINDOW;
+        --rpc->send_count;
 
-errval_t aos_rpc_send_string(struct aos_rpc* chan, const char* string)
-{
-    // break string into pieces
-    uintptr_t* args = (uintptr_t*) malloc(8 * sizeof(uintptr_t));
-    args[0] = (uintptr_t) ((struct aos_rpc*) malloc(sizeof(struct aos_rpc)));
-    *((struct aos_rpc*) args[0]) = *chan;
-
-    uint32_t len = strlen(string);
-    uint32_t rem_len = len;
-    char words[24];
-    char buf[4];
-    for(int i=0; i<=(len/24); i++) {
-        //memcpy(words, string + i*24, 24);
-        args[7] = (uintptr_t) ((uint32_t*) malloc(sizeof(uint32_t)));
-        *((uint32_t*) args[7]) = rem_len;
-        if(rem_len > 24) {
-            memcpy(words, string + i*24, 24);
-            for(int j=0; j<6; j++) {
-                memcpy(buf, words+(j*4), 4);
-                args[j+1] = (uintptr_t) ((char*) malloc(4*sizeof(char)));
-                *((char*) args[j+1]) = *buf;
-                *((char*) args[j+1] + 1) = *(buf + 1);
-                *((char*) args[j+1] + 2) = *(buf + 2);
-                *((char*) args[j+1] + 3) = *(buf + 3);
-            }
-            rem_len -= 24;
-        }else {
-            memcpy(words, string + i*24, rem_len);
-            rem_len = 24;
-            //printf("Remaining Length %d\n", rem_len);
-            for(int k=len; k<rem_len; k++) words[k] = 0;
-            //printf("%s\n", words);
-            // for(int p=0; p<24; p++) {
-            //     printf("%s\n", words[p]);
-            // }
-            
-            for(int j=0; j<(rem_len/4); j++) {
-                memcpy(buf, words+(j*4), 4);
-                //debug_printf("%%%%%%%% %c %c %c %c",buf[j], buf[j+1], buf[j+2], buf[j+3]);
-                args[j+1] = (uintptr_t) ((char*) malloc(4*sizeof(char)));
-                *((char*) args[j+1]) = *buf;
-                *((char*) args[j+1] + 1) = *(buf + 1);
-                *((char*) args[j+1] + 2) = *(buf + 2);
-                *((char*) args[j+1] + 3) = *(buf + 3);
-                //printf("%s\n", args[j+1]);
-            }
+        if (err_is_fail(err)) {
+            // Fail the RPC, there won't be a response.
+            DEBUG_ERR(err, "aos_rpc.c#aos_rpc_send_handler: lmp_chan_send4");
+            rpc->pending[tag].resp.status = AOS_RPC_FAILED;
+            rpc->pending[tag].resp.err = err;
+            rpc->pending[tag].resp.cap = NULL_CAP;
+            aos_rpc_complete(rpc, tag);
         }
-        CHECK("aos_rpc.c#aos_rpc_send_string: aos_rpc_send_and_receive",
-            aos_rpc_send_and_receive(args, aos_rpc_send_string_send_handler,
-                    aos_rpc_send_string_recv_handler));
     }
-    // for each piece: call send_and_receive sequentially
-    // when all have completed OK then return OK
-
-    // one chunk should contain:
-    // AOS_RPC_STRING, client_id, characters_left. => 6 * 4 = 24 characters per chunk
-    // {dcba}
 
-    // TODO: implement functionality to send a string over the given channel
-    // and wait for a response.
-    return SYS_ERR_OK;
+    errval_t err = aos_rpc_arm_send(rpc);
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "aos_rpc.c#aos_rpc_send_handler: aos_rpc_arm_send");
+    }
 }
 
 /**
- * \brief RAM cap request.
+ * \brief Free a cap that came with a response nobody is waiting for.
  */
-errval_t aos_rpc_ram_send_handler(void* void_args)
+static void aos_rpc_drop_cap(struct capref cap)
 {
-    // 0. get cycle counter value
-    uint32_t cycle_counter_begin = perf_measurement_get_counter();
-
-    uintptr_t* args = (uintptr_t*) void_args;
-
-    // 1. aos_rpc
-    struct aos_rpc *rpc = (struct aos_rpc*) args[0];
-    // 2. request_bytes
-    size_t* req_bytes = (size_t*) args[1];
-    // 3. retcap
-    struct capref* retcap = (struct capref*) args[2];
-    // 4. ret_bytes is not used here.
-
-    // 5. Perform send.
-    CHECK("aos_rpc.c#aos_rpc_ram_send_handler: lmp_chan_send0",
-            lmp_chan_send3(&rpc->lc, LMP_FLAG_SYNC, *retcap,
-                    AOS_RPC_MEMORY, rpc->client_id, *req_bytes));
-
-    // N. get new cycle counter value, show result
-    uint32_t cycle_counter_end = perf_measurement_get_counter();
-    if (cycle_counter_end > cycle_counter_begin) {  // otherwise it overflowed and doesn't make much sense
-        debug_printf(" *** performance measurement: aos_rpc_ram_send: %u cycles\n", cycle_counter_end - cycle_counter_begin);
+    if (capref_is_null(cap)) {
+        return;
+    }
+    errval_t err = cap_destroy(cap);
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "aos_rpc.c#aos_rpc_drop_cap: cap_destroy");
     }
-    return SYS_ERR_OK;
 }
 
 /**
- * \brief RAM cap response.
+ * \brief Receive all available responses and complete their tags.
  */
-errval_t aos_rpc_ram_recv_handler(void* void_args)
+static void aos_rpc_recv_handler(void* arg)
 {
-   // 0. get cycle counter value
-    uint32_t cycle_counter_begin = perf_measurement_get_counter();
-
-    uintptr_t* args = (uintptr_t*) void_args;
+    struct aos_rpc* rpc = (struct aos_rpc*) arg;
+    rpc->recv_registered = false;
+
+    // Drain everything in one go; the channel replaces the receive slot if a
+    // cap came in.
+    struct lmp_recv_msg msgs[AOS_RPC_WINDOW];
+    struct capref caps[AOS_RPC_WINDOW];
+    size_t count = 0;
+    errval_t err = lmp_chan_recv_many(&rpc->lc, msgs, caps, AOS_RPC_WINDOW,
+            &count);
+    if (err_is_fail(err) && err_no(err) != LIB_ERR_NO_LMP_MSG) {
+        DEBUG_ERR(err, "aos_rpc.c#aos_rpc_recv_handler: lmp_chan_recv_many");
+    }
 
-    // 1. aos_rpc
-    struct aos_rpc* rpc = (struct aos_rpc*) args[0];
-    // 2. retcap
-    struct capref* retcap = (struct capref*) args[2];
+    for (size_t n = 0; n < count; ++n) {
+        struct lmp_recv_msg* msg = &msgs[n];
 
-    struct lmp_recv_msg msg = LMP_RECV_MSG_INIT;
+        // We should have received (status | tag, err, payload).
+        if (msg->buf.msglen < 2 + AOS_RPC_PAYLOAD_WORDS) {
+            debug_printf("aos_rpc_recv_handler: short response (%zu words)\n",
+                    msg->buf.msglen);
+            aos_rpc_drop_cap(caps[n]);
+            continue;
+        }
+        uintptr_t tag = AOS_RPC_TAG(msg->words[0]);
+        if (tag >= AOS_RPC_WINDOW || !rpc->pending[tag].busy) {
+            debug_printf("aos_rpc_recv_handler: response for unknown tag %u\n",
+                    (unsigned) tag);
+            aos_rpc_drop_cap(caps[n]);
+            continue;
+        }
 
-    errval_t err = lmp_chan_recv(&rpc->lc, &msg, retcap);
-    if (err_is_fail(err) && lmp_err_is_transient(err)) {
-        // Reregister.
-        lmp_chan_register_recv(&rpc->lc, rpc->ws,
-                MKCLOSURE((void*) aos_rpc_ram_recv_handler, args));
+        struct aos_rpc_response* resp = &rpc->pending[tag].resp;
+        resp->status = AOS_RPC_CODE(msg->words[0]);
+        resp->err = (errval_t) msg->words[1];
+        resp->cap = caps[n];
+        for (int i = 0; i < AOS_RPC_PAYLOAD_WORDS; ++i) {
+            resp->u.words[i] = msg->words[2 + i];
+        }
+        aos_rpc_complete(rpc, tag);
     }
 
-    // We should have received:
-    // 1) RPC code
-    // 2) RAM alloc error code
-    // 3) actual returned size, if alloc succeeded.
-    assert(msg.buf.msglen >= 3);
+    err = aos_rpc_arm_recv(rpc);
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "aos_rpc.c#aos_rpc_recv_handler: aos_rpc_arm_recv");
+    }
+}
 
-    if (msg.words[0] == AOS_RPC_OK) {
-        // Fill in returnd size.
-        size_t* retsize = (size_t*) args[3];
-        *retsize = msg.words[2];
+errval_t aos_rpc_call_async(struct aos_rpc *rpc,
+                            const struct aos_rpc_request *req,
+                            aos_rpc_cont_t cont, void *arg)
+{
+    // 1. Wait for a free tag.
+    while (rpc->in_flight == AOS_RPC_WINDOW) {
+        CHECK("aos_rpc.c#aos_rpc_call_async: event_dispatch",
+                event_dispatch(rpc->ws));
     }
 
-   // N. get new cycle counter value, show result
-    uint32_t cycle_counter_end = perf_measurement_get_counter();
-    if (cycle_counter_end > cycle_counter_begin) {  // otherwise it overflowed and doesn't make much sense
-        debug_printf(" *** performance measurement: aos_rpc_ram_recv: %u cycles\n", cycle_counter_end - cycle_counter_begin);
+    uint8_t tag = 0;
+    while (rpc->pending[tag].busy) {
+        ++tag;
     }
+    assert(tag < AOS_RPC_WINDOW);
 
-    // No need to reregister, we got our RAM.
-    // Will return error provided by server.
-    return (errval_t) msg.words[1];
-}
+    // 2. Fill in the pending entry.
+    struct aos_rpc_pending* p = &rpc->pending[tag];
+    p->req = *req;
+    p->cont = cont;
+    p->arg = arg;
+    p->busy = true;
+    ++rpc->in_flight;
 
-errval_t aos_rpc_get_ram_cap(struct aos_rpc *chan, size_t request_bytes,
-                             struct capref *retcap, size_t *ret_bytes)
-{
-    // Fill in args.
-    // 1. aos_rpc
-    // 2. request_bytes
-    // 3. retcap
-    // 4. ret_bytes
-    uintptr_t* args = (uintptr_t*) malloc(4 * sizeof(uintptr_t));
-    args[0] = (uintptr_t) ((struct aos_rpc*) malloc(sizeof(struct aos_rpc)));
-    *((struct aos_rpc*) args[0]) = *chan;
-
-    args[1] = (uintptr_t) ((size_t*) malloc(sizeof(size_t)));
-    *((size_t*) args[1]) = request_bytes;
-
-    // Unused -- will be filled in by RPC.
-    args[2] = (uintptr_t) ((struct capref*) malloc(sizeof(struct capref)));
-    args[3] = (uintptr_t) ((size_t*) malloc(sizeof(size_t)));
-
-    // Allocate recv slot.
-    CHECK("aos_rpc.c#aos_rpc_get_ram_cap: lmp_chan_alloc_recv_slot",
-            lmp_chan_alloc_recv_slot(&chan->lc));
-
-    // Perform RPC. On success, this will make the provided capref pointer point
-    // to the newly allocated memory region.
-    CHECK("aos_rpc.c#aos_rpc_get_ram_cap: aos_rpc_send_and_receive",
-            aos_rpc_send_and_receive(args, aos_rpc_ram_send_handler,
-                    aos_rpc_ram_recv_handler));
-
-    *retcap = *((struct capref*) args[2]);
-    *ret_bytes = *((size_t*) args[3]);
-
-    // Free args.
-    free((size_t*) args[3]);
-    free((struct capref*) args[2]);
-    free((size_t*) args[1]);
-    free((struct aos_rpc*) args[0]);
-    free(args);
+    // 3. Queue for sending.
+    rpc->send_queue[(rpc->send_head + rpc->send_count) % AOS_RPC_WINDOW] = tag;
+    ++rpc->send_count;
+
+    CHECK("aos_rpc.c#aos_rpc_call_async: aos_rpc_arm_send",
+            aos_rpc_arm_send(rpc));
+    CHECK("aos_rpc.c#aos_rpc_call_async: aos_rpc_arm_recv",
+            aos_rpc_arm_recv(rpc));
 
     return SYS_ERR_OK;
 }
 
-errval_t aos_rpc_serial_getchar(struct aos_rpc *chan, char *retc)
+errval_t aos_rpc_wait_all(struct aos_rpc *rpc)
 {
-    // TODO implement functionality to request a character from
-    // the serial driver.
+    while (rpc->in_flight > 0) {
+        CHECK("aos_rpc.c#aos_rpc_wait_all: event_dispatch",
+                event_dispatch(rpc->ws));
+    }
     return SYS_ERR_OK;
 }
 
-
-errval_t aos_rpc_serial_putchar(struct aos_rpc *chan, char c)
+/**
+ * \brief Completion for synchronous calls: copy out the response.
+ */
+static void aos_rpc_sync_cont(struct aos_rpc *rpc,
+                              struct aos_rpc_response *resp, void *arg)
 {
-    // TODO implement functionality to send a character to the
-    // serial port.
-
-    uintptr_t* args = (uintptr_t*) malloc(2 * sizeof(uintptr_t));;
-    args[0] = (uintptr_t) ((struct aos_rpc*) malloc(sizeof(struct aos_rpc)));
-    *((struct aos_rpc*) args[0]) = *chan;
+    rpc->resp = *resp;
+    rpc->done = true;
+}
 
-    args[1] = (uintptr_t) ((char*) malloc(sizeof(char)));
-    *((char*) args[1]) = c;
+/**
+ * \brief General-purpose blocking RPC: send rpc->req and wait for rpc->resp.
+ * All state lives in the channel's descriptors, so this doesn't allocate.
+ */
+errval_t aos_rpc_call(struct aos_rpc *rpc)
+{
+    rpc->done = false;
 
-    CHECK("aos_rpc.c#aos_rpc_serial_putchar: aos_rpc_send_and_receive",
-           aos_rpc_send_and_receive(args, aos_rpc_putchar_send_handler,
-                   aos_rpc_putchar_recv_handler));
+    CHECK("aos_rpc.c#aos_rpc_call: aos_rpc_call_async",
+            aos_rpc_call_async(rpc, &rpc->req, aos_rpc_sync_cont, NULL));
 
-    free((char*) args[1]);
-    free((struct aos_rpc*) args[0]);
-    free(args);
+    // Block until the response has arrived.
+    while (!rpc->done) {
+        CHECK("aos_rpc.c#aos_rpc_call: event_dispatch",
+                event_dispatch(rpc->ws));
+    }
 
+    if (rpc->resp.status != AOS_RPC_OK) {
+        return err_is_fail(rpc->resp.err) ? rpc->resp.err : LIB_ERR_RPC_FAILED;
+    }
     return SYS_ERR_OK;
 }
 
-errval_t aos_rpc_putchar_send_handler(void* void_args)
+errval_t aos_rpc_send_number(struct aos_rpc *chan, uintptr_t val)
 {
-    // 0. get cycle counter value
-    uint32_t cycle_counter_begin = perf_measurement_get_counter();
-
-    uintptr_t* args = (uintptr_t*) void_args;
+    aos_rpc_request_init(chan, AOS_RPC_NUMBER);
+    chan->req.u.number = val;
 
-   struct aos_rpc* rpc = (struct aos_rpc*) args[0];
-   char* to_put = (char*) args[1];
+    CHECK("aos_rpc.c#aos_rpc_send_number: aos_rpc_call",
+            aos_rpc_call(chan));
 
-   CHECK("aos_rpc.c#aos_rpc_putchar_send_handler: lmp_chan_send0",
-           lmp_chan_send3(&rpc->lc, LMP_FLAG_SYNC, NULL_CAP,
-                   AOS_RPC_PUTCHAR, 0, *to_put));
+    return SYS_ERR_OK;
+}
 
-    // N. get new cycle counter value, show result
-    uint32_t cycle_counter_end = perf_measurement_get_counter();
-    if (cycle_counter_end > cycle_counter_begin) {  // otherwise it overflowed and doesn't make much sense
-        debug_printf(" *** performance measurement: aos_rpc_putchar_send: %u cycles\n", cycle_counter_end - cycle_counter_begin);
+/**
+ * \brief Map the bulk frame received from init, if not done yet.
+ * Done lazily, since mapping may need RAM from init, which in turn needs
+ * the channel to be fully set up.
+ */
+errval_t aos_rpc_bulk_buf(struct aos_rpc *chan, void **buf, size_t *size)
+{
+    if (chan->bulk_buf == NULL) {
+        if (capref_is_null(chan->bulk_frame)) {
+            return LIB_ERR_RPC_NO_BULK;
+        }
+        CHECK("aos_rpc.c#aos_rpc_bulk_buf: paging_map_frame",
+                paging_map_frame(get_current_paging_state(), &chan->bulk_buf,
+                        chan->bulk_size, chan->bulk_frame, NULL, NULL));
     }
 
-   return SYS_ERR_OK;
+    *buf = chan->bulk_buf;
+    *size = chan->bulk_size;
+    return SYS_ERR_OK;
 }
 
-errval_t aos_rpc_putchar_recv_handler(void* void_args)
+errval_t aos_rpc_send_bulk(struct aos_rpc *chan, size_t offset, size_t len)
 {
-    // 0. get cycle counter value
-    uint32_t cycle_counter_begin = perf_measurement_get_counter();
-
-    uintptr_t* args = (uintptr_t*) void_args;
-
-    struct aos_rpc* rpc = (struct aos_rpc*) args[0];
-    struct lmp_recv_msg msg = LMP_RECV_MSG_INIT;
-
-    struct capref cap;
-    errval_t err = lmp_chan_recv(&rpc->lc, &msg, &cap);
-    if (err_is_fail(err) && lmp_err_is_transient(err)) {
-        // Reregister.
-        lmp_chan_register_recv(&rpc->lc, rpc->ws,
-                MKCLOSURE((void*) aos_rpc_putchar_recv_handler, args));
+    if (len > chan->bulk_size || offset > chan->bulk_size - len) {
+        return LIB_ERR_RPC_BULK_RANGE;
     }
 
-    // This should be an ACK only.
-    assert(msg.buf.msglen == 1);
-    assert(msg.words[0] == AOS_RPC_OK);
+    // Only (offset, length) go over LMP -- the data is already in place.
+    aos_rpc_request_init(chan, AOS_RPC_STRING);
+    chan->req.u.bulk.offset = offset;
+    chan->req.u.bulk.len = len;
 
-    // N. get new cycle counter value, show result
-    uint32_t cycle_counter_end = perf_measurement_get_counter();
-    if (cycle_counter_end > cycle_counter_begin) {  // otherwise it overflowed and doesn't make much sense
-        debug_printf(" *** performance measurement: aos_rpc_putchar_recv: %u cycles\n", cycle_counter_end - cycle_counter_begin);
-    }
+    CHECK("aos_rpc.c#aos_rpc_send_bulk: aos_rpc_call",
+            aos_rpc_call(chan));
 
     return SYS_ERR_OK;
 }
 
-errval_t aos_rpc_process_spawn(struct aos_rpc *chan, char *name,
-                               coreid_t core, domainid_t *newpid)
+errval_t aos_rpc_send_buffer(struct aos_rpc *chan, const void *buf,
+                             size_t len)
 {
-    // TODO (milestone 5): implement spawn new process rpc
-    return SYS_ERR_OK;
-}
+    void *bulk;
+    size_t bulk_size;
+    CHECK("aos_rpc.c#aos_rpc_send_buffer: aos_rpc_bulk_buf",
+            aos_rpc_bulk_buf(chan, &bulk, &bulk_size));
+
+    // One round trip per bulk buffer worth of data.
+    const char *data = (const char*) buf;
+    while (len > 0) {
+        size_t chunk = len < bulk_size ? len : bulk_size;
+        memcpy(bulk, data, chunk);
+        CHECK("aos_rpc.c#aos_rpc_send_buffer: aos_rpc_send_bulk",
+                aos_rpc_send_bulk(chan, 0, chunk));
+        data += chunk;
+        len -= chunk;
+    }
 
-errval_t aos_rpc_process_get_name(struct aos_rpc *chan, domainid_t pid,
-                                  char **name)
-{
-    // TODO (milestone 5): implement name lookup for process given a process
-    // id
     return SYS_ERR_OK;
 }
 
-errval_t aos_rpc_process_get_all_pids(struct aos_rpc *chan,
-                                      domainid_t **pids, size_t *pid_count)
+errval_t aos_rpc_send_string(struct aos_rpc* chan, const char* string)
 {
-    // TODO (milestone 5): implement process id discovery
-    return SYS_ERR_OK;
+    return aos_rpc_send_buffer(chan, string, strlen(string));
 }
 
-/**
- * \brief Initiate handshake by sending local cap to server.
- */
-errval_t aos_rpc_handshake_send_handler(void* void_args)
+errval_t aos_rpc_get_ram_cap(struct aos_rpc *chan, size_t request_bytes,
+                             struct capref *retcap, size_t *ret_bytes)
 {
-    // 0. get cycle counter value
-    uint32_t cycle_counter_begin = perf_measurement_get_counter();
+    // The recv slot is kept allocated by the receive handler.
+    aos_rpc_request_init(chan, AOS_RPC_MEMORY);
+    chan->req.u.bytes = request_bytes;
 
-    uintptr_t* args = (uintptr_t*) void_args;
+    // Perform RPC. On success, the response carries the newly allocated
+    // memory region.
+    CHECK("aos_rpc.c#aos_rpc_get_ram_cap: aos_rpc_call",
+            aos_rpc_call(chan));
 
-    struct aos_rpc *rpc = (struct aos_rpc*) args[0];
-    CHECK("aos_rpc.c#aos_rpc_handshake_send_handler: lmp_chan_send0",
-            lmp_chan_send1(&rpc->lc, LMP_FLAG_SYNC, rpc->lc.local_cap,
-                    AOS_RPC_HANDSHAKE));
+    *retcap = chan->resp.cap;
+    *ret_bytes = chan->resp.u.bytes;
 
-    // N. get new cycle counter value, show result
-    uint32_t cycle_counter_end = perf_measurement_get_counter();
-    if (cycle_counter_end > cycle_counter_begin) {  // otherwise it overflowed and doesn't make much sense
-        debug_printf(" *** performance measurement: aos_rpc_handshake_send: %u cycles\n", cycle_counter_end - cycle_counter_begin);
+    return SYS_ERR_OK;
+}
+
+errval_t aos_rpc_get_ram_caps(struct aos_rpc *chan, size_t bytes, size_t count,
+                              struct capref *retcn, size_t *ret_count)
+{
+    aos_rpc_request_init(chan, AOS_RPC_MEMORY_BATCH);
+    chan->req.u.ram_batch.bytes = bytes;
+    chan->req.u.ram_batch.count = count;
+
+    CHECK("aos_rpc.c#aos_rpc_get_ram_caps: aos_rpc_call",
+            aos_rpc_call(chan));
+
+    // The response carries the L2 CNode holding the batch. Mount it into
+    // our root CNode, so the caps inside are addressable.
+    struct capref cn = chan->resp.cap;
+    if (capref_is_null(cn)) {
+        return LIB_ERR_RPC_FAILED;
     }
+    struct capref root_slot;
+    CHECK("aos_rpc.c#aos_rpc_get_ram_caps: slot_alloc_root",
+            slot_alloc_root(&root_slot));
+    CHECK("aos_rpc.c#aos_rpc_get_ram_caps: cap_copy",
+            cap_copy(root_slot, cn));
+    CHECK("aos_rpc.c#aos_rpc_get_ram_caps: cap_destroy",
+            cap_destroy(cn));
+
+    *retcn = root_slot;
+    *ret_count = chan->resp.u.ram_batch.count;
 
     return SYS_ERR_OK;
 }
 
-/**
- * \brief Finalize handshake by receiving ack from server.
- */
-errval_t aos_rpc_handshake_recv_handler(void* void_args)
+errval_t aos_rpc_get_ram_cap_async(struct aos_rpc *chan, size_t bytes,
+                                   aos_rpc_cont_t cont, void *arg)
 {
-    // 0. get cycle counter value
-    uint32_t cycle_counter_begin = perf_measurement_get_counter();
-
-    uintptr_t* args = (uintptr_t*) void_args;
+    struct aos_rpc_request req = {
+        .opcode = AOS_RPC_MEMORY,
+        .cap = NULL_CAP,
+        .u.words = { 0 },
+    };
+    req.u.bytes = bytes;
+
+    return aos_rpc_call_async(chan, &req, cont, arg);
+}
 
-    struct aos_rpc* rpc = (struct aos_rpc*) args[0];
-    struct lmp_recv_msg msg = LMP_RECV_MSG_INIT;;
-    struct capref cap;
+errval_t aos_rpc_serial_getchar(struct aos_rpc *chan, char *retc)
+{
+    // TODO implement functionality to request a character from
+    // the serial driver.
+    return SYS_ERR_OK;
+}
 
-    errval_t err = lmp_chan_recv(&rpc->lc, &msg, &cap);
-    if (err_is_fail(err) && lmp_err_is_transient(err)) {
-        // Reregister.
-        lmp_chan_register_recv(&rpc->lc, rpc->ws,
-                MKCLOSURE((void*) aos_rpc_handshake_recv_handler, args));
-    }
 
-    // We should have an ACK with a client ID.
-    assert(msg.buf.msglen == 2);
-    assert(msg.words[0] == AOS_RPC_OK);
-    rpc->client_id = (uint32_t) msg.words[1];
+errval_t aos_rpc_serial_putchar(struct aos_rpc *chan, char c)
+{
+    aos_rpc_request_init(chan, AOS_RPC_PUTCHAR);
+    chan->req.u.c = c;
 
-    // N. get new cycle counter value, show result
-    uint32_t cycle_counter_end = perf_measurement_get_counter();
-    if (cycle_counter_end > cycle_counter_begin) {  // otherwise it overflowed and doesn't make much sense
-        debug_printf(" *** performance measurement: aos_rpc_handshake_recv: %u cycles\n", cycle_counter_end - cycle_counter_begin);
-    }
+    CHECK("aos_rpc.c#aos_rpc_serial_putchar: aos_rpc_call",
+           aos_rpc_call(chan));
 
-    // No need to rereister here, as handshake is complete;
-    return err;
+    return SYS_ERR_OK;
 }
 
-/**
- * \brief General-purpose blocking RPC send-and-receive function.
- */
-errval_t aos_rpc_send_and_receive(uintptr_t* args, void* send_handler,
-        void* rcv_handler)
+errval_t aos_rpc_process_spawn(struct aos_rpc *chan, char *name,
+                               coreid_t core, domainid_t *newpid)
 {
-    struct aos_rpc* rpc = (struct aos_rpc*) args[0];
-    // 1. Set send handler.
-    CHECK("aos_rpc.c#aos_rpc_send_and_receive: lmp_chan_register_send",
-            lmp_chan_register_send(&rpc->lc, rpc->ws,
-                    MKCLOSURE(send_handler, args)));
-
-    // 2. Set receive handler.
-    CHECK("aos_rpc.c#aos_rpc_send_and_receive: lmp_chan_register_recv",
-            lmp_chan_register_recv(&rpc->lc, rpc->ws,
-                    MKCLOSURE(rcv_handler, args)));
-
-    // 3. Block until channel is ready to send.
-    CHECK("aos_rpc.c#aos_rpc_send_and_receive: event_dispatch send",
-            event_dispatch(rpc->ws));
+    // TODO (milestone 5): implement spawn new process rpc
+    return SYS_ERR_OK;
+}
 
-    // 4. Block until channel is ready to receive.
-    CHECK("aos_rpc.c#aos_rpc_send_and_receive: event_dispatch receive",
-            event_dispatch(rpc->ws));
+errval_t aos_rpc_process_get_name(struct aos_rpc *chan, domainid_t pid,
+                                  char **name)
+{
+    // TODO (milestone 5): implement name lookup for process given a process
+    // id
+    return SYS_ERR_OK;
+}
 
+errval_t aos_rpc_process_get_all_pids(struct aos_rpc *chan,
+                                      domainid_t **pids, size_t *pid_count)
+{
+    // TODO (milestone 5): implement process id discovery
     return SYS_ERR_OK;
 }
 
@@ -528,26 +443,53 @@ errval_t aos_rpc_init(struct aos_rpc *rpc, struct waitset* ws)
 {
     // 0. Assign waitset to use from now on.
     rpc->ws = ws;
+    rpc->client_id = 0;
 
-    // 1. Create local channel using init as remote endpoint.
+    // 1. Create local channel using init as remote endpoint, with room for
+    // a full window of responses.
     CHECK("aos_rpc.c#aos_rpc_init: lmp_chan_accept",
-            lmp_chan_accept(&rpc->lc, DEFAULT_LMP_BUF_WORDS, cap_initep));
-    debug_printf("aos_rpc_init: LOCAL CAP HAS SLOT %d\n", rpc->lc.local_cap.slot);
+            lmp_chan_accept(&rpc->lc, AOS_RPC_BUF_WORDS, cap_initep));
 
-    // 2. Marshal args.
-    uintptr_t* args = (uintptr_t*) malloc(sizeof(uintptr_t));
-    args[0] = (uintptr_t) rpc;
-    args[0] = (uintptr_t) ((struct aos_rpc*) malloc(sizeof(struct aos_rpc)));
-    *((struct aos_rpc*) args[0]) = *rpc;
+    // Nothing in flight yet.
+    for (int i = 0; i < AOS_RPC_WINDOW; ++i) {
+        rpc->pending[i].busy = false;
+    }
+    rpc->send_head = rpc->send_count = rpc->in_flight = 0;
+    rpc->send_registered = rpc->recv_registered = false;
+    debug_printf("aos_rpc_init: LOCAL CAP HAS SLOT %d\n", rpc->lc.local_cap.slot);
 
-    // 2. Send handshake request to init and wait for ACK.
-    CHECK("aos_rpc.c#aos_rpc_init: aos_rpc_send_and_receive",
-            aos_rpc_send_and_receive(args, aos_rpc_handshake_send_handler,
-                    aos_rpc_handshake_recv_handler));
+    // 2. Bulk frame is mapped lazily on first use.
+    rpc->bulk_frame = NULL_CAP;
+    rpc->bulk_buf = NULL;
+    rpc->bulk_size = 0;
+
+    // 3. Allocate recv slot for the endpoint that comes with the ACK. From
+    // then on, the receive handler replaces the slot whenever it's used up.
+    CHECK("aos_rpc.c#aos_rpc_init: lmp_chan_alloc_recv_slot",
+            lmp_chan_alloc_recv_slot(&rpc->lc));
+
+    // 4. Send handshake request with our local cap to init and wait for ACK.
+    aos_rpc_request_init(rpc, AOS_RPC_HANDSHAKE);
+    rpc->req.cap = rpc->lc.local_cap;
+    CHECK("aos_rpc.c#aos_rpc_init: aos_rpc_call",
+            aos_rpc_call(rpc));
+
+    // 5. ACK carries our client ID and an endpoint private to this channel,
+    // which init may serve from any of its threads. Talk to that from now on.
+    rpc->client_id = rpc->resp.u.handshake.client_id;
+    if (!capref_is_null(rpc->resp.cap)) {
+        rpc->lc.remote_cap = rpc->resp.cap;
+    }
 
-    // 3. Free args.
-    free((struct aos_rpc*) args[0]);
-    free(args);
+    // 6. Fetch the bulk frame shared with init.
+    aos_rpc_request_init(rpc, AOS_RPC_BULK);
+    errval_t err = aos_rpc_call(rpc);
+    if (err_is_ok(err)) {
+        rpc->bulk_frame = rpc->resp.cap;
+        rpc->bulk_size = rpc->resp.u.bytes;
+    } else {
+        DEBUG_ERR(err, "aos_rpc_init: no bulk frame, strings will fail");
+    }
 
     // By now we've successfully established the underlying LMP channel for RPC.
     return SYS_ERR_OK;
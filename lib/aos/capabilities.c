@@ -775,6 +775,32 @@ errval_t devframe_type(struct capref *dest, struct capref src, uint8_t bits)
     return cap_retype(*dest, src, 0, ObjType_DevFrame, 1UL << bits, 1);
 }
 
+/**
+ * \brief Create a RAM cap for a region this domain was told about, but
+ * holds no capability for
+ *
+ * Only usable by a domain holding the kernel capability, e.g. init on a
+ * core booted by another core's init.
+ *
+ * \param dest  Empty slot to place the new cap in
+ * \param base  Physical base address of the region
+ * \param bytes Size of the region
+ * \param owner Core owning the new cap
+ */
+errval_t ram_forge(struct capref dest, genpaddr_t base, gensize_t bytes,
+                   coreid_t owner)
+{
+    struct capability cap = {
+        .type = ObjType_RAM,
+        .rights = CAPRIGHTS_ALLRIGHTS,
+        .u.ram = {
+            .base = base,
+            .bytes = bytes,
+        },
+    };
+    return invoke_monitor_create_cap(cap_kernel, &cap, dest, owner);
+}
+
 /**
  * \brief Create an ID cap in a newly allocated slot.
  *
@@ -84,10 +84,12 @@ static size_t syscall_terminal_write(const char *buf, size_t len)
 static size_t aos_terminal_write(const char* buf, size_t len)
 {
     if (len > 0) {
-        debug_printf("init.c: calling aos_rpc_send_string\n");
-        return aos_rpc_send_string(get_init_rpc(), buf);
+        errval_t err = aos_rpc_send_buffer(get_init_rpc(), buf, len);
+        if (err_is_fail(err)) {
+            return 0;
+        }
     }
-    return 0;
+    return len;
 }
 
 static size_t dummy_terminal_read(char *buf, size_t len)
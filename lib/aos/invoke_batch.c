@@ -0,0 +1,162 @@
+/**
+ * \file
+ * \brief Batched capability invocations
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <aos/aos.h>
+#include <aos/invoke_batch.h>
+
+/**
+ * \brief Start an empty batch
+ */
+void invoke_batch_init(struct invoke_batch *b)
+{
+    b->count = 0;
+}
+
+/**
+ * \brief Queue an invocation, flushing the batch first if it is full
+ *
+ * \param b    Batch to add to
+ * \param to   Capability to invoke
+ * \param cmd  Invocation command
+ * \param argc Number of arguments after the command
+ * \param args Arguments, as cap_invoke() would pass them
+ */
+errval_t invoke_batch_add(struct invoke_batch *b, struct capref to,
+                          uint8_t cmd, size_t argc, const uintptr_t *args)
+{
+    assert(argc <= INVOKE_BATCH_MAX_ARGS);
+
+    if (b->count == INVOKE_BATCH_MAX) {
+        errval_t err = invoke_batch_flush(b);
+        if (err_is_fail(err)) {
+            return err;
+        }
+    }
+
+    struct invoke_batch_entry *e = &b->entries[b->count++];
+    e->cptr = get_cap_addr(to);
+    e->level = get_cap_level(to);
+    e->cmd = cmd;
+    e->argc = argc;
+    for (size_t i = 0; i < argc; i++) {
+        e->args[i] = args[i];
+    }
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief Run all queued invocations, and empty the batch
+ *
+ * Invocations after the first failing one are dropped.
+ */
+errval_t invoke_batch_flush(struct invoke_batch *b)
+{
+    if (b->count == 0) {
+        return SYS_ERR_OK;
+    }
+
+    size_t done;
+    errval_t err = sys_invoke_batch(b->entries, b->count, &done);
+    if (err_is_fail(err)) {
+        debug_printf("batched invocation %zu of %zu failed\n", done, b->count);
+        err = err_push(err, LIB_ERR_INVOKE_BATCH);
+    }
+    b->count = 0;
+    return err;
+}
+
+/**
+ * \brief Queue a retype, see cap_retype()
+ */
+errval_t invoke_batch_retype(struct invoke_batch *b, struct capref dest_start,
+                             struct capref src, gensize_t offset,
+                             enum objtype new_type, gensize_t objsize,
+                             size_t count)
+{
+    assert(offset <= 0xFFFFFFFF);
+    assert(objsize <= 0xFFFFFFFF);
+
+    uintptr_t args[] = {
+        get_croot_addr(src),
+        get_cap_addr(src),
+        offset,
+        invoke_retype_pack_type(get_cnode_level(dest_start), new_type),
+        objsize,
+        count,
+        get_croot_addr(dest_start),
+        get_cnode_addr(dest_start),
+        dest_start.slot,
+    };
+    return invoke_batch_add(b, cap_root, CNodeCmd_Retype, ARRAY_LENGTH(args),
+                            args);
+}
+
+/**
+ * \brief Queue a copy, see cap_copy()
+ */
+errval_t invoke_batch_copy(struct invoke_batch *b, struct capref dest,
+                           struct capref src)
+{
+    uintptr_t args[] = {
+        get_croot_addr(dest),
+        get_cnode_addr(dest),
+        dest.slot,
+        get_croot_addr(src),
+        get_cap_addr(src),
+        get_cnode_level(dest),
+        get_cap_level(src),
+    };
+    return invoke_batch_add(b, cap_root, CNodeCmd_Copy, ARRAY_LENGTH(args),
+                            args);
+}
+
+/**
+ * \brief Queue a delete, see cap_delete()
+ */
+errval_t invoke_batch_delete(struct invoke_batch *b, struct capref cap)
+{
+    uintptr_t args[] = {
+        get_cap_addr(cap),
+        get_cap_level(cap),
+    };
+    return invoke_batch_add(b, get_croot_capref(cap), CNodeCmd_Delete,
+                            ARRAY_LENGTH(args), args);
+}
+
+/**
+ * \brief Queue a mapping into a VNode, see vnode_map()
+ */
+errval_t invoke_batch_vnode_map(struct invoke_batch *b, struct capref dest,
+                                struct capref src, capaddr_t slot,
+                                uint64_t attr, uint64_t off,
+                                uint64_t pte_count, struct capref mapping)
+{
+    assert(get_croot_addr(dest) == CPTR_ROOTCN);
+    assert(off <= 0xffffffff);
+    assert(attr <= 0xffffffff);
+    assert(pte_count <= 0xffff);
+
+    uintptr_t args[] = {
+        get_croot_addr(src),
+        get_cap_addr(src),
+        attr,
+        off,
+        pte_count,
+        get_croot_addr(mapping),
+        get_cnode_addr(mapping),
+        invoke_vnode_map_pack(slot, get_cap_level(src),
+                              get_cnode_level(mapping), mapping.slot),
+    };
+    return invoke_batch_add(b, dest, VNodeCmd_Map, ARRAY_LENGTH(args), args);
+}
@@ -0,0 +1,128 @@
+/**
+ * \file
+ * \brief Cross-core notifications delivered by inter-processor interrupt
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetstr 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <aos/aos.h>
+#include <aos/ipi_notify.h>
+#include <aos/lmp_endpoints.h>
+
+/**
+ * \brief Create the receiving side of a notification channel
+ *
+ * \param in     Storage for channel state
+ * \param chanid Channel ID on this core, unique among this core's channels
+ */
+errval_t ipi_notify_init(struct ipi_notify *in, uint16_t chanid)
+{
+    errval_t err;
+
+    // the kernel merges notifications until they are taken, so the smallest
+    // endpoint will do
+    err = endpoint_create(LMP_RECV_LENGTH, &in->epcap, &in->ep);
+    if (err_is_fail(err)) {
+        return err_push(err, LIB_ERR_ENDPOINT_CREATE);
+    }
+
+    err = invoke_monitor_ipi_register(cap_kernel, in->epcap, chanid);
+    if (err_is_fail(err)) {
+        lmp_endpoint_free(in->ep);
+        return err_push(err, LIB_ERR_IPI_NOTIFY);
+    }
+
+    in->chanid = chanid;
+    in->remote = NULL_CAP;
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief Point the sending side of a notification channel at another core
+ *
+ * \param in     Channel state
+ * \param core   Core the other end runs on
+ * \param chanid Channel ID the other end registered there
+ */
+errval_t ipi_notify_connect(struct ipi_notify *in, coreid_t core,
+                            uint16_t chanid)
+{
+    errval_t err;
+
+    struct capability cap = {
+        .type = ObjType_Notify_IPI,
+        .rights = CAPRIGHTS_ALLRIGHTS,
+        .u.notify_ipi = {
+            .coreid = core,
+            .chanid = chanid,
+        },
+    };
+
+    err = slot_alloc(&in->remote);
+    if (err_is_fail(err)) {
+        return err_push(err, LIB_ERR_UMP_ALLOC_NOTIFY);
+    }
+    err = invoke_monitor_create_cap(cap_kernel, &cap, in->remote,
+                                    disp_get_core_id());
+    if (err_is_fail(err)) {
+        slot_free(in->remote);
+        in->remote = NULL_CAP;
+        return err_push(err, LIB_ERR_UMP_ALLOC_NOTIFY);
+    }
+
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief Notify the other end of the channel
+ */
+errval_t ipi_notify_raise(struct ipi_notify *in)
+{
+    assert(!capref_is_null(in->remote));
+    return invoke_ipi_notify_send(in->remote);
+}
+
+/**
+ * \brief Register an event handler to run when this end is notified
+ *
+ * As with other channels, the registration is consumed when the event fires.
+ * A handler should re-register before it looks for the work it was notified
+ * of, so that a notification raised in between is not lost.
+ */
+errval_t ipi_notify_register(struct ipi_notify *in, struct waitset *ws,
+                             struct event_closure closure)
+{
+    return lmp_endpoint_register(in->ep, ws, closure);
+}
+
+/**
+ * \brief Consume the notifications that have arrived so far
+ */
+void ipi_notify_ack(struct ipi_notify *in)
+{
+    struct lmp_recv_msg buf = LMP_RECV_MSG_INIT;
+    while (err_is_ok(lmp_endpoint_recv(in->ep, &buf.buf, NULL))) {
+        buf.buf.buflen = LMP_MSG_LENGTH;
+    }
+}
+
+/**
+ * \brief UMP send hook that notifies the receiver, see ump_chan_set_notify()
+ *
+ * \param uc  UMP channel
+ * \param arg The struct ipi_notify connected to the receiver
+ */
+void ipi_notify_ump(struct ump_chan *uc, void *arg)
+{
+    errval_t err = ipi_notify_raise(arg);
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "raising UMP notification");
+    }
+}
@@ -210,6 +210,27 @@ errval_t lmp_chan_alloc_recv_slot(struct lmp_chan *lc)
     return SYS_ERR_OK;
 }
 
+errval_t lmp_chan_recv_many(struct lmp_chan *lc, struct lmp_recv_msg *msgs,
+                            struct capref *caps, size_t max, size_t *count)
+{
+    assert(caps != NULL);
+    errval_t err = lmp_endpoint_recv_many(lc->endpoint, msgs, caps, max,
+                                          count);
+
+    for (size_t i = 0; i < *count; i++) {
+        if (!capref_is_null(caps[i])) {
+            // Only one slot per endpoint, so this happens at most once.
+            errval_t slot_err = lmp_chan_alloc_recv_slot(lc);
+            if (err_is_fail(slot_err)) {
+                return slot_err;
+            }
+            break;
+        }
+    }
+
+    return err;
+}
+
 /**
  * \brief Trigger send events for all LMP channels that are registered
  *
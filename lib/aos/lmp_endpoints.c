@@ -13,6 +13,7 @@
  */
 
 #include <inttypes.h>
+#include <string.h>
 #include <aos/aos.h>
 #include <aos/dispatch.h>
 #include <aos/dispatcher_arch.h>
@@ -354,6 +355,25 @@ void lmp_endpoint_migrate(struct lmp_endpoint *ep, struct waitset *ws)
     waitset_chan_migrate(&ep->waitset_state, ws);
 }
 
+/**
+ * \brief Copy `len` words at `pos` out of the endpoint buffer, in at most two
+ * contiguous pieces. Returns the position after the last word.
+ *
+ * Must be called while disabled.
+ */
+static uint32_t lmp_endpoint_copy_out(struct lmp_endpoint *ep, uint32_t pos,
+                                      uintptr_t *dst, size_t len)
+{
+    size_t first = MIN(len, ep->buflen - pos);
+    memcpy(dst, &ep->k.buf[pos], first * sizeof(uintptr_t));
+    if (first < len) {
+        memcpy(dst + first, &ep->k.buf[0], (len - first) * sizeof(uintptr_t));
+        return len - first;
+    }
+    pos += first;
+    return pos == ep->buflen ? 0 : pos;
+}
+
 /**
  * \brief Retrieve an LMP message from an endpoint, if possible
  *
@@ -407,13 +427,8 @@ errval_t lmp_endpoint_recv(struct lmp_endpoint *ep, struct lmp_recv_buf *buf,
         pos = 0;
     }
 
-    /* copy the rest out one word at a time... */
-    for (int i = 0; i < header.x.length; i++) {
-        buf->words[i] = ep->k.buf[pos];
-        if (++pos == ep->buflen) {
-            pos = 0;
-        }
-    }
+    /* copy the rest out */
+    pos = lmp_endpoint_copy_out(ep, pos, buf->words, header.x.length);
 
     /* did we get a cap? */
     if (header.x.flags.captransfer) {
@@ -434,6 +449,78 @@ errval_t lmp_endpoint_recv(struct lmp_endpoint *ep, struct lmp_recv_buf *buf,
     return SYS_ERR_OK;
 }
 
+/**
+ * \brief Retrieve all pending LMP messages from an endpoint, up to `max`
+ *
+ * Copies the messages out in a single disabled section. As an endpoint has
+ * only one receive slot, at most one of them carries a cap; the caller has
+ * to provide a new receive slot afterwards if so.
+ *
+ * \param ep    Endpoint
+ * \param msgs  Array of `max` message buffers, to be filled-in
+ * \param caps  If non-NULL, array of `max` caprefs, filled-in with the
+ *              location of the cap received with each message, or NULL_CAP
+ * \param max   Maximum number of messages to retrieve
+ * \param count Filled-in with the number of messages retrieved
+ *
+ * \return LIB_ERR_NO_LMP_MSG if no message is available
+ * \return LIB_ERR_LMP_RECV_BUF_OVERFLOW if a pending message is too long for
+ *         an lmp_recv_msg; messages before it are still returned in `count`
+ */
+errval_t lmp_endpoint_recv_many(struct lmp_endpoint *ep,
+                                struct lmp_recv_msg *msgs, struct capref *caps,
+                                size_t max, size_t *count)
+{
+    assert(msgs != NULL && count != NULL);
+    errval_t err = SYS_ERR_OK;
+    size_t n = 0;
+
+    dispatcher_handle_t handle = disp_disable();
+
+    uint32_t pos = ep->k.consumed;
+    uint32_t delivered = ep->k.delivered;
+    assert(pos < ep->buflen);
+
+    while (n < max && pos != delivered) {
+        union lmp_recv_header header;
+        header.raw = ep->k.buf[pos];
+        if (header.x.length > LMP_MSG_LENGTH) {
+            err = LIB_ERR_LMP_RECV_BUF_OVERFLOW;
+            break;
+        }
+        if (++pos == ep->buflen) {
+            pos = 0;
+        }
+
+        struct lmp_recv_msg *msg = &msgs[n];
+        msg->buf.buflen = LMP_MSG_LENGTH;
+        msg->buf.msglen = header.x.length;
+        pos = lmp_endpoint_copy_out(ep, pos, msg->buf.words, header.x.length);
+
+        if (header.x.flags.captransfer) {
+            assert_disabled(ep->k.recv_cptr != 0);
+            if (caps != NULL) {
+                caps[n] = ep->recv_slot;
+            }
+            ep->k.recv_cptr = ep->k.recv_cspc = 0;
+        } else if (caps != NULL) {
+            caps[n] = NULL_CAP;
+        }
+        ++n;
+    }
+
+    /* update dispatcher once for the whole batch */
+    ep->k.consumed = pos;
+
+    disp_enable(handle);
+
+    *count = n;
+    if (n == 0 && err_is_ok(err)) {
+        return LIB_ERR_NO_LMP_MSG;
+    }
+    return err;
+}
+
 /**
  * \brief Store a newly-received LRPC message into an endpoint buffer
  *
@@ -15,6 +15,7 @@
 #include <aos/aos.h>
 #include <aos/paging.h>
 #include <aos/except.h>
+#include <aos/invoke_batch.h>
 #include <aos/slab.h>
 #include "threads_priv.h"
 
@@ -24,11 +25,14 @@
 static struct paging_state current;
 
 /**
- * \brief Helper function that allocates a slot and
- *        creates a ARM l2 page table capability
+ * \brief Helper function that creates an ARM l2 page table capability and
+ *        maps it into the l1 page table at `l1_index`
+ *
+ * Retyping the table, mapping it and deleting the RAM it came from are made
+ * with one batched system call.
  */
-__attribute__((unused))
-static errval_t arml2_alloc(struct paging_state * st, struct capref *ret)
+static errval_t arml2_alloc(struct paging_state * st, uint16_t l1_index,
+                            struct capref *ret)
 {
     errval_t err;
     err = st->slot_alloc->alloc(st->slot_alloc, ret);
@@ -36,20 +40,118 @@ static errval_t arml2_alloc(struct paging_state * st, struct capref *ret)
         debug_printf("slot_alloc failed: %s\n", err_getstring(err));
         return err;
     }
-    err = vnode_create(*ret, ObjType_VNode_ARM_l2);
+    struct capref l2_to_l1;
+    err = st->slot_alloc->alloc(st->slot_alloc, &l2_to_l1);
     if (err_is_fail(err)) {
-        debug_printf("vnode_create failed: %s\n", err_getstring(err));
+        DEBUG_ERR(err, "slot_alloc for mapping L2 to L1\n");
         return err;
     }
+
+    // as in vnode_create(), settle for a page if a smaller block isn't there
+    struct capref ram;
+    size_t objsize = vnode_objsize(ObjType_VNode_ARM_l2);
+    err = ram_alloc_aligned(&ram, objsize, objsize);
+    if (err_no(err) == LIB_ERR_RAM_ALLOC_WRONG_SIZE) {
+        err = ram_alloc(&ram, BASE_PAGE_SIZE);
+    }
+    if (err_is_fail(err)) {
+        return err_push(err, LIB_ERR_RAM_ALLOC);
+    }
+
+    struct invoke_batch batch;
+    invoke_batch_init(&batch);
+    err = invoke_batch_retype(&batch, *ret, ram, 0, ObjType_VNode_ARM_l2,
+                              objsize, 1);
+    if (err_is_ok(err)) {
+        err = invoke_batch_vnode_map(&batch, st->l1_pagetable, *ret, l1_index,
+                                     VREGION_FLAGS_READ_WRITE, 0, 1, l2_to_l1);
+    }
+    if (err_is_ok(err)) {
+        err = invoke_batch_delete(&batch, ram);
+    }
+    if (err_is_ok(err)) {
+        err = invoke_batch_flush(&batch);
+    }
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "Creating L2 and mapping it to L1");
+        return err;
+    }
+    err = slot_free(ram);
+    if (err_is_fail(err)) {
+        return err_push(err, LIB_ERR_WHILE_FREEING_SLOT);
+    }
+
+    if (st->mapping_cb) {
+        err = st->mapping_cb(st->mapping_state, l2_to_l1);
+        if (err_is_fail(err)) {
+            DEBUG_ERR(err, "Copying mapping l2_to_l1 to child");
+            return err;
+        }
+    }
     return SYS_ERR_OK;
 }
 
+/// Frame mappings queued by paging_map_fixed_attr_locked()
+struct map_batch {
+    struct invoke_batch invocations;
+    struct capref mappings[INVOKE_BATCH_MAX];
+};
+
+/**
+ * \brief Make the queued mappings, then pass them to the mapping callback
+ */
+static errval_t map_batch_flush(struct paging_state *st, struct map_batch *mb)
+{
+    size_t count = mb->invocations.count;
+    errval_t err = invoke_batch_flush(&mb->invocations);
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "Mapping frame to L2");
+        return err;
+    }
+    for (size_t i = 0; st->mapping_cb && i < count; i++) {
+        err = st->mapping_cb(st->mapping_state, mb->mappings[i]);
+        if (err_is_fail(err)) {
+            DEBUG_ERR(err, "Copying mapping frame_to_l2 to child");
+            return err;
+        }
+    }
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief Queue a mapping of part of `frame` into an L2 page table
+ */
+static errval_t map_batch_add(struct paging_state *st, struct map_batch *mb,
+                              struct capref l2_cap, struct capref frame,
+                              uint16_t frame_index, int flags, size_t offset,
+                              size_t pages)
+{
+    errval_t err;
+    if (mb->invocations.count == INVOKE_BATCH_MAX) {
+        err = map_batch_flush(st, mb);
+        if (err_is_fail(err)) {
+            return err;
+        }
+    }
+
+    struct capref frame_to_l2;
+    err = st->slot_alloc->alloc(st->slot_alloc, &frame_to_l2);
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "slot_alloc for mapping frame to L2\n");
+        return err;
+    }
+    mb->mappings[mb->invocations.count] = frame_to_l2;
+    return invoke_batch_vnode_map(&mb->invocations, l2_cap, frame, frame_index,
+                                  flags, offset, pages, frame_to_l2);
+}
+
 errval_t paging_init_state(struct paging_state *st, lvaddr_t start_vaddr,
         struct capref pdir, struct slot_allocator *ca)
 {
     debug_printf("paging_init_state %p\n", st);
 
     st->mapping_cb = NULL;
+    thread_mutex_init(&st->mutex);
 
     // M2:
     // Slot allocator.
@@ -216,7 +318,8 @@ bool should_refill_slabs(struct paging_state *st)
  * \brief Find a bit of free virtual address space that is large enough to
  *        accomodate a buffer of size `bytes`.
  */
-errval_t paging_alloc(struct paging_state *st, void **buf, size_t bytes)
+static errval_t paging_alloc_locked(struct paging_state *st, void **buf,
+        size_t bytes)
 {
     // TODO: M2 Implement this function
     struct paging_node *node = st->head;
@@ -249,6 +352,17 @@ errval_t paging_alloc(struct paging_state *st, void **buf, size_t bytes)
     return LIB_ERR_VREGION_NOT_FOUND;
 }
 
+errval_t paging_alloc(struct paging_state *st, void **buf, size_t bytes)
+{
+    thread_mutex_lock_nested(&st->mutex);
+    errval_t err = paging_alloc_locked(st, buf, bytes);
+    thread_mutex_unlock(&st->mutex);
+    return err;
+}
+
+static errval_t paging_map_fixed_attr_locked(struct paging_state *st,
+        lvaddr_t vaddr, struct capref frame, size_t bytes, int flags);
+
 /**
  * \brief map a user provided frame, and return the VA of the mapped
  *        frame in `buf`.
@@ -257,20 +371,24 @@ errval_t paging_map_frame_attr(struct paging_state *st, void **buf,
                                size_t bytes, struct capref frame,
                                int flags, void *arg1, void *arg2)
 {
+    thread_mutex_lock_nested(&st->mutex);
     if (should_refill_slabs(st)) {
         st->slab_refilling = true;
         errval_t err = st->slabs.refill_func(&st->slabs);
         if (err_is_fail(err)) {
             DEBUG_ERR(err, "slab refill_func failed");
+            thread_mutex_unlock(&st->mutex);
             return LIB_ERR_VREGION_MAP;
         }
         st->slab_refilling = false;
     }
-    errval_t err = paging_alloc(st, buf, bytes);
-    if (err_is_fail(err)) {
-        return err;
+    errval_t err = paging_alloc_locked(st, buf, bytes);
+    if (err_is_ok(err)) {
+        err = paging_map_fixed_attr_locked(st, (lvaddr_t)(*buf), frame, bytes,
+                flags);
     }
-    return paging_map_fixed_attr(st, (lvaddr_t)(*buf), frame, bytes, flags);
+    thread_mutex_unlock(&st->mutex);
+    return err;
 }
 
 errval_t
@@ -293,6 +411,18 @@ slab_refill_no_pagefault(struct slab_allocator *slabs, struct capref frame, size
 errval_t paging_map_fixed_attr(struct paging_state *st, lvaddr_t vaddr,
         struct capref frame, size_t bytes, int flags)
 {
+    thread_mutex_lock_nested(&st->mutex);
+    errval_t err = paging_map_fixed_attr_locked(st, vaddr, frame, bytes, flags);
+    thread_mutex_unlock(&st->mutex);
+    return err;
+}
+
+static errval_t paging_map_fixed_attr_locked(struct paging_state *st,
+        lvaddr_t vaddr, struct capref frame, size_t bytes, int flags)
+{
+    struct map_batch batch;
+    invoke_batch_init(&batch.invocations);
+
     /* Step 1: Check if the virtual memory area wanted by the user is in fact
                free (check corresponding page_node). */
     struct paging_node *node = st->head;
@@ -362,33 +492,11 @@ errval_t paging_map_fixed_attr(struct paging_state *st, lvaddr_t vaddr,
             if (st->l2_pagetables[l2_index].initialized) {
                 l2_cap = st->l2_pagetables[l2_index].cap;
             } else {
-                // Need to allocate a new L2 pagetable.
-                err = arml2_alloc(st, &l2_cap);
-                if (err_is_fail(err)) {
-                    return err;
-                }
-
-                // Map newly created L2 to L1.
-                struct capref l2_to_l1;
-                err = st->slot_alloc->alloc(st->slot_alloc, &l2_to_l1);
+                // Need to allocate a new L2 pagetable, and map it to L1.
+                err = arml2_alloc(st, l2_index, &l2_cap);
                 if (err_is_fail(err)) {
-                    DEBUG_ERR(err, "slot_alloc for mapping L2 to L1\n");
                     return err;
                 }
-                err = vnode_map(st->l1_pagetable, l2_cap, l2_index,
-                        VREGION_FLAGS_READ_WRITE, 0, 1, l2_to_l1);
-                if (err_is_fail(err)) {
-                    DEBUG_ERR(err, "Mapping L2 to L1");
-                    return err;
-                }
-
-                if (st->mapping_cb) {
-                    err = st->mapping_cb(st->mapping_state, l2_to_l1);
-                    if (err_is_fail(err)) {
-                        DEBUG_ERR(err, "Copying mapping l2_to_l1 to child");
-                        return err;
-                    }
-                }
 
                 st->l2_pagetables[l2_index].cap = l2_cap;
                 st->l2_pagetables[l2_index].initialized = true;
@@ -402,30 +510,11 @@ errval_t paging_map_fixed_attr(struct paging_state *st, lvaddr_t vaddr,
                     : l2_entries_left * BASE_PAGE_SIZE;
 
             /* Step 3: Perform mapping. */
-            struct capref frame_to_l2;
-            err = st->slot_alloc->alloc(st->slot_alloc, &frame_to_l2);
+            err = map_batch_add(st, &batch, l2_cap, frame, frame_index, flags,
+                                mapped_size, size_to_map / BASE_PAGE_SIZE);
             if (err_is_fail(err)) {
-                DEBUG_ERR(err, "slot_alloc for mapping frame to L2\n");
                 return err;
             }
-            err = vnode_map(l2_cap,
-                    frame/*cap_to_map*/,
-                    frame_index,
-                    flags,
-                    mapped_size,
-                    size_to_map / BASE_PAGE_SIZE,
-                    frame_to_l2);
-            if (err_is_fail(err)) {
-                DEBUG_ERR(err, "Mapping frame to L2");  
-                return err;
-            }
-            if (st->mapping_cb) {
-                err = st->mapping_cb(st->mapping_state, frame_to_l2);
-                if (err_is_fail(err)) {
-                    DEBUG_ERR(err, "Copying mapping frame_to_l2 to child");
-                    return err;
-                }
-            }
 
             mapped_size += size_to_map;
             bytes -= size_to_map;
@@ -436,7 +525,7 @@ errval_t paging_map_fixed_attr(struct paging_state *st, lvaddr_t vaddr,
         }
     }
 
-    return SYS_ERR_OK;
+    return map_batch_flush(st, &batch);
 }
 
 /**
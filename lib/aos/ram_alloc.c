@@ -16,9 +16,65 @@
 #include <aos/aos_rpc.h>
 #include <aos/core_state.h>
 
+/// Number of BASE_PAGE_SIZE RAM caps to prefetch with a single RPC.
+#define RAM_BATCH_COUNT 32
+
+/**
+ * \brief Hand out a prefetched BASE_PAGE_SIZE RAM cap, refilling if needed.
+ * Refilling needs slots and possibly RAM itself, so nested requests while
+ * refilling fall back to single-cap RPCs. Each batch comes in a CNode of its
+ * own, which is destroyed once the batch after it is used up too; by then,
+ * callers must have retyped the caps they got from it.
+ */
+static errval_t ram_alloc_batched(struct capref *ret)
+{
+    struct ram_alloc_state *state = get_ram_alloc_state();
+
+    if (state->batch_next == state->batch_end) {
+        if (state->batch_refilling) {
+            return LIB_ERR_RAM_ALLOC;
+        }
+        state->batch_refilling = true;
+        struct capref cn;
+        size_t count;
+        errval_t err = aos_rpc_get_ram_caps(get_init_rpc(), BASE_PAGE_SIZE,
+                RAM_BATCH_COUNT, &cn, &count);
+        state->batch_refilling = false;
+        if (err_is_fail(err)) {
+            return err;
+        }
+        if (!capref_is_null(state->batch_prev_cap)) {
+            err = cap_destroy(state->batch_prev_cap);
+            if (err_is_fail(err)) {
+                DEBUG_ERR(err, "destroying an old RAM batch");
+            }
+        }
+        state->batch_prev_cap = state->batch_cn_cap;
+        state->batch_cn_cap = cn;
+        state->batch_cn = build_cnoderef(cn, CNODE_TYPE_OTHER);
+        state->batch_next = 0;
+        state->batch_end = count;
+        if (count == 0) {
+            return LIB_ERR_RAM_ALLOC;
+        }
+    }
+
+    ret->cnode = state->batch_cn;
+    ret->slot = state->batch_next++;
+    return SYS_ERR_OK;
+}
+
 /* remote (indirect through a channel) version of ram_alloc, for most domains */
 static errval_t ram_alloc_remote(struct capref *ret, size_t size, size_t alignment)
 {
+    // Single pages (page tables, slabs, small frames) come from the batch.
+    if (size == BASE_PAGE_SIZE && alignment <= BASE_PAGE_SIZE) {
+        errval_t err = ram_alloc_batched(ret);
+        if (err_is_ok(err)) {
+            return err;
+        }
+    }
+
     // size = ROUND_UP(size, alignment);
     size_t ret_bytes;
     return aos_rpc_get_ram_cap(get_init_rpc(), size, ret, &ret_bytes);
@@ -117,6 +173,12 @@ void ram_alloc_init(void)
     ram_alloc_state->default_minbase  = 0;
     ram_alloc_state->default_maxlimit = 0;
     ram_alloc_state->base_capnum      = 0;
+    ram_alloc_state->batch_cn_cap     = NULL_CAP;
+    ram_alloc_state->batch_prev_cap   = NULL_CAP;
+    ram_alloc_state->batch_cn         = NULL_CNODE;
+    ram_alloc_state->batch_next       = 0;
+    ram_alloc_state->batch_end        = 0;
+    ram_alloc_state->batch_refilling  = false;
 }
 
 /**
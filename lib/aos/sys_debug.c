@@ -69,6 +69,39 @@ errval_t sys_debug_print_timeslice(void)
     return err;
 }
 
+errval_t sys_debug_cap_lookup_cache_reset(void)
+{
+    return syscall2(SYSCALL_DEBUG, DEBUG_CAP_LOOKUP_CACHE_RESET).error;
+}
+
+/**
+ * \brief Read how many level-2 cap lookups the kernel did, and how many of
+ * those it answered from its translation cache
+ */
+errval_t sys_debug_cap_lookup_cache_read(uint32_t *hits, uint32_t *lookups)
+{
+    struct sysret sr = syscall2(SYSCALL_DEBUG, DEBUG_CAP_LOOKUP_CACHE_HITS_READ);
+    if (err_is_fail(sr.error)) {
+        return sr.error;
+    }
+    *hits = sr.value;
+    sr = syscall2(SYSCALL_DEBUG, DEBUG_CAP_LOOKUP_CACHE_COUNT_READ);
+    *lookups = sr.value;
+    return sr.error;
+}
+
+errval_t sys_debug_print_cap_lookup_cache(void)
+{
+    uint32_t hits, lookups;
+    errval_t err = sys_debug_cap_lookup_cache_read(&hits, &lookups);
+    if (err_is_ok(err)) {
+        printf("core %d: cap lookups = %" PRIu32 ", cached = %" PRIu32
+               " (%" PRIu32 "%%)\n", disp_get_core_id(), lookups, hits,
+               lookups ? (uint32_t)((uint64_t)hits * 100 / lookups) : 0);
+    }
+    return err;
+}
+
 errval_t sys_debug_flush_cache(void)
 {
     return syscall2(SYSCALL_DEBUG, DEBUG_FLUSH_CACHE).error;
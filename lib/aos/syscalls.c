@@ -17,6 +17,7 @@
 #include <aos/dispatch.h>
 #include <aos/syscall_arch.h>
 #include <aos/curdispatcher_arch.h>
+#include <barrelfish_kpi/invoke_batch.h>
 
 /* For documentation on system calls see include/aos/syscalls.h
  */
@@ -43,3 +44,14 @@ errval_t sys_getchar(char *c)
     *c= ret.value;
     return ret.error;
 }
+
+errval_t sys_invoke_batch(struct invoke_batch_entry *entries, size_t count,
+                          size_t *done)
+{
+    struct sysret ret = syscall3(SYSCALL_INVOKE_BATCH, (uintptr_t)entries,
+                                 count);
+    if (done != NULL) {
+        *done = ret.value;
+    }
+    return ret.error;
+}
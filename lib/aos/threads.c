@@ -594,6 +594,20 @@ struct thread *thread_self_disabled(void)
     return disp_gen->current;
 }
 
+/**
+ * \brief Returns whether any thread but the calling one is runnable.
+ */
+bool thread_others_runnable(void)
+{
+    dispatcher_handle_t handle = disp_disable();
+    struct dispatcher_generic *disp_gen = get_dispatcher_generic(handle);
+    struct thread *me = disp_gen->current;
+    bool others = disp_gen->runq != NULL &&
+                  (disp_gen->runq != me || me->next != me);
+    disp_enable(handle);
+    return others;
+}
+
 uintptr_t thread_id(void)
 {
     return thread_self()->id;
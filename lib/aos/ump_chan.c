@@ -0,0 +1,195 @@
+/**
+ * \file
+ * \brief Bidirectional UMP channel implementation
+ */
+
+/*
+ * Copyright (c) 2009, 2010, 2011, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Haldeneggsteig 4, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <aos/aos.h>
+#include <aos/ump_chan.h>
+#include <aos/waitset_chan.h>
+#include "waitset_chan_priv.h"
+
+/// Set up one direction of the channel in a half of the shared buffer
+static void ump_ring_init(struct ump_ring *r, void *buf, size_t size)
+{
+    // all but the last line hold messages; the slot count is kept a power
+    // of two so the epoch stays consistent when the sequence counter wraps
+    size_t nslots = size / UMP_MSG_BYTES - 1;
+    while (nslots & (nslots - 1)) {
+        nslots &= nslots - 1;
+    }
+
+    r->msgs = buf;
+    r->ack = (volatile uint32_t *)((uint8_t *)buf + size - UMP_MSG_BYTES);
+    r->nslots = nslots;
+    r->seq = 0;
+    r->acked = 0;
+}
+
+/**
+ * \brief Initialise a UMP channel over a shared buffer
+ *
+ * Both ends map the same buffer, which must be zeroed before either end
+ * uses it (a freshly retyped frame is), and call this with opposite values
+ * of `first_half`. On ARMv7 SMP the mapping must be cacheable and shareable
+ * for the coherency protocol to keep the two cores' views consistent.
+ *
+ * \param uc         Storage for channel state
+ * \param buf        Shared buffer, aligned to UMP_MSG_BYTES
+ * \param size       Size of the shared buffer
+ * \param first_half True if this end sends in the first half of the buffer
+ */
+errval_t ump_chan_init(struct ump_chan *uc, void *buf, size_t size,
+                       bool first_half)
+{
+    assert(uc != NULL);
+
+    if ((lvaddr_t)buf % UMP_MSG_BYTES != 0) {
+        return LIB_ERR_UMP_BUFADDR_INVALID;
+    }
+    // each half needs at least one message line and the ack line
+    if (size % (2 * UMP_MSG_BYTES) != 0 || size < 4 * UMP_MSG_BYTES) {
+        return LIB_ERR_UMP_BUFSIZE_INVALID;
+    }
+
+    size_t half = size / 2;
+    uint8_t *lo = buf, *hi = lo + half;
+    ump_ring_init(&uc->send, first_half ? lo : hi, half);
+    ump_ring_init(&uc->recv, first_half ? hi : lo, half);
+
+    waitset_chanstate_init(&uc->recv_waitset, CHANTYPE_UMP_IN);
+    uc->notify = NULL;
+    uc->notify_arg = NULL;
+
+    return SYS_ERR_OK;
+}
+
+/// Destroy the local state associated with a given channel
+void ump_chan_destroy(struct ump_chan *uc)
+{
+    waitset_chanstate_destroy(&uc->recv_waitset);
+}
+
+/**
+ * \brief Send a message on a UMP channel
+ *
+ * Non-blocking. Fails with LIB_ERR_UMP_CHAN_FULL if the receiver has not yet
+ * consumed enough of the ring.
+ *
+ * \param uc    UMP channel
+ * \param words Payload
+ * \param len   Payload length in words, at most UMP_PAYLOAD_WORDS
+ */
+errval_t ump_chan_send(struct ump_chan *uc, const uintptr_t *words, size_t len)
+{
+    assert(len <= UMP_PAYLOAD_WORDS);
+
+    if (!ump_chan_can_send(uc)) {
+        return LIB_ERR_UMP_CHAN_FULL;
+    }
+
+    struct ump_ring *r = &uc->send;
+    struct ump_msg *m = &r->msgs[r->seq % r->nslots];
+    for (size_t i = 0; i < len; i++) {
+        m->words[i] = words[i];
+    }
+
+    // the payload must be visible before the control word marks it valid
+    dmb();
+    m->ctrl = ump_ring_epoch(r) | (len << UMP_CTRL_LEN_SHIFT);
+    r->seq++;
+
+    if (uc->notify != NULL) {
+        uc->notify(uc, uc->notify_arg);
+    }
+
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief Receive a message from a UMP channel, if possible
+ *
+ * Non-blocking. Fails with LIB_ERR_NO_UMP_MSG if no message is available.
+ *
+ * \param uc  UMP channel
+ * \param msg UMP message buffer, to be filled-in
+ */
+errval_t ump_chan_recv(struct ump_chan *uc, struct ump_recv_msg *msg)
+{
+    assert(msg != NULL);
+
+    struct ump_ring *r = &uc->recv;
+    struct ump_msg *m = &r->msgs[r->seq % r->nslots];
+    uintptr_t ctrl = m->ctrl;
+    if ((ctrl & UMP_CTRL_EPOCH) != ump_ring_epoch(r)) {
+        return LIB_ERR_NO_UMP_MSG;
+    }
+
+    // don't read the payload before seeing the control word
+    dmb();
+    msg->len = (ctrl >> UMP_CTRL_LEN_SHIFT) & UMP_CTRL_LEN_MASK;
+    assert(msg->len <= UMP_PAYLOAD_WORDS);
+    for (size_t i = 0; i < msg->len; i++) {
+        msg->words[i] = m->words[i];
+    }
+    r->seq++;
+
+    // acknowledge in batches of a quarter ring, so the ack line isn't pulled
+    // across on every message; the sender only needs it when it runs full
+    size_t batch = r->nslots / 4 ? r->nslots / 4 : 1;
+    if (r->seq - r->acked >= batch) {
+        dmb();  // finish reading the slots before handing them back
+        *r->ack = r->seq;
+        r->acked = r->seq;
+    }
+
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief Register an event handler to be notified when messages can be received
+ *
+ * The channel is polled by the dispatcher whenever it would otherwise go
+ * idle, and the closure runs on the given waitset once a message is present.
+ * A channel may only be registered with a single receive event handler on a
+ * single waitset at any one time.
+ *
+ * \param uc UMP channel
+ * \param ws Waitset
+ * \param closure Event handler
+ */
+errval_t ump_chan_register_recv(struct ump_chan *uc, struct waitset *ws,
+                                struct event_closure closure)
+{
+    return waitset_chan_register_polled(ws, &uc->recv_waitset, closure);
+}
+
+/**
+ * \brief Cancel an event registration made with ump_chan_register_recv()
+ *
+ * \param uc UMP channel
+ */
+errval_t ump_chan_deregister_recv(struct ump_chan *uc)
+{
+    return waitset_chan_deregister(&uc->recv_waitset);
+}
+
+/// Called by the waitset when polling; triggers the channel if a message is there
+void ump_chan_poll_disabled(struct waitset_chanstate *chan,
+                            dispatcher_handle_t handle)
+{
+    struct ump_chan *uc = (struct ump_chan *)
+        ((uint8_t *)chan - offsetof(struct ump_chan, recv_waitset));
+    if (ump_chan_can_recv(uc)) {
+        errval_t err = waitset_chan_trigger_disabled(chan, handle);
+        assert_disabled(err_is_ok(err)); // should not be able to fail
+    }
+}
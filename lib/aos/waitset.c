@@ -217,13 +217,20 @@ void poll_ahci(struct waitset_chanstate *chan)
 /// Check polled channels
 void poll_channels_disabled(dispatcher_handle_t handle) {
     struct dispatcher_generic *dp = get_dispatcher_generic(handle);
-    struct waitset_chanstate *chan;
+    struct waitset_chanstate *chan, *next, *last;
 
     if (!dp->polled_channels)
         return;
     chan = dp->polled_channels;
-    do {
+    last = chan->polled_prev;
+    for (;;) {
+        // a triggered channel leaves the polled queue, so remember where to
+        // go next before polling it
+        next = chan->polled_next;
         switch (chan->chantype) {
+        case CHANTYPE_UMP_IN:
+            ump_chan_poll_disabled(chan, handle);
+            break;
         case CHANTYPE_LWIP_SOCKET:
             arranet_polling_loop_proxy();
             break;
@@ -233,7 +240,11 @@ void poll_channels_disabled(dispatcher_handle_t handle) {
         default:
             assert(!"invalid channel type to poll!");
         }
-    } while (chan != dp->polled_channels);
+        if (chan == last || dp->polled_channels == NULL) {
+            break;
+        }
+        chan = next;
+    }
 }
 
 /// Re-register a channel (if persistent)
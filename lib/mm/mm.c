@@ -12,7 +12,8 @@ Design decisions:
 
 Notes:
 
-- not at all reentrant in general, though can survive refilling slabs & slots
+- public functions take mm->lock, recursively so that they survive refilling slots
+- lock order: the paging state's mutex, then mm->lock; slabs are refilled outside mm->lock
 - my memory manager leaks memory :D (does not return slabs & slots)
 - mm_destroy() leaves stuff hanging around, but destroys its own caps, so maybe nobody cares
 
@@ -20,6 +21,7 @@ Notes:
 
 #include <aos/aos.h>
 #include <aos/debug.h>
+#include <aos/invoke_batch.h>
 #include <bitmacros.h>
 #include <mm/mm.h>
 
@@ -43,18 +45,41 @@ static errval_t mm_slot_alloc(struct mm *mm, struct capref *retcap) {
     return mm->slot_alloc(mm->slot_alloc_inst, 1, retcap);
 }
 
-static void *mm_slab_alloc(struct mm *mm) {
-    if (slab_freecount(&mm->slabs) < SLAB_RESERVE && !mm->slabs_refilling) {
-        CHECK_COND(mm->slabs.refill_func, "no function to refill slabs", return NULL);
-        mm->slabs_refilling = true;
-        errval_t err = mm->slabs.refill_func(&mm->slabs);
-        if (err_is_fail(err)) {
-            DEBUG_ERR(err, "refilling slabs failed");
-            mm->slabs_refilling = false;
-            return NULL;
-        }
-        mm->slabs_refilling = false;
+// Refilling maps a page, which takes the paging state's mutex, and paging
+//   allocates RAM from us with that mutex held. So this runs before taking
+//   mm->lock, into a private allocator whose slabs are spliced in afterwards.
+// Nested calls (from our own slot refill) and threads racing another refill
+//   get by on the SLAB_RESERVE.
+static void mm_slab_refill(struct mm *mm) {
+    thread_mutex_lock_nested(&mm->lock);
+    // slots_refilling is only set by the lock holder, so we can't drop it then
+    if (slab_freecount(&mm->slabs) >= SLAB_RESERVE || mm->slabs_refilling ||
+            mm->slots_refilling || mm->slab_refill == NULL) {
+        thread_mutex_unlock(&mm->lock);
+        return;
+    }
+    mm->slabs_refilling = true;
+    thread_mutex_unlock(&mm->lock);
+
+    struct slab_allocator fresh;
+    slab_init(&fresh, sizeof(struct mmnode), NULL);
+    errval_t err = mm->slab_refill(&fresh);
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "refilling slabs failed");
+    }
+
+    thread_mutex_lock_nested(&mm->lock);
+    if (fresh.slabs != NULL) {
+        struct slab_head *last = fresh.slabs;
+        while (last->next != NULL) last = last->next;
+        last->next = mm->slabs.slabs;
+        mm->slabs.slabs = fresh.slabs;
     }
+    mm->slabs_refilling = false;
+    thread_mutex_unlock(&mm->lock);
+}
+
+static void *mm_slab_alloc(struct mm *mm) {
     return slab_alloc(&mm->slabs);
 }
 
@@ -139,7 +164,9 @@ errval_t mm_init(struct mm *mm, enum objtype objtype,
     if (slab_refill_func == NULL) {
         slab_refill_func = slab_default_refill;
     }
-    slab_init(&mm->slabs, sizeof(struct mmnode), slab_refill_func);
+    // no refill function here, so that slab_alloc() never refills under the lock
+    slab_init(&mm->slabs, sizeof(struct mmnode), NULL);
+    mm->slab_refill = slab_refill_func;
 
     mm->objtype = objtype;
     mm->slot_alloc = slot_alloc_func;
@@ -154,6 +181,7 @@ errval_t mm_init(struct mm *mm, enum objtype objtype,
     };
     mm->slabs_refilling = false;
     mm->slots_refilling = false;
+    thread_mutex_init(&mm->lock);
 
     return SYS_ERR_OK;
 }
@@ -164,10 +192,22 @@ errval_t mm_init(struct mm *mm, enum objtype objtype,
 void mm_destroy(struct mm *mm)
 {
     debug_printf("mm: self-destruct sequence initiated\n");
-    for (struct mmnode *found = &mm->head; found != NULL; found = found->next) {
-        if (found->type == NodeType_Parent) { // we do not want to hold these anymore
-            errval_t err = cap_destroy(found->cap.cap);
-            if (err_is_fail(err)) debug_printf("ERROR destroying mem region cap: %s\n", err_getstring(err));
+    // delete the region caps in batches, and only free their slots after
+    struct invoke_batch batch;
+    invoke_batch_init(&batch);
+    struct mmnode *first = &mm->head;
+    while (first != NULL) {
+        struct mmnode *found = first;
+        for (; found != NULL && batch.count < INVOKE_BATCH_MAX; found = found->next) {
+            if (found->type == NodeType_Parent) { // we do not want to hold these anymore
+                invoke_batch_delete(&batch, found->cap.cap);
+            }
+        }
+        // on failure, some of the slots may still be in use, so leave them be
+        errval_t err = invoke_batch_flush(&batch);
+        if (err_is_fail(err)) debug_printf("ERROR destroying mem region caps: %s\n", err_getstring(err));
+        for (; first != found; first = first->next) {
+            if (err_is_ok(err) && first->type == NodeType_Parent) slot_free(first->cap.cap);
         }
     }
     // since we've destroyed all caps to the memory we've been holding, we
@@ -191,15 +231,18 @@ errval_t mm_add(struct mm *mm, struct capref capr, genpaddr_t base, size_t size)
     };
     // I save the original "parent" region that I won't ever touch so that I can
     //   cleanly mm_destroy() easily
+    mm_slab_refill(mm);
+    thread_mutex_lock_nested(&mm->lock);
     struct mmnode *parent = mm_slab_alloc(mm);
-    CHECK_COND(parent != NULL, "allocating space for new mmnode", return LIB_ERR_RAM_ALLOC);
+    CHECK_COND(parent != NULL, "allocating space for new mmnode", thread_mutex_unlock(&mm->lock); return LIB_ERR_RAM_ALLOC);
     struct mmnode *node   = mm_slab_alloc(mm);
-    CHECK_COND(node != NULL, "allocating space for new mmnode", mm_slab_free(mm, parent); return LIB_ERR_RAM_ALLOC);
+    CHECK_COND(node != NULL, "allocating space for new mmnode", mm_slab_free(mm, parent); thread_mutex_unlock(&mm->lock); return LIB_ERR_RAM_ALLOC);
 
     node_fill(parent, capi, base, size, NodeType_Parent);
     node_fill(node, capi, base, size, NodeType_Free);
     node_add(&mm->head, parent);
     node_add(&mm->head, node);
+    thread_mutex_unlock(&mm->lock);
     return SYS_ERR_OK;
 }
 
@@ -224,13 +267,14 @@ errval_t mm_alloc_aligned(struct mm *mm, size_t wanted_size, size_t alignment, s
         alignment = BASE_PAGE_SIZE;
     }
 
+    mm_slab_refill(mm);
+    thread_mutex_lock_nested(&mm->lock);
     struct mmnode *before = mm_slab_alloc(mm);
-    CHECK_COND(before != NULL, "allocating space for new mmnode", return LIB_ERR_RAM_ALLOC);
+    CHECK_COND(before != NULL, "allocating space for new mmnode", thread_mutex_unlock(&mm->lock); return LIB_ERR_RAM_ALLOC);
     struct mmnode *after = mm_slab_alloc(mm);
-    CHECK_COND(after != NULL, "allocating space for new mmnode", mm_slab_free(mm, before); return LIB_ERR_RAM_ALLOC);
+    CHECK_COND(after != NULL, "allocating space for new mmnode", mm_slab_free(mm, before); thread_mutex_unlock(&mm->lock); return LIB_ERR_RAM_ALLOC);
 
     // look for a free node that's big enough
-    // NOTE: acquire lock here
     for (struct mmnode *found = &mm->head; found != NULL; found = found->next) {
         // debug_printf("*** mm: found node: base %llx, size %llx, type %d\n", found->base, found->size, found->type);
 
@@ -262,18 +306,21 @@ errval_t mm_alloc_aligned(struct mm *mm, size_t wanted_size, size_t alignment, s
         // 3. update the allocated node
         found->base = real_base;
         found->size = size;
-        // NOTE: release lock here
-        CHECK("creating cap for new RAM chunk", make_cap_for_node(mm, found));
+        // the slot allocator is shared with nested refills, so keep holding
+        //   the lock until the cap exists
+        errval_t err = make_cap_for_node(mm, found);
+        thread_mutex_unlock(&mm->lock);
+        CHECK("creating cap for new RAM chunk", err);
 
         // 4. we're done here
         // debug_printf("*** mm: allocated %llx bytes at base %llx\n", found->size, found->base);
         *retcap = found->cap.cap;
         return SYS_ERR_OK;
     }
-    // NOTE: release lock here
     debug_printf("If you see this, I think there is no free RAM left\n");
     mm_slab_free(mm, before);
     mm_slab_free(mm, after);
+    thread_mutex_unlock(&mm->lock);
     return LIB_ERR_RAM_ALLOC;
 }
 
@@ -305,13 +352,17 @@ errval_t mm_free(struct mm *mm, struct capref cap, genpaddr_t base, gensize_t si
     // print_mm_state(mm);
 
     // walk through the list, looking for the node this refers to
-    // NOTE: acquire lock here
+    thread_mutex_lock_nested(&mm->lock);
     for (struct mmnode *found = &mm->head; found != NULL; found = found->next) {
         if (found->base == base && found->size == size &&
             found->type == NodeType_Allocated) {
 
             // 1. set type to free
-            CHECK("looking for parent region", find_parent_region_cap(mm, base, size, &found->cap));
+            errval_t err = find_parent_region_cap(mm, base, size, &found->cap);
+            if (err_is_fail(err)) {
+                thread_mutex_unlock(&mm->lock);
+                CHECK("looking for parent region", err);
+            }
             found->type = NodeType_Free;
 
             struct mmnode* freeme[2] = {NULL, NULL};
@@ -333,16 +384,16 @@ errval_t mm_free(struct mm *mm, struct capref cap, genpaddr_t base, gensize_t si
                 found->size += found->next->size;
                 node_rm(found->next);
             }
-            // NOTE: release lock here
-            CHECK("mm_free: destroying cap for freed chunk", cap_destroy(cap));
             for (int i = 0; i < 2; ++i) {
                 if (freeme[i] != NULL) mm_slab_free(mm, freeme[i]);
             }
+            thread_mutex_unlock(&mm->lock);
+            CHECK("mm_free: destroying cap for freed chunk", cap_destroy(cap));
             return SYS_ERR_OK;
         }
     }
     // if we got here, we didn't find anything
-    // NOTE: release lock here
+    thread_mutex_unlock(&mm->lock);
     debug_printf("ERROR: mm_free: given parameters don't match any actual region\n");
     return LIB_ERR_RAM_ALLOC;
 }
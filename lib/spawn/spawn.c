@@ -3,6 +3,7 @@
 
 #include <elf/elf.h>
 #include <aos/dispatcher_arch.h>
+#include <aos/invoke_batch.h>
 #include <barrelfish_kpi/paging_arm_v7.h>
 #include <barrelfish_kpi/domain_params.h>
 #include <spawn/multiboot.h>
@@ -342,12 +343,14 @@ errval_t setup_cspace(struct spawninfo* si)
     }
 
     // 3. Set TASKCN slot ROOTCN to L1Cnode.
+    struct invoke_batch batch;
+    invoke_batch_init(&batch);
     struct capref taskn_rootcn = {
         .cnode = si->l2_cnodes[ROOTCN_SLOT_TASKCN],
         .slot = TASKCN_SLOT_ROOTCN
     };
     CHECK("copying L1Cnode cap to taskcn",\
-            cap_copy(taskn_rootcn, si->l1_cnode_cap));
+            invoke_batch_copy(&batch, taskn_rootcn, si->l1_cnode_cap));
 
     // 3.1 Set up initep
     struct capref parent_initep = {
@@ -356,17 +359,30 @@ errval_t setup_cspace(struct spawninfo* si)
     };
     
     // CHECK("Copy cap", cap_copy(cap_initep, parent_chan.local_cap));
-    CHECK("err in cap copy from local cap\n", cap_copy(parent_initep, cap_initep));
+    CHECK("err in cap copy from local cap\n",
+            invoke_batch_copy(&batch, parent_initep, cap_initep));
+    CHECK("copying caps to taskcn", invoke_batch_flush(&batch));
 
-    // 4. Allocate some RAM for BASE_PAGE_CN slots.
+    // 4. Allocate some RAM for BASE_PAGE_CN slots. Copying each page and
+    //    deleting our own cap for it go in one batch per chunk of pages.
     struct capref cap = {
         .cnode = si->l2_cnodes[ROOTCN_SLOT_BASE_PAGE_CN]
     };
-    for (cap.slot = 0; cap.slot < L2_CNODE_SLOTS; ++cap.slot) {
-        struct capref ram;
-        CHECK("ram_alloc for BASE_PAGE_CN", ram_alloc(&ram, BASE_PAGE_SIZE));
-        CHECK("copying ram to BASE_PAGE_CN", cap_copy(cap, ram));
-        cap_destroy(ram);
+    struct capref ram[INVOKE_BATCH_MAX / 2];
+    for (cap.slot = 0; cap.slot < L2_CNODE_SLOTS;) {
+        size_t n;
+        for (n = 0; n < ARRAY_LENGTH(ram) && cap.slot < L2_CNODE_SLOTS;
+             ++n, ++cap.slot) {
+            CHECK("ram_alloc for BASE_PAGE_CN", ram_alloc(&ram[n], BASE_PAGE_SIZE));
+            CHECK("copying ram to BASE_PAGE_CN",
+                    invoke_batch_copy(&batch, cap, ram[n]));
+            CHECK("deleting ram for BASE_PAGE_CN",
+                    invoke_batch_delete(&batch, ram[n]));
+        }
+        CHECK("filling BASE_PAGE_CN", invoke_batch_flush(&batch));
+        for (size_t i = 0; i < n; ++i) {
+            slot_free(ram[i]);
+        }
     }
 
     return SYS_ERR_OK;
@@ -469,10 +485,13 @@ errval_t setup_dispatcher(struct spawninfo* si)
     CHECK("dispatcher create", dispatcher_create(si->dispatcher));
 
     // 2. Setup dispatcher endpoint.
+    struct invoke_batch batch;
+    invoke_batch_init(&batch);
     struct capref endpoint;
     CHECK("dispatcher endpoint slot", slot_alloc(&endpoint));
     CHECK("dispatcher endpoint retype",
-            cap_retype(endpoint, si->dispatcher, 0, ObjType_EndPoint, 0, 1));
+            invoke_batch_retype(&batch, endpoint, si->dispatcher, 0,
+                    ObjType_EndPoint, 0, 1));
 
     // 3. Create dispatcher frame cap.
     size_t retsize;
@@ -485,20 +504,22 @@ errval_t setup_dispatcher(struct spawninfo* si)
         .slot = TASKCN_SLOT_DISPATCHER
     };
     CHECK("copy dispatcher to child",
-            cap_copy(dispatcher_child, si->dispatcher));
+            invoke_batch_copy(&batch, dispatcher_child, si->dispatcher));
 
     struct capref selfep = {
         .cnode = si->l2_cnodes[ROOTCN_SLOT_TASKCN],
         .slot = TASKCN_SLOT_SELFEP
     };
-    CHECK("copy selfep to child", cap_copy(selfep, endpoint));
+    CHECK("copy selfep to child", invoke_batch_copy(&batch, selfep, endpoint));
 
     struct capref dispatcher_frame_child = {
         .cnode = si->l2_cnodes[ROOTCN_SLOT_TASKCN],
         .slot = TASKCN_SLOT_DISPFRAME
     };
     CHECK("copy dispatcher frame to child",
-            cap_copy(dispatcher_frame_child, si->dispatcher_frame));
+            invoke_batch_copy(&batch, dispatcher_frame_child,
+                    si->dispatcher_frame));
+    CHECK("setting up dispatcher caps", invoke_batch_flush(&batch));
 
     // 5. Map dispatcher frame into my own vspace.
     void* vaddr_me;
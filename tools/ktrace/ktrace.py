@@ -0,0 +1,156 @@
+#!/usr/bin/env python3
+##########################################################################
+# Copyright (c) 2016, ETH Zurich.
+# All rights reserved.
+#
+# This file is distributed under the terms in the attached LICENSE file.
+# If you do not find this file, copies can be found by writing to:
+# ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+##########################################################################
+
+"""Turn the kernel event traces init prints into a timeline.
+
+Reads a console log with the KTRACE lines printed by usr/init/ktrace.c, and
+prints the events of all cores in time order. With --ipc, it instead
+follows messages across domains, and prints how long each hop took:
+
+  * from an LMP delivery to the receiver being dispatched, and
+  * from an IPI notification being raised to the interrupt on its core.
+
+    tools/ktrace/ktrace.py console.log
+"""
+
+import argparse, collections, re, sys
+
+LINE_RE = re.compile(r'KTRACE (\d+) (hz|disp|rec|lost) (.*)')
+
+# must match include/barrelfish_kpi/ktrace.h
+SYSCALL, SYSCALL_RET, LMP_SEND, NOTIFY, DISPATCH, IRQ, WAKEUP = range(1, 8)
+DISP_NONE = 0xff
+
+# must match include/barrelfish_kpi/syscalls.h for ARMv7
+SYSCALLS = ['invoke', 'yield', 'lrpc', 'debug', 'reboot', 'nop', 'print',
+            'getchar', 'cache_clean', 'cache_inval', 'suspend',
+            'get_abs_time', 'invoke_batch']
+
+# must match IPI_NOTIFY_SGI in kernel/include/arch/armv7/irq.h
+IPI_NOTIFY_SGI = 2
+
+Event = collections.namedtuple('Event', 'ts core event disp peer arg')
+
+class Trace(object):
+    def __init__(self):
+        self.hz = {}
+        self.names = {}     # (core, index) -> name
+        self.events = []
+        self.lost = collections.Counter()
+
+    def name(self, core, disp):
+        if disp == DISP_NONE:
+            return '-'
+        return self.names.get((core, disp), '#%d' % disp)
+
+    def us(self, core, ticks):
+        return ticks * 1e6 / self.hz[core]
+
+def read_trace(f):
+    t = Trace()
+    for line in f:
+        m = LINE_RE.search(line)
+        if m is None:
+            continue
+        core, kind, rest = int(m.group(1)), m.group(2), m.group(3).split()
+        if kind == 'hz':
+            t.hz[core] = int(rest[0])
+        elif kind == 'disp':
+            t.names[(core, int(rest[0]))] = rest[1] if len(rest) > 1 else ''
+        elif kind == 'lost':
+            t.lost[core] += int(rest[0])
+        elif core in t.hz:
+            ts, event, disp, peer, arg = [int(x, 16) for x in rest[:5]]
+            t.events.append(Event(ts, core, event, disp, peer, arg))
+    # all cores share the same timestamp counter
+    t.events.sort(key=lambda e: (e.ts, e.core))
+    return t
+
+def describe(t, e):
+    name = t.name(e.core, e.disp)
+    if e.event == SYSCALL:
+        n = e.arg & 0xf
+        s = 'syscall %s' % (SYSCALLS[n] if n < len(SYSCALLS) else n)
+        if n == 0:
+            s += ' cmd %d' % ((e.arg >> 8) & 0xff)
+        return name, s
+    if e.event == SYSCALL_RET:
+        return name, 'syscall returns %s' % ('ok' if e.arg == 0 else
+                                             'error %d' % e.arg)
+    if e.event == LMP_SEND:
+        return name, 'lmp -> %s, %d words' % (t.name(e.core, e.peer), e.arg)
+    if e.event == NOTIFY:
+        return name, 'notify core %d channel %d' % (e.arg >> 16,
+                                                    e.arg & 0xffff)
+    if e.event == DISPATCH:
+        return name, 'dispatch' if e.disp != DISP_NONE else 'idle'
+    if e.event == IRQ:
+        return name, 'irq %d' % e.arg
+    if e.event == WAKEUP:
+        return name, 'wakeup'
+    return name, 'event %d arg %x' % (e.event, e.arg)
+
+def timeline(t):
+    start = t.events[0].ts
+    for e in t.events:
+        name, s = describe(t, e)
+        print('%12.3f  %2d  %-16s %s' % (t.us(e.core, e.ts - start), e.core,
+                                         name, s))
+
+def ipc(t):
+    hops = collections.defaultdict(list)
+    # messages waiting for their receiver to run, per core and receiver
+    pending = collections.defaultdict(list)
+    # notifications waiting for their interrupt, per core
+    notified = collections.defaultdict(list)
+    for e in t.events:
+        if e.event == LMP_SEND and e.peer != DISP_NONE:
+            pending[(e.core, e.peer)].append(e)
+        elif e.event == DISPATCH:
+            for s in pending.pop((e.core, e.disp), []):
+                key = ('lmp', t.name(s.core, s.disp), t.name(e.core, e.disp))
+                hops[key].append(t.us(e.core, e.ts - s.ts))
+        elif e.event == NOTIFY:
+            notified[e.arg >> 16].append(e)
+        elif e.event == IRQ and e.arg == IPI_NOTIFY_SGI:
+            for s in notified.pop(e.core, []):
+                key = ('notify', '%s@%d' % (t.name(s.core, s.disp), s.core),
+                       'core %d' % e.core)
+                hops[key].append(t.us(e.core, e.ts - s.ts))
+
+    print('%-6s %-20s %-20s %6s %10s %10s %10s' % ('KIND', 'FROM', 'TO', 'N',
+          'MIN(us)', 'AVG(us)', 'MAX(us)'))
+    for (kind, src, dst), l in sorted(hops.items(), key=lambda x: -len(x[1])):
+        print('%-6s %-20s %-20s %6d %10.3f %10.3f %10.3f' % (kind, src, dst,
+              len(l), min(l), sum(l) / len(l), max(l)))
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__,
+                                formatter_class=argparse.RawDescriptionHelpFormatter)
+    p.add_argument('log', nargs='?', type=argparse.FileType('r'),
+                   default=sys.stdin, help='console log (default: stdin)')
+    p.add_argument('--ipc', action='store_true',
+                   help='summarise IPC hop latencies instead')
+    args = p.parse_args()
+
+    t = read_trace(args.log)
+    if not t.events:
+        sys.exit('Error: no trace records found')
+    for core, n in sorted(t.lost.items()):
+        sys.stderr.write('Warning: %d records of core %d were overwritten\n'
+                         % (n, core))
+
+    if args.ipc:
+        ipc(t)
+    else:
+        timeline(t)
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,128 @@
+#!/usr/bin/env python3
+##########################################################################
+# Copyright (c) 2016, ETH Zurich.
+# All rights reserved.
+#
+# This file is distributed under the terms in the attached LICENSE file.
+# If you do not find this file, copies can be found by writing to:
+# ETH Zurich D-INFK, Universitaetstr. 6, CH-8092 Zurich. Attn: Systems Group.
+##########################################################################
+
+"""Turn the PC samples init prints into a flat profile.
+
+Reads a console log with the PROFILE lines printed by usr/init/profile.c,
+and symbolises each sample against the binary named after its dispatcher,
+as built by hake in <build>/<arch>/sbin. Prints, for each function, how
+many samples hit it, and with --callers, which functions the samples' LR
+pointed into.
+
+    tools/profile/profile.py --build build console.log
+"""
+
+import argparse, bisect, collections, os, re, shutil, subprocess, sys
+
+SAMPLE_RE = re.compile(r'PROFILE (\d+) (\S+) ([0-9a-fA-F]+) ([0-9a-fA-F]+)( D)?')
+
+IDLE = '<idle>'
+
+class Symbols(object):
+    """Function symbols of one ELF binary, as listed by nm"""
+
+    def __init__(self, nm, path):
+        self.addrs = []
+        self.names = []
+        if path is None:
+            return
+        out = subprocess.check_output([nm, '-n', '--defined-only', path],
+                                      universal_newlines=True)
+        for line in out.splitlines():
+            fields = line.split()
+            if len(fields) != 3 or fields[1] not in 'TtWw':
+                continue
+            # skip ARM mapping symbols, they don't name anything
+            if fields[2].startswith('$'):
+                continue
+            self.addrs.append(int(fields[0], 16))
+            self.names.append(fields[2])
+
+    def lookup(self, addr):
+        # Thumb code addresses have the low bit set
+        i = bisect.bisect_right(self.addrs, addr & ~1) - 1
+        if i < 0:
+            return '0x%08x' % addr
+        return self.names[i]
+
+def find_nm(name):
+    if name is not None:
+        return name
+    for nm in ['arm-linux-gnueabihf-nm', 'arm-none-eabi-nm', 'nm']:
+        if shutil.which(nm):
+            return nm
+    sys.exit('Error: no nm found, use --nm')
+
+def read_samples(f, core):
+    for line in f:
+        m = SAMPLE_RE.search(line)
+        if m is None:
+            continue
+        if core is not None and int(m.group(1)) != core:
+            continue
+        yield m.group(2), int(m.group(3), 16), int(m.group(4), 16)
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__,
+                                formatter_class=argparse.RawDescriptionHelpFormatter)
+    p.add_argument('log', nargs='?', type=argparse.FileType('r'),
+                   default=sys.stdin, help='console log (default: stdin)')
+    p.add_argument('--build', default='.', help='hake build directory')
+    p.add_argument('--arch', default='armv7', help='architecture built')
+    p.add_argument('--nm', help='nm to list symbols with')
+    p.add_argument('--core', type=int, help='only count samples of this core')
+    p.add_argument('--idle', action='store_true',
+                   help='count samples of idle cores too')
+    p.add_argument('--callers', action='store_true',
+                   help='show where samples LR pointed into, per function')
+    p.add_argument('--limit', type=int, default=40,
+                   help='functions to show (default: 40, 0 for all)')
+    args = p.parse_args()
+    nm = find_nm(args.nm)
+
+    binaries = {}
+    def symbols(name):
+        if name not in binaries:
+            path = os.path.join(args.build, args.arch, 'sbin', name)
+            if not os.path.exists(path):
+                sys.stderr.write('Warning: no binary %s, not symbolising %s\n'
+                                 % (path, name))
+                path = None
+            binaries[name] = Symbols(nm, path)
+        return binaries[name]
+
+    total = 0
+    hits = collections.Counter()
+    callers = collections.defaultdict(collections.Counter)
+    for name, pc, lr in read_samples(args.log, args.core):
+        if name == IDLE:
+            if not args.idle:
+                continue
+            fn = (name, IDLE)
+        else:
+            fn = (name, symbols(name).lookup(pc))
+            if args.callers:
+                callers[fn][symbols(name).lookup(lr)] += 1
+        hits[fn] += 1
+        total += 1
+
+    if total == 0:
+        sys.exit('Error: no samples found')
+
+    print('%d samples' % total)
+    print('%8s %6s  %-16s %s' % ('SAMPLES', '%', 'BINARY', 'FUNCTION'))
+    for (name, fn), n in hits.most_common(args.limit or None):
+        print('%8d %6.2f  %-16s %s' % (n, 100.0 * n / total, name, fn))
+        if args.callers:
+            for caller, m in callers[(name, fn)].most_common(3):
+                print('%8s %6s  %-16s   <- %s (%d)' % ('', '', '', caller, m))
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,271 @@
+/**
+ * \file
+ * \brief Booting additional cores from init
+ *
+ * The new core shares the text of the running CPU driver, but needs its own
+ * copy of the driver's data segment (the GOT and BSS, including its stacks),
+ * its own KCB, and a struct arm_core_data telling it where all of that is.
+ * The boot driver still parks the other cores in a WFE loop, so once that is
+ * ready, the kernel only has to post the core data to the boot record.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetsstrasse 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <string.h>
+
+#include <aos/aos.h>
+#include <aos/paging.h>
+#include <aos/sys_debug.h>
+#include <elf/elf.h>
+#include <spawn/multiboot.h>
+
+#include "coreboot.h"
+#include "mem_alloc.h"
+
+/// Find the first program header of the given type
+static struct Elf32_Phdr *find_segment(void *elf, uint32_t type)
+{
+    struct Elf32_Ehdr *ehdr = elf;
+    struct Elf32_Phdr *phdr = (struct Elf32_Phdr *)((char *)elf + ehdr->e_phoff);
+    for (size_t i = 0; i < ehdr->e_phnum; i++) {
+        if (phdr[i].p_type == type) {
+            return &phdr[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * \brief Copy and relocate the per-core data segment of a CPU driver
+ *
+ * The CPU driver is linked at 0, with its text shared by all cores at
+ * `text_offset` and a separate PT_BF_RELOC segment per core. Relocations in
+ * that segment either point back into it, and move with it to `vbase`, or
+ * into the shared text, and move by `text_offset`.
+ *
+ * \param elf         CPU driver image
+ * \param elf_bytes   Size of the image
+ * \param out         Where to copy the segment to
+ * \param vbase       Kernel-virtual address `out` will have on the new core
+ * \param text_offset Kernel-virtual address of the running, shared text
+ * \param got_base    Filled-in with the new core's GOT address
+ */
+static errval_t load_cpu_relocatable_segment(void *elf, size_t elf_bytes,
+                                             void *out, lvaddr_t vbase,
+                                             lvaddr_t text_offset,
+                                             lvaddr_t *got_base)
+{
+    // the full image holds the dynamic table and the relocations
+    struct Elf32_Phdr *full = find_segment(elf, PT_LOAD);
+    struct Elf32_Phdr *reloc = find_segment(elf, PT_BF_RELOC);
+    struct Elf32_Phdr *dynamic = find_segment(elf, PT_DYNAMIC);
+    if (full == NULL || reloc == NULL || dynamic == NULL) {
+        return ELF_ERR_HEADER;
+    }
+    char *full_data = (char *)elf + full->p_offset;
+
+    // the BSS part of the segment isn't in the file, and must start zeroed
+    assert(reloc->p_filesz <= reloc->p_memsz);
+    memcpy(out, (char *)elf + reloc->p_offset, reloc->p_filesz);
+    memset((char *)out + reloc->p_filesz, 0, reloc->p_memsz - reloc->p_filesz);
+
+    // pointers in the dynamic table are virtual addresses within the full
+    // segment, and so is the table itself
+    struct Elf32_Dyn *dyn = (struct Elf32_Dyn *)
+        (full_data + (dynamic->p_vaddr - full->p_vaddr));
+    size_t ndyn = dynamic->p_filesz / sizeof(struct Elf32_Dyn);
+
+    char *rel_base = NULL;
+    size_t relsz = 0, relent = sizeof(struct Elf32_Rel);
+    for (size_t i = 0; i < ndyn; i++) {
+        switch (dyn[i].d_tag) {
+        case DT_RELA:
+            // the CPU driver only uses REL relocations
+            return ELF_ERR_HEADER;
+        case DT_REL:
+            rel_base = full_data + (dyn[i].d_un.d_ptr - full->p_vaddr);
+            break;
+        case DT_RELSZ:
+            relsz = dyn[i].d_un.d_val;
+            break;
+        case DT_RELENT:
+            relent = dyn[i].d_un.d_val;
+            break;
+        }
+    }
+    if (rel_base == NULL && relsz > 0) {
+        return ELF_ERR_HEADER;
+    }
+
+    lvaddr_t seg_start = reloc->p_vaddr, seg_end = seg_start + reloc->p_memsz;
+    for (size_t i = 0; i < relsz / relent; i++) {
+        struct Elf32_Rel *rel = (struct Elf32_Rel *)(rel_base + i * relent);
+
+        // relocations in the shared part were applied when the BSP kernel
+        // was loaded
+        if (rel->r_offset < seg_start || rel->r_offset >= seg_end) {
+            continue;
+        }
+        if (ELF32_R_TYPE(rel->r_info) != R_ARM_RELATIVE) {
+            return ELF_ERR_HEADER;
+        }
+
+        uint32_t *value = (uint32_t *)((char *)out + (rel->r_offset - seg_start));
+        if (*value >= seg_start && *value < seg_end) {
+            *value = vbase + (*value - seg_start);
+        } else {
+            *value += text_offset;
+        }
+    }
+
+    struct Elf32_Shdr *got = elf32_find_section_header_name((genvaddr_t)elf,
+                                                            elf_bytes, ".got");
+    if (got == NULL) {
+        return ELF_ERR_HEADER;
+    }
+    *got_base = vbase + (got->sh_addr - seg_start);
+
+    return SYS_ERR_OK;
+}
+
+/// Map a multiboot module, returning its frame identity
+static errval_t map_module(const char *name, struct mem_region **ret_module,
+                           struct frame_identity *ret_id, void **ret_buf)
+{
+    struct mem_region *module = multiboot_find_module(bi, name);
+    if (module == NULL) {
+        return SPAWN_ERR_FIND_MODULE;
+    }
+
+    struct capref frame = {
+        .cnode = cnode_module,
+        .slot = module->mrmod_slot,
+    };
+    CHECK("identifying module", frame_identify(frame, ret_id));
+    if (ret_buf != NULL) {
+        CHECK("mapping module",
+              paging_map_frame_attr(get_current_paging_state(), ret_buf,
+                                    ret_id->bytes, frame, VREGION_FLAGS_READ,
+                                    NULL, NULL));
+    }
+    *ret_module = module;
+    return SYS_ERR_OK;
+}
+
+/// Allocate and map a frame, returning its physical base
+static errval_t alloc_mapped_frame(size_t bytes, struct capref *ret_frame,
+                                   struct frame_identity *ret_id, void **ret_buf)
+{
+    size_t retbytes;
+    CHECK("frame_alloc", frame_alloc(ret_frame, bytes, &retbytes));
+    CHECK("frame_identify", frame_identify(*ret_frame, ret_id));
+    CHECK("mapping frame",
+          paging_map_frame(get_current_paging_state(), ret_buf, retbytes,
+                           *ret_frame, NULL, NULL));
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief Boot another core, with its own KCB, CPU driver data and init
+ *
+ * Physical and kernel-virtual addresses are the same on the ARMv7 platforms
+ * we boot on (RAM at 2GB, mapped 1:1 by the kernel window), so frame bases
+ * are handed to the new kernel as they are.
+ *
+ * \param mpid          Hardware ID of the core to boot
+ * \param cpu_driver    Multiboot module name of the CPU driver
+ * \param init          Multiboot module name of the init to run on it
+ * \param urpc_frame_id Frame shared with the new core's init
+ */
+errval_t coreboot(coreid_t mpid, const char *cpu_driver, const char *init,
+                  struct frame_identity urpc_frame_id)
+{
+    // the new core's kernel control block
+    struct capref kcb_ram, kcb;
+    CHECK("allocating KCB memory",
+          ram_alloc_aligned(&kcb_ram, OBJSIZE_KCB, 4 * BASE_PAGE_SIZE));
+    CHECK("slot_alloc", slot_alloc(&kcb));
+    CHECK("creating KCB",
+          cap_retype(kcb, kcb_ram, 0, ObjType_KernelControlBlock,
+                     OBJSIZE_KCB, 1));
+    struct frame_identity kcb_id;
+    CHECK("identifying KCB", frame_identify(kcb, &kcb_id));
+
+    // its core data, starting with the parts shared with this kernel
+    struct capref cd_frame;
+    struct frame_identity cd_id;
+    struct arm_core_data *cd;
+    CHECK("allocating core data",
+          alloc_mapped_frame(BASE_PAGE_SIZE, &cd_frame, &cd_id, (void **)&cd));
+    CHECK("cloning core data", invoke_kcb_clone(kcb, cd_frame));
+
+    // a private copy of the CPU driver's data segment
+    struct mem_region *cpu_module;
+    struct frame_identity cpu_id;
+    void *cpu_elf;
+    CHECK("mapping CPU driver",
+          map_module(cpu_driver, &cpu_module, &cpu_id, &cpu_elf));
+    struct Elf32_Phdr *reloc = find_segment(cpu_elf, PT_BF_RELOC);
+    if (reloc == NULL) {
+        return INIT_ERR_CPU_DRIVER_RELOC;
+    }
+
+    struct capref seg_frame;
+    struct frame_identity seg_id;
+    void *seg;
+    CHECK("allocating CPU driver segment",
+          alloc_mapped_frame(ROUND_UP(reloc->p_memsz, BASE_PAGE_SIZE),
+                             &seg_frame, &seg_id, &seg));
+    errval_t err = load_cpu_relocatable_segment(cpu_elf, cpu_module->mrmod_size,
+                                                seg, seg_id.base,
+                                                cd->kernel_load_base,
+                                                &cd->got_base);
+    if (err_is_fail(err)) {
+        return err_push(err, INIT_ERR_CPU_DRIVER_RELOC);
+    }
+
+    // the init image, which the new kernel loads itself
+    struct mem_region *init_module;
+    struct frame_identity init_id;
+    CHECK("finding init", map_module(init, &init_module, &init_id, NULL));
+    cd->monitor_module.mod_start = init_id.base;
+    cd->monitor_module.mod_end = init_id.base + init_module->mrmod_size - 1;
+    cd->monitor_module.string = 0;
+    cd->monitor_module.reserved = 0;
+
+    // memory for the kernel to build that init's initial structures in
+    struct capref init_mem;
+    struct frame_identity init_mem_id;
+    CHECK("allocating init memory",
+          ram_alloc(&init_mem, COREBOOT_INIT_MEM_BYTES));
+    CHECK("identifying init memory", frame_identify(init_mem, &init_mem_id));
+    cd->memory_base_start = init_mem_id.base;
+    cd->memory_bytes = init_mem_id.bytes;
+
+    cd->urpc_frame_base = urpc_frame_id.base;
+    cd->urpc_frame_size = urpc_frame_id.bytes;
+    cd->chan_id = 0;
+
+    cd->kcb = kcb_id.base;
+    cd->cmdline = cd_id.base + offsetof(struct arm_core_data, cmdline_buf);
+    cd->src_core_id = disp_get_core_id();
+    cd->dst_core_id = mpid;
+    cd->src_arch_id = disp_get_core_id();
+
+    // the boot driver reads the core data with its caches off
+    CHECK("flushing caches", sys_debug_flush_cache());
+
+    err = invoke_monitor_spawn_core(cap_kernel, mpid, CPU_ARM7, cd_id.base);
+    if (err_is_fail(err)) {
+        return err_push(err, INIT_ERR_BOOT_CORE);
+    }
+
+    return SYS_ERR_OK;
+}
@@ -0,0 +1,27 @@
+/**
+ * \file
+ * \brief Booting additional cores from init
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetsstrasse 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#ifndef _INIT_COREBOOT_H_
+#define _INIT_COREBOOT_H_
+
+#include <aos/aos.h>
+#include <barrelfish_kpi/arm_core_data.h>
+
+/// Memory handed to the new core's kernel for its init's structures
+#define COREBOOT_INIT_MEM_BYTES (ARM_CORE_DATA_PAGES * BASE_PAGE_SIZE)
+
+errval_t coreboot(coreid_t mpid, const char *cpu_driver, const char *init,
+                  struct frame_identity urpc_frame_id);
+
+#endif /* _INIT_COREBOOT_H_ */
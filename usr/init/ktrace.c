@@ -0,0 +1,121 @@
+/**
+ * \file
+ * \brief Dumping the kernel's event trace
+ *
+ * Init gives the kernel of its core a trace buffer, see
+ * barrelfish_kpi/ktrace.h, and periodically prints the records added to it
+ * since the last dump, as lines of
+ *
+ *     KTRACE <core> hz <timestamp rate>
+ *     KTRACE <core> disp <index> <name>
+ *     KTRACE <core> rec <timestamp> <event> <disp> <peer> <arg>
+ *     KTRACE <core> lost <records>
+ *
+ * with the numbers of records in hex. Tracing is paused while dumping, so
+ * the trace doesn't fill up with the dump's own system calls. tools/ktrace
+ * turns a console log with these lines into a timeline.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetsstrasse 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <aos/aos.h>
+#include <aos/deferred.h>
+#include <aos/paging.h>
+#include <barrelfish_kpi/ktrace.h>
+
+#include "ktrace.h"
+
+static struct capref ktrace_frame;
+static struct ktrace_buffer *ktrace_buf;
+static uint32_t ktrace_tail;                ///< Records dumped so far
+static uint32_t ktrace_dispatchers;         ///< Dispatchers named so far
+static struct periodic_event ktrace_event;
+
+/**
+ * \brief Print the records the kernel added since the last dump
+ */
+void ktrace_dump(void)
+{
+    struct ktrace_buffer *buf = ktrace_buf;
+    if (buf == NULL) {
+        return;
+    }
+
+    uint32_t mask = buf->mask;
+    buf->mask = 0;
+
+    coreid_t core = disp_get_core_id();
+    uint32_t head = buf->head;
+    if (head - ktrace_tail > buf->nrecords) {
+        printf("KTRACE %" PRIuCOREID " lost %" PRIu32 "\n", core,
+               head - ktrace_tail - buf->nrecords);
+        ktrace_tail = head - buf->nrecords;
+    }
+
+    // records name dispatchers only after they're in the table
+    uint32_t ndispatchers = buf->ndispatchers;
+    for (; ktrace_dispatchers < ndispatchers; ktrace_dispatchers++) {
+        const char *name = buf->dispatchers[ktrace_dispatchers].name;
+        printf("KTRACE %" PRIuCOREID " disp %" PRIu32 " %.*s\n", core,
+               ktrace_dispatchers, (int)strnlen(name, DISP_NAME_LEN), name);
+    }
+
+    for (; ktrace_tail != head; ktrace_tail++) {
+        struct ktrace_record *r =
+            &buf->records[ktrace_tail & (buf->nrecords - 1)];
+        printf("KTRACE %" PRIuCOREID " rec %" PRIx64 " %x %x %x %" PRIx32
+               "\n", core, r->ts, r->event, r->disp, r->peer, r->arg);
+    }
+
+    buf->mask = mask;
+}
+
+static void ktrace_event_handler(void *arg)
+{
+    ktrace_dump();
+}
+
+/**
+ * \brief Trace the subsystems in 'mask' on this core, and dump the trace
+ * every 'period' us from the default waitset
+ */
+errval_t ktrace_start(uint32_t mask, delayus_t period)
+{
+    errval_t err;
+
+    size_t bytes;
+    err = frame_alloc(&ktrace_frame, KTRACE_BUFFER_SIZE, &bytes);
+    if (err_is_fail(err)) {
+        return err_push(err, LIB_ERR_FRAME_ALLOC);
+    }
+
+    void *buf;
+    err = paging_map_frame(get_current_paging_state(), &buf, bytes,
+                           ktrace_frame, NULL, NULL);
+    if (err_is_fail(err)) {
+        return err_push(err, LIB_ERR_VSPACE_MAP);
+    }
+
+    err = invoke_kernel_setup_trace(cap_kernel, ktrace_frame, mask);
+    if (err_is_fail(err)) {
+        return err;
+    }
+    ktrace_buf = buf;
+    ktrace_tail = 0;
+    ktrace_dispatchers = 0;
+
+    printf("KTRACE %" PRIuCOREID " hz %" PRIu32 "\n", disp_get_core_id(),
+           ktrace_buf->tick_hz);
+    return periodic_event_create(&ktrace_event, get_default_waitset(), period,
+                                 MKCLOSURE(ktrace_event_handler, NULL));
+}
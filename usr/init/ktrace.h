@@ -0,0 +1,27 @@
+/**
+ * \file
+ * \brief Dumping the kernel's event trace
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetsstrasse 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#ifndef _INIT_KTRACE_H_
+#define _INIT_KTRACE_H_
+
+#include <aos/aos.h>
+#include <barrelfish_kpi/ktrace.h>
+
+/// Size of the trace buffer, records are 16 bytes each
+#define KTRACE_BUFFER_SIZE      (256 * 1024)
+
+errval_t ktrace_start(uint32_t mask, delayus_t period);
+void ktrace_dump(void);
+
+#endif /* _INIT_KTRACE_H_ */
@@ -24,6 +24,11 @@
 
 #include <mm/mm.h>
 #include "mem_alloc.h"
+#include "ktrace.h"
+#include "multicore.h"
+#include "profile.h"
+#include "top.h"
+#include "zero_pool.h"
 #include <spawn/spawn.h>
 
 coreid_t my_core_id;
@@ -31,63 +36,323 @@ struct bootinfo *bi;
 
 #define MAX_CLIENT_RAM 64 * 1024 * 1024
 
+// Number of worker threads serving client channels. With 0, everything runs
+// on the main thread and the default waitset.
+#define INIT_WORKER_THREADS 2
+
+// How often to dump the statistics of the dispatchers we run, in seconds.
+// With 0, they're never dumped.
+#define INIT_TOP_PERIOD 0
+
+// How often to print the kernel's PC samples of this core, in seconds. With
+// 0, the kernel doesn't take any.
+#define INIT_PROFILE_PERIOD 0
+
+// How often to print the kernel's event trace of this core, in seconds, and
+// which subsystems to trace. With 0, nothing is traced.
+#define INIT_KTRACE_PERIOD 0
+#define INIT_KTRACE_MASK KTRACE_SUBSYS_ALL
+
+// How often to zero more of the pool of RAM handed out pre-zeroed, in
+// milliseconds. With 0, there's no pool and the kernel zeroes all new frames
+// when they are retyped.
+#define INIT_ZERO_POOL_PERIOD 10
+
+/**
+ * \brief A worker thread, dispatching events on its own waitset.
+ */
+struct worker {
+    struct thread* thread;
+    struct waitset ws;
+};
+static struct worker workers[INIT_WORKER_THREADS];
+
 struct client_state {
-    struct lmp_chan lc;  // LMP channel.
-    char* str_buf;       // buffer for send_string messages.
-    size_t str_buf_idx;  // current index in string buffer.
-    size_t ram;          // how much RAM this client's currently holding.
-} *clients = NULL;
+    struct lmp_chan lc;        // LMP channel.
+    // Responses not yet sent, in FIFO order. A client never has more than
+    // AOS_RPC_WINDOW requests in flight, so this never overflows.
+    struct aos_rpc_response resp[AOS_RPC_WINDOW];
+    uintptr_t resp_tag[AOS_RPC_WINDOW];  // tag of each queued response.
+    bool resp_giveaway[AOS_RPC_WINDOW];  // whether to hand over resp->cap.
+    size_t resp_head;          // index of the first queued response.
+    size_t resp_count;         // number of queued responses.
+    bool send_registered;      // whether send_responses is registered.
+    struct capref bulk_frame;  // frame shared with the client for bulk data.
+    char* bulk_buf;            // init's mapping of bulk_frame.
+    size_t bulk_size;          // size of bulk_frame in bytes.
+    size_t ram;                // how much RAM this client's currently holding.
+    uint32_t id;               // index into client_table, sent with requests.
+    struct waitset* ws;        // waitset of the thread serving this client.
+};
+
+// Client records come from a slab, so they never move once handed out.
+// client_table maps client IDs to records and grows by doubling. Workers
+// look clients up while the main thread adds them, so it has a lock.
+static struct slab_allocator client_slabs;
+static struct client_state** client_table = NULL;
+static size_t client_table_size = 0;
+static struct thread_mutex client_table_lock = THREAD_MUTEX_INITIALIZER;
 size_t num_conns;
 
+/**
+ * \brief Handler for one request opcode. `cap` is the cap that came with the
+ * request (NULL_CAP if none); `resp` is the queued response, preset to ACK.
+ */
+typedef void (*request_handler_t)(struct client_state* client,
+        struct lmp_recv_msg* msg, struct capref cap,
+        struct aos_rpc_response* resp);
+
+// Opcodes are single bits, so handlers are indexed by bit position.
+#define MAX_REQUEST_HANDLERS 32
+static request_handler_t request_handlers[MAX_REQUEST_HANDLERS];
+
+errval_t handshake_handler(void* arg);
 errval_t recv_handler(void* arg);
 
-uintptr_t* process_handshake_request(struct lmp_chan* lc,
-        struct capref* remote_cap);
-uintptr_t* process_memory_request(struct lmp_recv_msg* msg,
-        struct capref* remote_cap);
-uintptr_t* process_number_request(struct lmp_recv_msg* msg);
-uintptr_t* process_putchar_request(struct lmp_recv_msg* msg);
-uintptr_t* process_string_request(struct lmp_recv_msg* msg);
+struct client_state* client_create(struct capref remote_cap);
+void process_handshake_request(struct client_state* client,
+        struct lmp_recv_msg* msg, struct capref cap,
+        struct aos_rpc_response* resp);
+void process_bulk_request(struct client_state* client,
+        struct lmp_recv_msg* msg, struct capref cap,
+        struct aos_rpc_response* resp);
+void process_memory_request(struct client_state* client,
+        struct lmp_recv_msg* msg, struct capref cap,
+        struct aos_rpc_response* resp);
+void process_memory_batch_request(struct client_state* client,
+        struct lmp_recv_msg* msg, struct capref cap,
+        struct aos_rpc_response* resp);
+void process_number_request(struct client_state* client,
+        struct lmp_recv_msg* msg, struct capref cap,
+        struct aos_rpc_response* resp);
+void process_putchar_request(struct client_state* client,
+        struct lmp_recv_msg* msg, struct capref cap,
+        struct aos_rpc_response* resp);
+void process_string_request(struct client_state* client,
+        struct lmp_recv_msg* msg, struct capref cap,
+        struct aos_rpc_response* resp);
+
+errval_t send_responses(void* arg);
 
-errval_t send_handshake(void* void_args);
-errval_t send_memory(void* void_args);
-errval_t send_simple_ok(void* void_args);
+/**
+ * \brief Register `handler` for requests with opcode `code`.
+ */
+static void register_request_handler(uintptr_t code, request_handler_t handler)
+{
+    assert(code != 0 && (code & (code - 1)) == 0);
+    size_t idx = __builtin_ctz(code);
+    assert(idx < MAX_REQUEST_HANDLERS);
+    request_handlers[idx] = handler;
+}
 
-uintptr_t* process_handshake_request(struct lmp_chan *lc,
-        struct capref* remote_cap)
+/**
+ * \brief Look up the handler for opcode `code`, NULL if there is none.
+ */
+static inline request_handler_t lookup_request_handler(uintptr_t code)
 {
-    // Create channel for newly connecting client.
-    if (clients == NULL) {
-        clients = malloc(sizeof(struct client_state));
-    } else {
-        realloc(clients, (num_conns + 1) * sizeof(struct client_state));
+    if (code == 0 || (code & (code - 1)) != 0) {
+        return NULL;
+    }
+    size_t idx = __builtin_ctz(code);
+    return idx < MAX_REQUEST_HANDLERS ? request_handlers[idx] : NULL;
+}
+
+/**
+ * \brief Worker thread main loop: serve the channels assigned to it.
+ */
+static int worker_main(void* arg)
+{
+    struct worker* worker = (struct worker*) arg;
+    while (true) {
+        errval_t err = event_dispatch(&worker->ws);
+        if (err_is_fail(err)) {
+            DEBUG_ERR(err, "in worker event_dispatch");
+        }
+    }
+    return 0;
+}
+
+/**
+ * \brief Start the worker pool.
+ */
+static errval_t workers_start(void)
+{
+    for (int i = 0; i < INIT_WORKER_THREADS; ++i) {
+        waitset_init(&workers[i].ws);
+        workers[i].thread = thread_create(worker_main, &workers[i]);
+        if (workers[i].thread == NULL) {
+            return LIB_ERR_THREAD_CREATE;
+        }
+    }
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief Pick the waitset to serve client `id` from, round-robin over workers.
+ */
+static struct waitset* client_waitset(uint32_t id)
+{
+#if INIT_WORKER_THREADS > 0
+    return &workers[id % INIT_WORKER_THREADS].ws;
+#else
+    return get_default_waitset();
+#endif
+}
+
+/**
+ * \brief Register send_responses for `client` unless it already is.
+ */
+static errval_t client_register_send(struct client_state* client)
+{
+    if (client->send_registered) {
+        return SYS_ERR_OK;
+    }
+    // Set first: once registered, the client's thread may run it right away.
+    client->send_registered = true;
+    errval_t err = lmp_chan_register_send(&client->lc, client->ws,
+            MKCLOSURE((void*) send_responses, client));
+    if (err_is_fail(err)) {
+        client->send_registered = false;
+    }
+    return err;
+}
+
+/**
+ * \brief Queue a response to request `tag`, initialized to a plain ACK.
+ */
+static struct aos_rpc_response* response_enqueue(struct client_state* client,
+        uintptr_t tag)
+{
+    assert(client->resp_count < AOS_RPC_WINDOW);
+    size_t idx = (client->resp_head + client->resp_count) % AOS_RPC_WINDOW;
+    ++client->resp_count;
+
+    struct aos_rpc_response* resp = &client->resp[idx];
+    client->resp_tag[idx] = tag;
+    client->resp_giveaway[idx] = false;
+    resp->status = AOS_RPC_OK;
+    resp->err = SYS_ERR_OK;
+    resp->cap = NULL_CAP;
+    for (int i = 0; i < AOS_RPC_PAYLOAD_WORDS; ++i) {
+        resp->u.words[i] = 0;
+    }
+    return resp;
+}
+
+/**
+ * \brief Move `resp`'s cap to the client when sending it, rather than copying.
+ */
+static void response_giveaway(struct client_state* client,
+        struct aos_rpc_response* resp)
+{
+    client->resp_giveaway[resp - client->resp] = true;
+}
+
+/**
+ * \brief Look up the client with ID `id`, NULL if there is none.
+ */
+static struct client_state* client_lookup(uint32_t id)
+{
+    struct client_state* client = NULL;
+    thread_mutex_lock(&client_table_lock);
+    if (id < num_conns) {
+        client = client_table[id];
+    }
+    thread_mutex_unlock(&client_table_lock);
+    return client;
+}
+
+/**
+ * \brief Set up the state for a newly connecting client, whose endpoint is
+ * `remote_cap`. Returns NULL if we're out of memory.
+ */
+struct client_state* client_create(struct capref remote_cap)
+{
+    // Make room for the new ID first, so a failure leaves nothing behind.
+    // Only the main thread adds clients, so only the move needs the lock.
+    if (num_conns == client_table_size) {
+        size_t new_size = client_table_size == 0 ? 16 : 2 * client_table_size;
+        thread_mutex_lock(&client_table_lock);
+        struct client_state** new_table = realloc(client_table,
+                new_size * sizeof(struct client_state*));
+        if (new_table != NULL) {
+            client_table = new_table;
+            client_table_size = new_size;
+        }
+        thread_mutex_unlock(&client_table_lock);
+        if (new_table == NULL) {
+            return NULL;
+        }
+    }
+
+    struct client_state* client = slab_alloc(&client_slabs);
+    if (client == NULL) {
+        return NULL;
     }
 
     // Initialize client state.
-    clients[num_conns].ram = 0;
-    clients[num_conns].str_buf = NULL;
-    clients[num_conns].str_buf_idx = 0;
-
-    // New channel.
-    lmp_chan_accept(&clients[num_conns].lc, DEFAULT_LMP_BUF_WORDS, *remote_cap);
-    lmp_chan_alloc_recv_slot(&clients[num_conns].lc);
-    lmp_chan_register_recv(&clients[num_conns].lc, get_default_waitset(),
-            MKCLOSURE((void*) recv_handler, &clients[num_conns].lc));
-
-    // Fill in response args.
-    uintptr_t* args = (uintptr_t*) malloc(2 * sizeof(uintptr_t));
-    // First arg is the channel to send the response down.
-    args[0] = (uintptr_t) ((struct lmp_chan*) malloc(sizeof(struct lmp_chan)));
-    *((struct lmp_chan*) args[0]) = clients[num_conns].lc;
-
-    // Second arg is the 32-bit client tag (ID).
-    args[1] = (uintptr_t) ((uint32_t*) malloc(sizeof(uint32_t)));                
-    *((uint32_t*) args[1]) = num_conns;
+    client->id = num_conns;
+    client->ws = client_waitset(client->id);
+    client->ram = 0;
+    client->resp_head = client->resp_count = 0;
+    client->send_registered = false;
+
+    // Bulk frame shared with the client for strings and buffers.
+    errval_t err = frame_alloc(&client->bulk_frame, AOS_RPC_BULK_SIZE,
+            &client->bulk_size);
+    if (err_is_ok(err)) {
+        err = paging_map_frame(get_current_paging_state(),
+                (void**) &client->bulk_buf, client->bulk_size,
+                client->bulk_frame, NULL, NULL);
+    }
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "setting up bulk frame for client");
+        client->bulk_frame = NULL_CAP;
+        client->bulk_buf = NULL;
+        client->bulk_size = 0;
+    }
+
+    // New channel, whose endpoint is private to this client. It's served by
+    // the client's thread, so the client itself is the closure argument.
+    lmp_chan_accept(&client->lc, AOS_RPC_BUF_WORDS, remote_cap);
+    lmp_chan_alloc_recv_slot(&client->lc);
+    lmp_chan_register_recv(&client->lc, client->ws,
+            MKCLOSURE((void*) recv_handler, client));
 
     // Keep track o incremented number of connections.
-    ++num_conns;
+    thread_mutex_lock(&client_table_lock);
+    client_table[num_conns++] = client;
+    thread_mutex_unlock(&client_table_lock);
+
+    return client;
+}
 
-    return args;
+/**
+ * \brief Answer a handshake with the client's 32-bit ID and the endpoint to
+ * send all further requests to.
+ */
+void process_handshake_request(struct client_state* client,
+        struct lmp_recv_msg* msg, struct capref cap,
+        struct aos_rpc_response* resp)
+{
+    resp->cap = client->lc.local_cap;
+    resp->u.handshake.client_id = client->id;
+}
+
+/**
+ * \brief Hand out the client's bulk frame and its size.
+ */
+void process_bulk_request(struct client_state* client,
+        struct lmp_recv_msg* msg, struct capref cap,
+        struct aos_rpc_response* resp)
+{
+    if (capref_is_null(client->bulk_frame)) {
+        resp->status = AOS_RPC_FAILED;
+        resp->err = LIB_ERR_RPC_NO_BULK;
+        return;
+    }
+    resp->cap = client->bulk_frame;
+    resp->u.bytes = client->bulk_size;
 }
 
 /**
@@ -97,231 +362,273 @@ uintptr_t* process_handshake_request(struct lmp_chan *lc,
  * Namely, message format is (request_id_ram, client_id, size_requested).
  * The requested size is rounded to BASE_PAGE_SIZE and limited to 64 MB.
  */
-uintptr_t* process_memory_request(struct lmp_recv_msg* msg,
-        struct capref* remote_cap)
+void process_memory_request(struct client_state* client,
+        struct lmp_recv_msg* msg, struct capref cap,
+        struct aos_rpc_response* resp)
 {
-    uint32_t conn = msg->words[1];
     size_t req_size = (size_t) msg->words[2];
     req_size = ROUND_UP(req_size, BASE_PAGE_SIZE);
     if (req_size == 0) {
         // Waht?!
         req_size = BASE_PAGE_SIZE;
     }
-    if (req_size + clients[conn].ram >= MAX_CLIENT_RAM) {
+    if (req_size + client->ram >= MAX_CLIENT_RAM) {
         // Limit to 64 MB.
-        req_size = MAX_CLIENT_RAM - clients[conn].ram;
+        req_size = MAX_CLIENT_RAM - client->ram;
     }
 
     // Allocate frame.
 
-    errval_t err = ram_alloc(remote_cap, req_size);//frame_alloc(remote_cap, req_size, &ret_size);
-    clients[conn].ram += req_size;
+    errval_t err = ram_alloc(&resp->cap, req_size);
+    client->ram += req_size;
 
-    // Response args.
-    // 1. Channel to send down.
-    // 2. Error code from frame_alloc.
-    // 3. Cap for memory.
-    // 4. Returned size.
-    uintptr_t* args = (uintptr_t*) malloc(4 * sizeof(uintptr_t));
-    args[0] = (uintptr_t) ((struct lmp_chan*) malloc(sizeof(struct lmp_chan)));
-    *((struct lmp_chan*) args[0]) = clients[conn].lc;
+    // Response is (code, error from ram_alloc, returned size) plus the cap.
+    resp->status = err_is_fail(err) ? AOS_RPC_FAILED : AOS_RPC_OK;
+    resp->err = err;
+    resp->u.bytes = req_size;
+}
 
-    args[1] = (uintptr_t) ((errval_t*) malloc(sizeof(errval_t)));
-    *((errval_t*) args[1]) = err;
+/**
+ * \brief Handle a batched RAM request: (request_id_ram_batch, client_id,
+ * bytes per cap, number of caps).
+ * All caps are retyped from one contiguous region into slots 0 to count - 1
+ * of a new L2 CNode, which is charged to the client's RAM budget and given
+ * away with the response, so that init keeps no hold on its slots.
+ */
+void process_memory_batch_request(struct client_state* client,
+        struct lmp_recv_msg* msg, struct capref cap,
+        struct aos_rpc_response* resp)
+{
+    resp->status = AOS_RPC_FAILED;
+    resp->err = LIB_ERR_RAM_ALLOC;
+    resp->u.ram_batch.count = 0;
+
+    size_t bytes = (size_t) msg->words[2];
+    size_t count = MIN((size_t) msg->words[3], L2_CNODE_SLOTS);
+    if (bytes > MAX_CLIENT_RAM || count == 0) {
+        return;
+    }
+    bytes = ROUND_UP(bytes, BASE_PAGE_SIZE);
+    if (bytes == 0) {
+        bytes = BASE_PAGE_SIZE;
+    }
+
+    // The client's budget covers the batch and its CNode. Divide rather
+    // than multiply, so a large request can't wrap around.
+    size_t left = MAX_CLIENT_RAM - client->ram;
+    if (OBJSIZE_L2CNODE > left ||
+        bytes > (left - OBJSIZE_L2CNODE) / count) {
+        return;
+    }
 
-    args[2] = (uintptr_t) ((struct capref*) malloc(sizeof(struct capref)));
-    *((struct capref*) args[2]) = *remote_cap;
+    struct capref cn_cap;
+    struct cnoderef cn;
+    errval_t err = cnode_create_l2(&cn_cap, &cn);
+    if (err_is_fail(err)) {
+        resp->err = err;
+        return;
+    }
 
-    args[3] = (uintptr_t) ((size_t*) malloc(sizeof(size_t)));
-    *((size_t*) args[3]) = req_size;
+    struct capref region;
+    err = ram_alloc(&region, bytes * count);
+    if (err_is_fail(err)) {
+        cap_destroy(cn_cap);
+        resp->err = err;
+        return;
+    }
 
-    return args;
+    struct capref dest = {
+        .cnode = cn,
+        .slot = 0
+    };
+    err = cap_retype(dest, region, 0, ObjType_RAM, bytes, count);
+    if (err_is_fail(err)) {
+        cap_destroy(cn_cap);
+        aos_ram_free(region, bytes * count);
+        resp->err = err;
+        return;
+    }
+    // The retyped caps keep the memory alive; drop our handle on the region.
+    cap_destroy(region);
+    client->ram += OBJSIZE_L2CNODE + bytes * count;
+
+    // Response is (code, err, number of caps), plus the CNode.
+    resp->status = AOS_RPC_OK;
+    resp->err = SYS_ERR_OK;
+    resp->u.ram_batch.count = count;
+    resp->cap = cn_cap;
+    response_giveaway(client, resp);
 }
 
-uintptr_t* process_number_request(struct lmp_recv_msg* msg)
+void process_number_request(struct client_state* client,
+        struct lmp_recv_msg* msg, struct capref cap,
+        struct aos_rpc_response* resp)
 {
-    uint32_t conn = msg->words[1];
-    // Fill in response args.
-    uintptr_t* args = (uintptr_t*) malloc(sizeof(uintptr_t));
-    // First arg is the channel to send the response down.
-    args[0] = (uintptr_t) ((struct lmp_chan*) malloc(sizeof(struct lmp_chan)));
-    *((struct lmp_chan*) args[0]) = clients[conn].lc;
-
     // Print what we got.
     uint32_t number = msg->words[2];
-    debug_printf("Client ID %u sent number %u\n", conn, number);
-
-    return args;
+    debug_printf("Client ID %u sent number %u\n", (uint32_t) msg->words[1],
+            number);
 }
 
-uintptr_t* process_putchar_request(struct lmp_recv_msg* msg)
+void process_putchar_request(struct client_state* client,
+        struct lmp_recv_msg* msg, struct capref cap,
+        struct aos_rpc_response* resp)
 {
     // Put character.
     sys_print((char*) &msg->words[2], 1);
-
-    uint32_t conn = msg->words[1];
-    // Fill in response args.
-    uintptr_t* args = (uintptr_t*) malloc(sizeof(sizeof(uintptr_t)));
-    // First arg is the channel to send the response down.
-    args[0] = (uintptr_t) ((struct lmp_chan*) malloc(sizeof(struct lmp_chan)));
-    *((struct lmp_chan*) args[0]) = clients[conn].lc;
-
-    return args;
 }
 
-uintptr_t* process_string_request(struct lmp_recv_msg* msg)
+/**
+ * \brief Process a string request by printing it straight out of the
+ * client's bulk frame.
+ * Message format is (request_id_string, client_id, offset, length).
+ */
+void process_string_request(struct client_state* client,
+        struct lmp_recv_msg* msg, struct capref cap,
+        struct aos_rpc_response* resp)
 {
-    uint32_t conn = msg->words[1];
-    uint32_t remaining = msg->words[2];
+    size_t offset = (size_t) msg->words[2];
+    size_t len = (size_t) msg->words[3];
 
-    if (clients[conn].str_buf == NULL) {
-        clients[conn].str_buf = (char*) malloc(remaining * sizeof(char));
-        clients[conn].str_buf_idx = 0;
-    }
-
-    size_t stop = remaining < 24 ? remaining : 24;
-    for (size_t i = 0; i < stop; ++i) {
-        uint32_t word = msg->words[3 + i / 4];
-        clients[conn].str_buf[clients[conn].str_buf_idx++] =
-                (char) (word >> (8 * (i % 4)));
-    }
-
-    remaining -= stop;
-    if (remaining == 0) {
-        // Print and reset.
-        sys_print(clients[conn].str_buf, clients[conn].str_buf_idx);
-        clients[conn].str_buf_idx = 0;
-        free(clients[conn].str_buf);
-        clients[conn].str_buf = NULL;
+    if (offset > client->bulk_size || len > client->bulk_size - offset) {
+        debug_printf("Client ID %u sent string out of bulk frame bounds\n",
+                (uint32_t) msg->words[1]);
+        resp->status = AOS_RPC_FAILED;
+    } else {
+        sys_print(client->bulk_buf + offset, len);
     }
-
-    // Fill in response args.
-    uintptr_t* args = (uintptr_t*) malloc(sizeof(sizeof(uintptr_t)));
-    // First arg is the channel to send the response down.
-    args[0] = (uintptr_t) ((struct lmp_chan*) malloc(sizeof(struct lmp_chan)));
-    *((struct lmp_chan*) args[0]) = clients[conn].lc;
-
-    return args;
 }
 
-errval_t recv_handler(void* arg)
+/**
+ * \brief Handle a message on init's shared endpoint, where new clients send
+ * their handshake. Runs on the main thread.
+ */
+errval_t handshake_handler(void* arg)
 {
     struct lmp_chan* lc = (struct lmp_chan*) arg;
     struct lmp_recv_msg msg = LMP_RECV_MSG_INIT;
-    // printf("msg buflen %d\n", msg.buf.buflen);
     struct capref cap;
     errval_t err = lmp_chan_recv(lc, &msg, &cap);
-    
+
     // Reregister.
     CHECK("Create Slot", lmp_chan_alloc_recv_slot(lc));
     lmp_chan_register_recv(lc, get_default_waitset(),
-            MKCLOSURE((void *)recv_handler, arg));
+            MKCLOSURE((void *)handshake_handler, arg));
 
-    // debug_printf("main.c: got message of size %u\n", msg.buf.msglen);
     if (msg.buf.msglen > 0) {
-        void* response;
-        // debug_printf("init.c: msg buflen %zu\n", msg.buf.msglen);
-        // debug_printf("init.c: msg->words[0] = %d\n", msg.words[0]);
-        uintptr_t* response_args;
-        switch (msg.words[0]) {
-            case AOS_RPC_HANDSHAKE:
-                response = (void*) send_handshake;
-                response_args = process_handshake_request(lc, &cap);
-                break;
-            case AOS_RPC_MEMORY:
-                response = (void*) send_memory;
-                response_args = process_memory_request(&msg, &cap);
-                break;
-            case AOS_RPC_NUMBER:
-                response = (void*) send_simple_ok;
-                response_args = process_number_request(&msg);
-                break;
-            case AOS_RPC_PUTCHAR:
-                response = (void*) send_simple_ok;
-                response_args = process_putchar_request(&msg);
-                break;
-            case AOS_RPC_STRING:
-                response = (void*) send_simple_ok;
-                response_args = process_string_request(&msg);
-                break;
-            default:
-                return 1;  // TODO: More meaning plz
+        uintptr_t code = AOS_RPC_CODE(msg.words[0]);
+        uintptr_t tag = AOS_RPC_TAG(msg.words[0]);
+        if (code != AOS_RPC_HANDSHAKE) {
+            // Everything else goes to the client's private endpoint.
+            return LIB_ERR_RPC_NO_CLIENT;
         }
 
-        CHECK("lmp_chan_register_send parent",
-                lmp_chan_register_send(lc, get_default_waitset(),
-                        MKCLOSURE(response, response_args)));  
+        struct client_state* client = client_create(cap);
+        if (client == NULL) {
+            return LIB_ERR_MALLOC_FAIL;
+        }
+        struct aos_rpc_response* resp = response_enqueue(client, tag);
+        process_handshake_request(client, &msg, cap, resp);
+        CHECK("client_register_send handshake", client_register_send(client));
     }
 
     return err;
 }
 
-errval_t send_handshake(void* void_args)
+/**
+ * \brief Handle all pending requests on a client's private endpoint. Runs on
+ * the client's thread, so no locking is needed for per-client state.
+ */
+errval_t recv_handler(void* arg)
 {
-    uintptr_t* args = (uintptr_t*) void_args;
-
-    // 1. Get channel to send down.
-    struct lmp_chan* lc = (struct lmp_chan*) args[0];
-    // 2. Get Client ID.
-    uint32_t* client_id = (uint32_t*) args[1];
-
-    // 3. Send response.
-    CHECK("lmp_chan_send handshake",
-            lmp_chan_send2(lc, LMP_FLAG_SYNC, NULL_CAP, AOS_RPC_OK, *client_id));
-
-    // 4. Free args.
-    free(client_id);
-    free(lc);
-    free(args);
+    struct client_state* client = (struct client_state*) arg;
+    struct lmp_chan* lc = &client->lc;
+
+    // A client never has more than a window's worth of requests in flight,
+    // counting the ones whose responses we haven't sent yet.
+    struct lmp_recv_msg msgs[AOS_RPC_WINDOW];
+    struct capref caps[AOS_RPC_WINDOW];
+    size_t count = 0;
+    errval_t err = lmp_chan_recv_many(lc, msgs, caps,
+            AOS_RPC_WINDOW - client->resp_count, &count);
+
+    // Reregister, once for the whole batch.
+    lmp_chan_register_recv(lc, client->ws,
+            MKCLOSURE((void *)recv_handler, arg));
 
-    return SYS_ERR_OK;
-}
+    for (size_t i = 0; i < count; ++i) {
+        struct lmp_recv_msg* msg = &msgs[i];
+        if (msg->buf.msglen == 0) {
+            continue;
+        }
+        uintptr_t code = AOS_RPC_CODE(msg->words[0]);
+        uintptr_t tag = AOS_RPC_TAG(msg->words[0]);
+
+        struct aos_rpc_response* resp = response_enqueue(client, tag);
+        request_handler_t handler = lookup_request_handler(code);
+        if (msg->buf.msglen < 2 || client_lookup(msg->words[1]) != client) {
+            // Requests carry the ID this channel's client got at handshake.
+            resp->status = AOS_RPC_FAILED;
+            resp->err = LIB_ERR_RPC_NO_CLIENT;
+            if (!capref_is_null(caps[i])) {
+                cap_destroy(caps[i]);
+            }
+        } else if (handler != NULL && code != AOS_RPC_HANDSHAKE) {
+            handler(client, msg, caps[i], resp);
+        } else {
+            resp->status = AOS_RPC_FAILED;
+        }
+    }
 
-errval_t send_memory(void* void_args)
-{
-    uintptr_t* args = (uintptr_t*) void_args;
-    
-    // 1. Get channel to send down.
-    struct lmp_chan* lc = (struct lmp_chan*) args[0];
-    // 2. Get error code.
-    errval_t* err = (errval_t*) args[1];
-    // 3. Get cap for memory.
-    struct capref* retcap = (struct capref*) args[2];
-    // 4. Get returned size.
-    size_t* size = (size_t*) args[3];
-
-    // 5. Generate response code.
-    size_t code = err_is_fail(*err) ? AOS_RPC_FAILED : AOS_RPC_OK;
-
-    // 6. Send response.
-    CHECK("lmp_chan_send memory",
-            lmp_chan_send3(lc, LMP_FLAG_SYNC, *retcap, code, (uintptr_t) *err,
-                    *size));
-
-    // 7 Free args.
-    free(size);
-    free(retcap);
-    free(err);
-    free(lc);
-    free(args);
+    if (client->resp_count > 0) {
+        CHECK("client_register_send", client_register_send(client));
+    }
 
-    return SYS_ERR_OK;
+    return err;
 }
 
-errval_t send_simple_ok(void* void_args)
+/**
+ * \brief Send all of a client's queued responses in one go.
+ * On the wire: (status | tag, err, payload) plus the response cap, if any.
+ * Only the last response of a batch yields to the client.
+ */
+errval_t send_responses(void* arg)
 {
-    uintptr_t* args = (uintptr_t*) void_args;
-
-    // 1. Get channel to send down.
-    struct lmp_chan* lc = (struct lmp_chan*) args[0];
+    struct client_state* client = (struct client_state*) arg;
+    client->send_registered = false;
+
+    while (client->resp_count > 0) {
+        struct aos_rpc_response* resp = &client->resp[client->resp_head];
+        uintptr_t tag = client->resp_tag[client->resp_head];
+        bool giveaway = client->resp_giveaway[client->resp_head];
+        lmp_send_flags_t flags = client->resp_count == 1 ? LMP_FLAG_SYNC : 0;
+#if INIT_WORKER_THREADS == 0
+        // Single-threaded: reply and sleep until the next request comes in.
+        if (client->resp_count == 1) {
+            flags |= LMP_FLAG_CALL;
+        }
+#endif
+        if (giveaway) {
+            flags |= LMP_FLAG_GIVEAWAY;
+        }
 
-    // 2. Send response.
-    CHECK("lmp_chan_send putchar",
-            lmp_chan_send1(lc, LMP_FLAG_SYNC, NULL_CAP, AOS_RPC_OK));
+        errval_t err = lmp_chan_send4(&client->lc, flags, resp->cap,
+                AOS_RPC_MKWORD(resp->status, tag), (uintptr_t) resp->err,
+                resp->u.words[0], resp->u.words[1]);
+        if (err_is_fail(err) && lmp_err_is_transient(err)) {
+            // Client's buffer or cap slot is busy, retry later.
+            CHECK("client_register_send retry", client_register_send(client));
+            return SYS_ERR_OK;
+        }
 
-    // 3. Free args.
-    free(lc);
-    free(args);
+        client->resp_head = (client->resp_head + 1) % AOS_RPC_WINDOW;
+        --client->resp_count;
+        CHECK("lmp_chan_send response", err);
+        if (giveaway) {
+            // The cap moved to the client, the slot is free again.
+            CHECK("slot_free giveaway", slot_free(resp->cap));
+        }
+    }
 
     return SYS_ERR_OK;
 }
@@ -359,22 +666,43 @@ int main(int argc, char *argv[])
     //     DEBUG_ERR(err, "slot_alloc_init");
     // }
 
-    err = initialize_ram_alloc();
-    if(err_is_fail(err)){
-        DEBUG_ERR(err, "initialize_ram_alloc");
+    if (my_core_id == 0) {
+        err = initialize_ram_alloc();
+        if(err_is_fail(err)){
+            DEBUG_ERR(err, "initialize_ram_alloc");
+        }
+    } else {
+        err = multicore_init_app_core();
+        if (err_is_fail(err)) {
+            USER_PANIC_ERR(err, "multicore_init_app_core");
+        }
     }
 
+    slab_init(&client_slabs, sizeof(struct client_state), slab_default_refill);
+    register_request_handler(AOS_RPC_HANDSHAKE, process_handshake_request);
+    register_request_handler(AOS_RPC_BULK, process_bulk_request);
+    register_request_handler(AOS_RPC_MEMORY, process_memory_request);
+    register_request_handler(AOS_RPC_MEMORY_BATCH, process_memory_batch_request);
+    register_request_handler(AOS_RPC_NUMBER, process_number_request);
+    register_request_handler(AOS_RPC_PUTCHAR, process_putchar_request);
+    register_request_handler(AOS_RPC_STRING, process_string_request);
+
     CHECK("Retype selfep from dispatcher", cap_retype(cap_selfep, cap_dispatcher, 0, ObjType_EndPoint, 0, 1));
 
     struct lmp_chan* lc = (struct lmp_chan*) malloc(sizeof(struct lmp_chan));
-    CHECK("Create channel for parent", lmp_chan_accept(lc, DEFAULT_LMP_BUF_WORDS, NULL_CAP));
+    CHECK("Create channel for parent", lmp_chan_accept(lc, AOS_RPC_BUF_WORDS, NULL_CAP));
 
     CHECK("Create Slot", lmp_chan_alloc_recv_slot(lc));
     CHECK("COpy to initep", cap_copy(cap_initep, lc->local_cap));
 
     CHECK("lmp_chan_register_recv child",
             lmp_chan_register_recv(lc, get_default_waitset(),
-                    MKCLOSURE((void*) recv_handler, lc)));
+                    MKCLOSURE((void*) handshake_handler, lc)));
+
+    // Client channels get spread over the workers from here on.
+    CHECK("workers_start", workers_start());
+
+    CHECK("top_add init", top_add("init", cap_dispatcher));
 
     // // ALLOCATE A LOT OF MEMORY TROLOLOLOLO.
     // struct capref frame;
@@ -424,7 +752,34 @@ int main(int argc, char *argv[])
     // spawn_load_by_name("hello", (struct spawninfo*) malloc(sizeof(struct spawninfo)));
     // spawn_load_by_name("byebye", (struct spawninfo*) malloc(sizeof(struct spawninfo)));
 
-    spawn_load_by_name("memeater", (struct spawninfo*) malloc(sizeof(struct spawninfo)));
+    if (my_core_id == 0) {
+        err = multicore_boot_cores();
+        if (err_is_fail(err)) {
+            DEBUG_ERR(err, "multicore_boot_cores");
+        }
+
+        struct spawninfo* si = malloc(sizeof(struct spawninfo));
+        err = spawn_load_by_name("memeater", si);
+        if (err_is_fail(err)) {
+            DEBUG_ERR(err, "spawning memeater");
+        } else {
+            CHECK("top_add memeater", top_add(si->binary_name, si->dispatcher));
+        }
+    }
+
+    if (INIT_TOP_PERIOD > 0) {
+        CHECK("top_start", top_start(INIT_TOP_PERIOD * 1000000));
+    }
+    if (INIT_PROFILE_PERIOD > 0) {
+        CHECK("profile_start", profile_start(INIT_PROFILE_PERIOD * 1000000));
+    }
+    if (INIT_KTRACE_PERIOD > 0) {
+        CHECK("ktrace_start",
+              ktrace_start(INIT_KTRACE_MASK, INIT_KTRACE_PERIOD * 1000000));
+    }
+    if (INIT_ZERO_POOL_PERIOD > 0) {
+        CHECK("zero_pool_start", zero_pool_start(INIT_ZERO_POOL_PERIOD * 1000));
+    }
 
     debug_printf("Message handler loop\n");
     // Hang around
@@ -4,15 +4,54 @@
  */
 
 #include "mem_alloc.h"
+#include "zero_pool.h"
 #include <mm/mm.h>
 #include <aos/paging.h>
 
 /// MM allocator instance data
 struct mm aos_mm;
 
+/// Total RAM handed to aos_mm, in bytes
+gensize_t aos_mm_bytes;
+
+/// Called to obtain more RAM when aos_mm runs dry, if set
+static mem_refill_func_t mem_refill;
+
+/// Serializes refills through mem_refill
+static struct thread_mutex refill_lock = THREAD_MUTEX_INITIALIZER;
+
+/// Thread holding refill_lock, so that allocations made by the refill itself
+/// don't refill again
+static struct thread *refiller;
+
+/// Next free slot in cnode_super, for RAM caps forged on this core
+static cslot_t super_next;
+static struct thread_mutex super_lock = THREAD_MUTEX_INITIALIZER;
+
 static errval_t aos_ram_alloc_aligned(struct capref *ret, size_t size, size_t alignment)
 {
-    return mm_alloc_aligned(&aos_mm, size, alignment, ret);
+    // pooled RAM is page aligned, and retyping it needn't zero it
+    if (alignment <= BASE_PAGE_SIZE && zero_pool_take(size, ret)) {
+        return SYS_ERR_OK;
+    }
+
+    errval_t err = mm_alloc_aligned(&aos_mm, size, alignment, ret);
+    if (err_is_fail(err) && mem_refill != NULL && refiller != thread_self()) {
+        thread_mutex_lock(&refill_lock);
+        refiller = thread_self();
+        // another thread may have refilled while we waited
+        err = mm_alloc_aligned(&aos_mm, size, alignment, ret);
+        if (err_is_fail(err)) {
+            // ask another core for memory, then try once more
+            errval_t refill_err = mem_refill(size + alignment);
+            if (err_is_ok(refill_err)) {
+                err = mm_alloc_aligned(&aos_mm, size, alignment, ret);
+            }
+        }
+        refiller = NULL;
+        thread_mutex_unlock(&refill_lock);
+    }
+    return err;
 }
 
 errval_t aos_ram_free(struct capref cap, size_t bytes)
@@ -26,13 +65,9 @@ errval_t aos_ram_free(struct capref cap, size_t bytes)
     return mm_free(&aos_mm, cap, fi.base, bytes);
 }
 
-/**
- * \brief Setups a local memory allocator for init to use till the memory server
- * is ready to be used.
- */
-errval_t initialize_ram_alloc(void)
+/// Set up aos_mm and its slot allocator, without any memory yet
+static errval_t mem_alloc_setup(void)
 {
-    debug_printf("initialize_ram_alloc\n");
     errval_t err;
 
     // Init slot allocator
@@ -62,6 +97,85 @@ errval_t initialize_ram_alloc(void)
     static char nodebuf[sizeof(struct mmnode)*64];
     slab_grow(&aos_mm.slabs, nodebuf, sizeof(nodebuf));
 
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief Add a region of RAM this core holds no cap for to aos_mm
+ *
+ * Used by init on cores booted by another core's init, which passes the
+ * physical range over their shared frame.
+ */
+errval_t mem_alloc_add_forged(genpaddr_t base, gensize_t bytes)
+{
+    thread_mutex_lock(&super_lock);
+    if (super_next >= L2_CNODE_SLOTS) {
+        thread_mutex_unlock(&super_lock);
+        return MM_ERR_SLOT_NOSLOTS;
+    }
+    struct capref ram = {
+        .cnode = cnode_super,
+        .slot = super_next,
+    };
+    errval_t err = ram_forge(ram, base, bytes, disp_get_core_id());
+    if (err_is_ok(err)) {
+        super_next++;
+    }
+    thread_mutex_unlock(&super_lock);
+    CHECK("forging RAM cap", err);
+
+    err = mm_add(&aos_mm, ram, base, bytes);
+    if (err_is_fail(err)) {
+        return err_push(err, MM_ERR_MM_ADD);
+    }
+    aos_mm_bytes += bytes;
+
+    err = slot_prealloc_refill(aos_mm.slot_alloc_inst);
+    if (err_is_fail(err) && err_no(err) != MM_ERR_SLOT_MM_ALLOC) {
+        return err;
+    }
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief Setups a local memory allocator for init on a core booted by
+ * another core, over the RAM region it was handed
+ */
+errval_t initialize_ram_alloc_forged(genpaddr_t base, gensize_t bytes)
+{
+    debug_printf("initialize_ram_alloc_forged\n");
+
+    CHECK("mem_alloc_setup", mem_alloc_setup());
+    CHECK("adding RAM", mem_alloc_add_forged(base, bytes));
+    debug_printf("Added %"PRIu64" MB of physical memory.\n",
+                 (uint64_t)bytes / 1024 / 1024);
+
+    errval_t err = ram_alloc_set(aos_ram_alloc_aligned);
+    if (err_is_fail(err)) {
+        return err_push(err, LIB_ERR_RAM_ALLOC_SET);
+    }
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief Install a function to call when aos_mm runs out of memory
+ */
+void mem_alloc_set_refill(mem_refill_func_t refill)
+{
+    mem_refill = refill;
+}
+
+/**
+ * \brief Setups a local memory allocator for init to use till the memory server
+ * is ready to be used.
+ */
+errval_t initialize_ram_alloc(void)
+{
+    debug_printf("initialize_ram_alloc\n");
+    errval_t err;
+
+    CHECK("mem_alloc_setup", mem_alloc_setup());
+
     // Walk bootinfo and add all RAM caps to allocator handed to us by the kernel
     uint64_t mem_avail = 0;
     struct capref mem_cap = {
@@ -93,6 +207,7 @@ errval_t initialize_ram_alloc(void)
         }
     }
     debug_printf("Added %"PRIu64" MB of physical memory.\n", mem_avail / 1024 / 1024);
+    aos_mm_bytes = mem_avail;
 
     // Finally, we can initialize the generic RAM allocator to use our local allocator
     err = ram_alloc_set(aos_ram_alloc_aligned);
@@ -20,8 +20,15 @@
 
 extern struct bootinfo *bi;
 extern struct mm aos_mm;
+extern gensize_t aos_mm_bytes;
+
+/// Obtains at least `bytes` more RAM for aos_mm, e.g. from another core
+typedef errval_t (*mem_refill_func_t)(size_t bytes);
 
 errval_t initialize_ram_alloc(void);
+errval_t initialize_ram_alloc_forged(genpaddr_t base, gensize_t bytes);
+errval_t mem_alloc_add_forged(genpaddr_t base, gensize_t bytes);
+void mem_alloc_set_refill(mem_refill_func_t refill);
 errval_t aos_ram_free(struct capref cap, size_t bytes);
 
 #endif /* _INIT_MEM_ALLOC_H_ */
@@ -0,0 +1,283 @@
+/**
+ * \file
+ * \brief Running one init per core, and sharing RAM between them
+ *
+ * Init on core 0 owns all RAM at boot. Before booting each other core it
+ * carves out an equal share and passes its physical range in that core's
+ * URPC frame; the init there forges a RAM cap for it and runs its own
+ * allocator. When a core runs dry, it asks core 0 for more over UMP.
+ *
+ * Each side of a UMP channel raises an IPI notification after sending, so
+ * core 0 waits on its waitset for requests rather than polling for them.
+ * Notification channel IDs are simply the peer's core ID on core 0, and 0
+ * on the other cores.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetsstrasse 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <string.h>
+
+#include <aos/aos.h>
+#include <aos/ipi_notify.h>
+#include <aos/paging.h>
+#include <mm/mm.h>
+#include <spawn/multiboot.h>
+
+#include "coreboot.h"
+#include "mem_alloc.h"
+#include "multicore.h"
+
+/// Core 0's end of the channel to another core's init
+struct core_link {
+    struct ump_chan chan;
+    struct ipi_notify notify;
+};
+
+static struct core_link links[INIT_MAX_CORES];
+
+/// An app core's channel to core 0
+static struct ump_chan uplink;
+static struct ipi_notify uplink_notify;
+/// Held across a request on the uplink and adding its reply, so that replies
+/// can't be taken by another thread's request
+static struct thread_mutex uplink_lock = THREAD_MUTEX_INITIALIZER;
+
+/// Send, waiting for the receiver to make room
+static errval_t urpc_send(struct ump_chan *chan, const uintptr_t *words,
+                          size_t len)
+{
+    errval_t err;
+    while (err_no(err = ump_chan_send(chan, words, len)) ==
+           LIB_ERR_UMP_CHAN_FULL) {
+        thread_yield();
+    }
+    return err;
+}
+
+/// Serve a RAM request from another core out of this core's allocator
+static void urpc_grant_ram(struct core_link *link, size_t bytes)
+{
+    struct capref ram;
+    size_t chunk = ROUND_UP(MAX(bytes, URPC_RAM_CHUNK), BASE_PAGE_SIZE);
+    errval_t err = mm_alloc(&aos_mm, chunk, &ram);
+    if (err_is_fail(err)) {
+        chunk = ROUND_UP(bytes, BASE_PAGE_SIZE);
+        err = mm_alloc(&aos_mm, chunk, &ram);
+    }
+
+    struct frame_identity id;
+    if (err_is_ok(err)) {
+        err = frame_identify(ram, &id);
+    }
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "can't spare %zu bytes for another core", bytes);
+        uintptr_t deny = URPC_RAM_DENY;
+        urpc_send(&link->chan, &deny, 1);
+        return;
+    }
+
+    // the region now belongs to the other core; keeping the cap here stops
+    // aos_mm from handing it out again
+    uintptr_t grant[4] = {
+        URPC_RAM_GRANT, (uintptr_t)id.base, (uintptr_t)(id.base >> 32),
+        (uintptr_t)id.bytes,
+    };
+    err = urpc_send(&link->chan, grant, 4);
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "sending RAM grant");
+    }
+}
+
+static void urpc_recv_handler(void *arg)
+{
+    struct core_link *link = arg;
+    struct ump_recv_msg msg;
+
+    // re-arm before draining, so a message sent meanwhile isn't missed
+    ipi_notify_ack(&link->notify);
+    errval_t err = ipi_notify_register(&link->notify, get_default_waitset(),
+                                       MKCLOSURE(urpc_recv_handler, link));
+    if (err_is_fail(err)) {
+        DEBUG_ERR(err, "re-registering URPC notification");
+    }
+
+    while (err_is_ok(ump_chan_recv(&link->chan, &msg))) {
+        switch (msg.words[0]) {
+        case URPC_RAM_REQUEST:
+            urpc_grant_ram(link, msg.words[1]);
+            break;
+        default:
+            debug_printf("unexpected URPC message %" PRIuPTR "\n",
+                         msg.words[0]);
+            break;
+        }
+    }
+}
+
+/// Name of the CPU driver module, i.e. the one named cpu_<platform>
+static const char *find_cpu_driver(void)
+{
+    for (size_t i = 0; i < bi->regions_length; i++) {
+        const char *name = multiboot_module_name(&bi->regions[i]);
+        if (name == NULL) {
+            continue;
+        }
+        const char *base = strrchr(name, '/');
+        base = base != NULL ? base + 1 : name;
+        if (strncmp(base, "cpu_", 4) == 0) {
+            // multiboot_module_name returns a static buffer
+            static char cpu_driver[64];
+            strncpy(cpu_driver, base, sizeof(cpu_driver) - 1);
+            return cpu_driver;
+        }
+    }
+    return NULL;
+}
+
+/// Boot one other core, handing it `ram_bytes` of RAM
+static errval_t boot_core(coreid_t core, const char *cpu_driver,
+                          size_t ram_bytes)
+{
+    struct core_link *link = &links[core];
+
+    struct capref urpc_frame;
+    size_t retbytes;
+    CHECK("allocating URPC frame",
+          frame_alloc(&urpc_frame, MON_URPC_SIZE, &retbytes));
+    struct frame_identity urpc_id;
+    CHECK("identifying URPC frame", frame_identify(urpc_frame, &urpc_id));
+    void *urpc;
+    CHECK("mapping URPC frame",
+          paging_map_frame(get_current_paging_state(), &urpc, retbytes,
+                           urpc_frame, NULL, NULL));
+    memset(urpc, 0, retbytes);
+
+    struct capref ram;
+    errval_t err = mm_alloc_aligned(&aos_mm, ram_bytes, LARGE_PAGE_SIZE, &ram);
+    if (err_is_fail(err)) {
+        return err_push(err, MM_ERR_FIND_NODE);
+    }
+    struct frame_identity ram_id;
+    CHECK("identifying RAM share", frame_identify(ram, &ram_id));
+    struct urpc_bootinfo *bootinfo = urpc;
+    bootinfo->ram_base = ram_id.base;
+    bootinfo->ram_bytes = ram_id.bytes;
+
+    CHECK("ump_chan_init",
+          ump_chan_init(&link->chan, (char *)urpc + URPC_UMP_OFFSET,
+                        retbytes - URPC_UMP_OFFSET, true));
+    CHECK("setting up URPC notification",
+          ipi_notify_init(&link->notify, core));
+    CHECK("connecting URPC notification",
+          ipi_notify_connect(&link->notify, core, 0));
+    ump_chan_set_notify(&link->chan, ipi_notify_ump, &link->notify);
+    CHECK("registering URPC channel",
+          ipi_notify_register(&link->notify, get_default_waitset(),
+                              MKCLOSURE(urpc_recv_handler, link)));
+
+    return coreboot(core, cpu_driver, "init", urpc_id);
+}
+
+/**
+ * \brief Boot every other core, splitting RAM evenly between all of them
+ *
+ * Core 0 keeps whatever is left of its share, and serves later requests
+ * for more from it.
+ */
+errval_t multicore_boot_cores(void)
+{
+    struct platform_info pi;
+    CHECK("getting platform info",
+          invoke_kernel_get_platform_info(cap_kernel, &pi));
+    size_t ncores = MIN(pi.arch_info.armv7.ncores, INIT_MAX_CORES);
+    if (ncores <= 1) {
+        return SYS_ERR_OK;
+    }
+
+    const char *cpu_driver = find_cpu_driver();
+    if (cpu_driver == NULL) {
+        return SPAWN_ERR_FIND_MODULE;
+    }
+
+    size_t share = ROUND_DOWN(aos_mm_bytes / ncores, LARGE_PAGE_SIZE);
+    for (coreid_t core = 1; core < ncores; core++) {
+        errval_t err = boot_core(core, cpu_driver, share);
+        if (err_is_fail(err)) {
+            DEBUG_ERR(err, "booting core %" PRIuCOREID, core);
+            return err;
+        }
+        debug_printf("booted core %" PRIuCOREID " with %zu MB\n", core,
+                     share / 1024 / 1024);
+    }
+
+    return SYS_ERR_OK;
+}
+
+/// Ask core 0 for more RAM, once this core's allocator is empty
+static errval_t urpc_ram_refill(size_t bytes)
+{
+    uintptr_t req[2] = { URPC_RAM_REQUEST, bytes };
+    thread_mutex_lock(&uplink_lock);
+    errval_t err = urpc_send(&uplink, req, 2);
+    if (err_is_fail(err)) {
+        thread_mutex_unlock(&uplink_lock);
+        DEBUG_ERR(err, "sending RAM request");
+        return err;
+    }
+
+    struct ump_recv_msg msg;
+    while (err_no(err = ump_chan_recv(&uplink, &msg)) == LIB_ERR_NO_UMP_MSG) {
+        thread_yield();
+    }
+    if (err_is_fail(err)) {
+        thread_mutex_unlock(&uplink_lock);
+        return err;
+    }
+    // nothing waits on the uplink's notifications, we just polled for it
+    ipi_notify_ack(&uplink_notify);
+    if (msg.words[0] != URPC_RAM_GRANT) {
+        thread_mutex_unlock(&uplink_lock);
+        return INIT_ERR_RAM_REBALANCE;
+    }
+
+    genpaddr_t base = msg.words[1] | ((genpaddr_t)msg.words[2] << 32);
+    err = mem_alloc_add_forged(base, msg.words[3]);
+    thread_mutex_unlock(&uplink_lock);
+    return err;
+}
+
+/**
+ * \brief Bring up init on a core booted by core 0
+ *
+ * Takes over the RAM share passed in the URPC frame, and arranges for more
+ * to be requested from core 0 when it runs out.
+ */
+errval_t multicore_init_app_core(void)
+{
+    // the kernel maps the URPC frame right after our dispatcher frame, and
+    // we can't map it ourselves until RAM is set up from what's in it
+    void *urpc = (char *)curdispatcher() + DISPATCHER_SIZE;
+    struct urpc_bootinfo *bootinfo = urpc;
+
+    CHECK("initialize_ram_alloc_forged",
+          initialize_ram_alloc_forged(bootinfo->ram_base,
+                                      bootinfo->ram_bytes));
+
+    CHECK("ump_chan_init",
+          ump_chan_init(&uplink, (char *)urpc + URPC_UMP_OFFSET,
+                        MON_URPC_SIZE - URPC_UMP_OFFSET, false));
+    CHECK("setting up URPC notification", ipi_notify_init(&uplink_notify, 0));
+    CHECK("connecting URPC notification",
+          ipi_notify_connect(&uplink_notify, 0, disp_get_core_id()));
+    ump_chan_set_notify(&uplink, ipi_notify_ump, &uplink_notify);
+    mem_alloc_set_refill(urpc_ram_refill);
+
+    return SYS_ERR_OK;
+}
@@ -0,0 +1,50 @@
+/**
+ * \file
+ * \brief Running one init per core, and sharing RAM between them
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetsstrasse 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#ifndef _INIT_MULTICORE_H_
+#define _INIT_MULTICORE_H_
+
+#include <aos/aos.h>
+#include <aos/ump_chan.h>
+
+/// Most cores init will boot
+#define INIT_MAX_CORES          4
+
+/// Smallest amount of RAM moved between cores when one runs out
+#define URPC_RAM_CHUNK          (16 * 1024 * 1024)
+
+/**
+ * \brief Boot parameters for another core's init
+ *
+ * Sits at the start of the URPC frame the kernel maps for that init; the
+ * rest of the frame, from URPC_UMP_OFFSET, is a UMP channel back to core 0.
+ */
+struct urpc_bootinfo {
+    genpaddr_t ram_base;    ///< RAM the new core's init manages itself
+    gensize_t ram_bytes;
+};
+
+#define URPC_UMP_OFFSET         BASE_PAGE_SIZE
+
+/// Message types on the UMP channel between init instances
+enum urpc_msg_type {
+    URPC_RAM_REQUEST = 1,   ///< words[1]: bytes wanted
+    URPC_RAM_GRANT,         ///< words[1..2]: base (lo, hi), words[3]: bytes
+    URPC_RAM_DENY,
+};
+
+errval_t multicore_boot_cores(void);
+errval_t multicore_init_app_core(void);
+
+#endif /* _INIT_MULTICORE_H_ */
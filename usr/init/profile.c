@@ -0,0 +1,128 @@
+/**
+ * \file
+ * \brief Draining the kernel's PC sampling profile
+ *
+ * Init gives the kernel a profile buffer, see barrelfish_kpi/profile.h, and
+ * periodically prints the samples collected in it, one per line:
+ *
+ *     PROFILE <core> <dispatcher> <pc> <lr> [D]
+ *
+ * with the PC and LR in hex, and D marking samples of a disabled dispatcher.
+ * Samples of an idle core name the dispatcher "<idle>". tools/profile turns
+ * a console log with these lines into a flat profile.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetsstrasse 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <aos/aos.h>
+#include <aos/deferred.h>
+#include <aos/paging.h>
+#include <barrelfish_kpi/profile.h>
+
+#include "profile.h"
+
+static struct capref profile_frame;
+static struct profile_buffer *profile_buf;
+static uint32_t last_dropped;
+static struct periodic_event profile_event;
+
+/**
+ * \brief Print the samples the kernel took since the last drain
+ */
+void profile_drain(void)
+{
+    struct profile_buffer *buf = profile_buf;
+    if (buf == NULL) {
+        return;
+    }
+
+    coreid_t core = disp_get_core_id();
+    uint32_t head = buf->head;
+    for (uint32_t n = buf->tail; n != head; n++) {
+        struct profile_sample *s = &buf->samples[n % buf->nsamples];
+        const char *name = "<idle>";
+        int namelen = DISP_NAME_LEN;
+        if (s->disp != PROFILE_DISP_IDLE) {
+            name = buf->dispatchers[s->disp].name;
+            namelen = strnlen(name, DISP_NAME_LEN);
+        }
+        printf("PROFILE %" PRIuCOREID " %.*s %08" PRIx32 " %08" PRIx32 "%s\n",
+               core, namelen, name, s->pc, s->lr,
+               s->flags & PROFILE_SAMPLE_DISABLED ? " D" : "");
+    }
+    buf->tail = head;
+
+    uint32_t dropped = buf->dropped;
+    if (dropped != last_dropped) {
+        debug_printf("profile: %" PRIu32 " samples dropped\n",
+                     dropped - last_dropped);
+        last_dropped = dropped;
+    }
+}
+
+static void profile_event_handler(void *arg)
+{
+    profile_drain();
+}
+
+/**
+ * \brief Have the kernel sample this core, and drain the samples every
+ * 'period' us from the default waitset
+ */
+errval_t profile_start(delayus_t period)
+{
+    errval_t err;
+
+    size_t bytes;
+    err = frame_alloc(&profile_frame, PROFILE_BUFFER_SIZE, &bytes);
+    if (err_is_fail(err)) {
+        return err_push(err, LIB_ERR_FRAME_ALLOC);
+    }
+
+    void *buf;
+    err = paging_map_frame(get_current_paging_state(), &buf, bytes,
+                           profile_frame, NULL, NULL);
+    if (err_is_fail(err)) {
+        return err_push(err, LIB_ERR_VSPACE_MAP);
+    }
+
+    err = invoke_kernel_profile(cap_kernel, profile_frame);
+    if (err_is_fail(err)) {
+        return err;
+    }
+    profile_buf = buf;
+    last_dropped = 0;
+
+    debug_printf("profile: sampling every %" PRIu32 " ms into %" PRIu32
+                 " slots\n", profile_buf->tick_ms, profile_buf->nsamples);
+    return periodic_event_create(&profile_event, get_default_waitset(), period,
+                                 MKCLOSURE(profile_event_handler, NULL));
+}
+
+/**
+ * \brief Stop sampling, and print what's left
+ */
+errval_t profile_stop(void)
+{
+    errval_t err = periodic_event_cancel(&profile_event);
+    if (err_is_fail(err)) {
+        return err;
+    }
+    err = invoke_kernel_profile(cap_kernel, NULL_CAP);
+    if (err_is_fail(err)) {
+        return err;
+    }
+    profile_drain();
+    profile_buf = NULL;
+    return SYS_ERR_OK;
+}
@@ -0,0 +1,27 @@
+/**
+ * \file
+ * \brief Draining the kernel's PC sampling profile
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetsstrasse 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#ifndef _INIT_PROFILE_H_
+#define _INIT_PROFILE_H_
+
+#include <aos/aos.h>
+
+/// Size of the profile buffer; at one sample per tick, it must hold a period
+#define PROFILE_BUFFER_SIZE     (64 * 1024)
+
+errval_t profile_start(delayus_t period);
+void profile_drain(void);
+errval_t profile_stop(void);
+
+#endif /* _INIT_PROFILE_H_ */
@@ -0,0 +1,138 @@
+/**
+ * \file
+ * \brief Per-dispatcher statistics dump, in the style of top
+ *
+ * Init keeps the dispatcher capabilities of the domains it runs, and reads
+ * the kernel's accounting for each of them with invoke_dispatcher_stats().
+ * A dump shows how much of the time since the last one each dispatcher ran,
+ * and what it did meanwhile, followed by its system calls over its lifetime.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetsstrasse 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <aos/aos.h>
+#include <aos/deferred.h>
+
+#include "top.h"
+
+struct top_entry {
+    char name[DISP_NAME_LEN + 1];
+    struct capref dispatcher;
+    struct dispatcher_stats last;   ///< Counters at the last dump
+};
+
+static struct top_entry entries[TOP_MAX_DISPATCHERS];
+static size_t entry_count;
+static systime_t last_dump;         ///< In us, see get_system_time()
+static struct periodic_event top_event;
+
+static const char *syscall_names[SYSCALL_COUNT] = {
+    [SYSCALL_INVOKE] = "invoke",
+    [SYSCALL_YIELD] = "yield",
+    [SYSCALL_LRPC] = "lrpc",
+    [SYSCALL_DEBUG] = "debug",
+    [SYSCALL_REBOOT] = "reboot",
+    [SYSCALL_NOP] = "nop",
+    [SYSCALL_PRINT] = "print",
+    [SYSCALL_GETCHAR] = "getchar",
+    [SYSCALL_ARMv7_CACHE_CLEAN] = "cache_clean",
+    [SYSCALL_ARMv7_CACHE_INVAL] = "cache_inval",
+    [SYSCALL_SUSPEND] = "suspend",
+    [SYSCALL_GET_ABS_TIME] = "get_abs_time",
+    [SYSCALL_INVOKE_BATCH] = "invoke_batch",
+};
+
+/**
+ * \brief Start keeping track of a dispatcher
+ *
+ * \param name       Name to show it under
+ * \param dispatcher Its dispatcher capability, which must stay valid
+ */
+errval_t top_add(const char *name, struct capref dispatcher)
+{
+    if (entry_count == TOP_MAX_DISPATCHERS) {
+        return INIT_ERR_TOP_FULL;
+    }
+
+    struct top_entry *e = &entries[entry_count];
+    errval_t err = invoke_dispatcher_stats(dispatcher, &e->last, NULL);
+    if (err_is_fail(err)) {
+        return err;
+    }
+    strncpy(e->name, name, DISP_NAME_LEN);
+    e->name[DISP_NAME_LEN] = '\0';
+    e->dispatcher = dispatcher;
+    entry_count++;
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief Print what each dispatcher has been doing since the last dump
+ */
+void top_dump(void)
+{
+    systime_t now = get_system_time();
+    systime_t elapsed_us = now - last_dump;
+    last_dump = now;
+
+    printf("%-16s %6s %8s %8s %8s %8s %8s\n", "NAME", "%CPU", "RUN(ms)",
+           "SWITCH", "YIELD", "PREEMPT", "LMP TX/RX");
+    for (size_t i = 0; i < entry_count; i++) {
+        struct top_entry *e = &entries[i];
+        struct dispatcher_stats s;
+        uint32_t tick_hz;
+        errval_t err = invoke_dispatcher_stats(e->dispatcher, &s, &tick_hz);
+        if (err_is_fail(err)) {
+            printf("%-16s (gone: %s)\n", e->name, err_getstring(err));
+            continue;
+        }
+
+        uint64_t run_us = (s.run_ticks - e->last.run_ticks) * 1000000 /
+                          tick_hz;
+        unsigned cpu_pml = elapsed_us == 0 ? 0 : run_us * 1000 / elapsed_us;
+        printf("%-16s %4u.%u %8" PRIu64 " %8" PRIu64 " %8" PRIu64 " %8"
+               PRIu64 " %" PRIu64 "/%" PRIu64 "\n",
+               e->name, cpu_pml / 10, cpu_pml % 10, run_us / 1000,
+               s.dispatches - e->last.dispatches,
+               s.yields - e->last.yields,
+               s.preemptions - e->last.preemptions,
+               s.lmp_sent - e->last.lmp_sent,
+               s.lmp_received - e->last.lmp_received);
+
+        printf("%16s", "syscalls:");
+        for (int n = 0; n < SYSCALL_COUNT; n++) {
+            if (s.syscalls[n] != 0) {
+                printf(" %s=%" PRIu64, syscall_names[n] ? syscall_names[n] : "?",
+                       s.syscalls[n]);
+            }
+        }
+        printf("\n");
+
+        e->last = s;
+    }
+}
+
+static void top_event_handler(void *arg)
+{
+    top_dump();
+}
+
+/**
+ * \brief Dump statistics every 'period' us, from the default waitset
+ */
+errval_t top_start(delayus_t period)
+{
+    last_dump = get_system_time();
+    return periodic_event_create(&top_event, get_default_waitset(), period,
+                                 MKCLOSURE(top_event_handler, NULL));
+}
@@ -0,0 +1,27 @@
+/**
+ * \file
+ * \brief Per-dispatcher statistics dump, in the style of top
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetsstrasse 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#ifndef _INIT_TOP_H_
+#define _INIT_TOP_H_
+
+#include <aos/aos.h>
+
+/// Most dispatchers top keeps track of
+#define TOP_MAX_DISPATCHERS     32
+
+errval_t top_add(const char *name, struct capref dispatcher);
+void top_dump(void);
+errval_t top_start(delayus_t period);
+
+#endif /* _INIT_TOP_H_ */
@@ -0,0 +1,147 @@
+/**
+ * \file
+ * \brief Pool of RAM capabilities zeroed ahead of time
+ *
+ * The kernel zeroes the memory of every Frame it retypes, inside the retype,
+ * so a large frame_alloc() holds up the whole core. Instead, init keeps a few
+ * RAM caps of common sizes, and has the kernel zero them with
+ * invoke_ram_zero() a bit at a time, from a periodic event. Allocations of
+ * exactly one of these sizes are served from the caps that are all zero, and
+ * the kernel then skips zeroing when they are retyped.
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetsstrasse 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#include <aos/aos.h>
+#include <aos/deferred.h>
+#include <mm/mm.h>
+
+#include "mem_alloc.h"
+#include "zero_pool.h"
+
+/// Most caps kept of any one size
+#define ZERO_POOL_DEPTH         16
+
+struct zero_pool_ram {
+    struct capref cap;
+    size_t zeroed;              ///< Bytes from the base known to be zero
+};
+
+struct zero_pool_class {
+    size_t bytes;               ///< Size of each cap
+    size_t depth;               ///< Number of caps to keep
+    size_t count;
+    struct zero_pool_ram ram[ZERO_POOL_DEPTH];
+};
+
+static struct zero_pool_class classes[] = {
+    { .bytes = BASE_PAGE_SIZE,      .depth = 16 },
+    { .bytes = 16 * BASE_PAGE_SIZE, .depth = 8 },
+    { .bytes = LARGE_PAGE_SIZE,     .depth = 4 },
+};
+
+/// Allocations come from the client worker threads too
+static struct thread_mutex zero_pool_lock = THREAD_MUTEX_INITIALIZER;
+static struct periodic_event zero_pool_event;
+
+/**
+ * \brief Take a RAM cap of `bytes` that is all zero, if there is one
+ */
+bool zero_pool_take(size_t bytes, struct capref *ret)
+{
+    bool found = false;
+
+    thread_mutex_lock_nested(&zero_pool_lock);
+    for (size_t c = 0; c < ARRAY_LENGTH(classes) && !found; c++) {
+        struct zero_pool_class *cls = &classes[c];
+        if (cls->bytes != bytes) {
+            continue;
+        }
+        for (size_t i = 0; i < cls->count; i++) {
+            if (cls->ram[i].zeroed == cls->bytes) {
+                *ret = cls->ram[i].cap;
+                cls->ram[i] = cls->ram[--cls->count];
+                found = true;
+                break;
+            }
+        }
+    }
+    thread_mutex_unlock(&zero_pool_lock);
+
+    return found;
+}
+
+/// Top up every class, then zero what the budget allows
+static void zero_pool_refill(void *arg)
+{
+    errval_t err;
+    size_t budget = ZERO_POOL_BUDGET;
+
+    for (size_t c = 0; c < ARRAY_LENGTH(classes); c++) {
+        struct zero_pool_class *cls = &classes[c];
+        struct capref fresh[ZERO_POOL_DEPTH], failed[ZERO_POOL_DEPTH];
+        size_t nfresh = 0, nfailed = 0;
+
+        // mm_alloc() may take the paging lock, and with it held, allocating
+        // RAM takes ours, so allocate without holding it. This is the only
+        // thread adding caps, so there will still be room for these.
+        thread_mutex_lock(&zero_pool_lock);
+        size_t want = cls->depth - cls->count;
+        thread_mutex_unlock(&zero_pool_lock);
+        while (nfresh < want) {
+            err = mm_alloc(&aos_mm, cls->bytes, &fresh[nfresh]);
+            if (err_is_fail(err)) {
+                // short on memory, so don't hoard any more of it
+                break;
+            }
+            nfresh++;
+        }
+
+        thread_mutex_lock(&zero_pool_lock);
+        for (size_t i = 0; i < nfresh; i++) {
+            assert(cls->count < cls->depth);
+            cls->ram[cls->count++] = (struct zero_pool_ram) { .cap = fresh[i] };
+        }
+
+        size_t i = 0;
+        while (i < cls->count && budget > 0) {
+            struct zero_pool_ram *ram = &cls->ram[i];
+            if (ram->zeroed == cls->bytes) {
+                i++;
+                continue;
+            }
+
+            size_t step = MIN(budget, cls->bytes - ram->zeroed);
+            err = invoke_ram_zero(ram->cap, step, &ram->zeroed);
+            if (err_is_fail(err)) {
+                DEBUG_ERR(err, "zeroing pooled RAM");
+                // give it back rather than retry it every period
+                failed[nfailed++] = ram->cap;
+                *ram = cls->ram[--cls->count];
+                continue;
+            }
+            budget -= step;
+        }
+        thread_mutex_unlock(&zero_pool_lock);
+
+        for (size_t j = 0; j < nfailed; j++) {
+            aos_ram_free(failed[j], cls->bytes);
+        }
+    }
+}
+
+/**
+ * \brief Zero more of the pool every 'period' us, from the default waitset
+ */
+errval_t zero_pool_start(delayus_t period)
+{
+    return periodic_event_create(&zero_pool_event, get_default_waitset(),
+                                 period, MKCLOSURE(zero_pool_refill, NULL));
+}
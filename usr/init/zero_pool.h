@@ -0,0 +1,26 @@
+/**
+ * \file
+ * \brief Pool of RAM capabilities zeroed ahead of time
+ */
+
+/*
+ * Copyright (c) 2016, ETH Zurich.
+ * All rights reserved.
+ *
+ * This file is distributed under the terms in the attached LICENSE file.
+ * If you do not find this file, copies can be found by writing to:
+ * ETH Zurich D-INFK, Universitaetsstrasse 6, CH-8092 Zurich. Attn: Systems Group.
+ */
+
+#ifndef _INIT_ZERO_POOL_H_
+#define _INIT_ZERO_POOL_H_
+
+#include <aos/aos.h>
+
+/// Most bytes the pool zeroes each period
+#define ZERO_POOL_BUDGET        (128 * 1024)
+
+bool zero_pool_take(size_t bytes, struct capref *ret);
+errval_t zero_pool_start(delayus_t period);
+
+#endif /* _INIT_ZERO_POOL_H_ */
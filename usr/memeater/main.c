@@ -20,7 +20,7 @@
 #include <aos/waitset.h>
 #include <aos/paging.h>
 
-static struct aos_rpc init_rpc;
+static struct aos_rpc *init_rpc;
 
 const char *str = "Lorem ipsum dolor sit amet, consectetur adipiscing elit, "
                   "sed do eiusmod tempor incididunt ut labore et dolore magna "
@@ -44,7 +44,7 @@ static errval_t request_and_map_memory(void)
     debug_printf("obtaining cap of %" PRIu32 " bytes...\n", BASE_PAGE_SIZE);
 
     struct capref cap1;
-    err = aos_rpc_get_ram_cap(&init_rpc, BASE_PAGE_SIZE, &cap1, &bytes);
+    err = aos_rpc_get_ram_cap(init_rpc, BASE_PAGE_SIZE, &cap1, &bytes);
     if (err_is_fail(err)) {
         DEBUG_ERR(err, "could not get BASE_PAGE_SIZE cap\n");
         return err;
@@ -113,21 +113,21 @@ static errval_t test_basic_rpc(void)
     debug_printf("RPC: testing basic RPCs...\n");
 
     debug_printf("RPC: sending number...\n");
-    err =  aos_rpc_send_number(&init_rpc, 42);
+    err =  aos_rpc_send_number(init_rpc, 42);
     if (err_is_fail(err)) {
         DEBUG_ERR(err, "could not send a string\n");
         return err;
     }
 
     debug_printf("RPC: sending small string...\n");
-    err =  aos_rpc_send_string(&init_rpc, "Hello init");
+    err =  aos_rpc_send_string(init_rpc, "Hello init");
     if (err_is_fail(err)) {
         DEBUG_ERR(err, "could not send a string\n");
         return err;
     }
 
     debug_printf("RPC: sending large string...\n");
-    err =  aos_rpc_send_string(&init_rpc, str);
+    err =  aos_rpc_send_string(init_rpc, str);
     if (err_is_fail(err)) {
         DEBUG_ERR(err, "could not send a string\n");
         return err;
@@ -138,6 +138,118 @@ static errval_t test_basic_rpc(void)
     return SYS_ERR_OK;
 }
 
+#define RPC_BENCH_ROUNDS 32
+#define RAM_BATCH 100
+
+struct ram_batch {
+    struct capref caps[RAM_BATCH];
+    size_t done;
+    errval_t err;
+};
+
+static void ram_batch_cont(struct aos_rpc *rpc, struct aos_rpc_response *resp,
+                           void *arg)
+{
+    struct ram_batch *batch = (struct ram_batch*) arg;
+    if (resp->status != AOS_RPC_OK) {
+        batch->err = err_is_fail(resp->err) ? resp->err : LIB_ERR_RPC_FAILED;
+    } else {
+        batch->caps[batch->done] = resp->cap;
+    }
+    ++batch->done;
+}
+
+/**
+ * \brief Request many RAM caps with overlapping round trips.
+ */
+static errval_t request_ram_batch(void)
+{
+    errval_t err;
+    static struct ram_batch batch;
+
+    debug_printf("RPC: requesting %u RAM caps asynchronously...\n", RAM_BATCH);
+
+    batch.done = 0;
+    batch.err = SYS_ERR_OK;
+    uint32_t begin = perf_measurement_get_counter();
+    for (int i = 0; i < RAM_BATCH; ++i) {
+        err = aos_rpc_get_ram_cap_async(init_rpc, BASE_PAGE_SIZE,
+                ram_batch_cont, &batch);
+        if (err_is_fail(err)) {
+            DEBUG_ERR(err, "could not submit RAM request\n");
+            return err;
+        }
+    }
+    err = aos_rpc_wait_all(init_rpc);
+    uint32_t end = perf_measurement_get_counter();
+    if (err_is_fail(err)) {
+        return err;
+    }
+    if (err_is_fail(batch.err)) {
+        DEBUG_ERR(batch.err, "RAM request failed\n");
+        return batch.err;
+    }
+
+    if (end > begin) {
+        debug_printf(" *** performance measurement: %u pipelined RAM requests: "
+                     "%u cycles\n", RAM_BATCH, end - begin);
+    }
+
+    return SYS_ERR_OK;
+}
+
+/**
+ * \brief Measure steady-state round trip cost of basic RPCs in cycles.
+ */
+static errval_t bench_basic_rpc(void)
+{
+    errval_t err;
+
+    debug_printf("RPC: benchmarking basic RPCs...\n");
+
+    uint32_t min = UINT32_MAX, total = 0, rounds = 0;
+    for (int i = 0; i < RPC_BENCH_ROUNDS; ++i) {
+        uint32_t begin = perf_measurement_get_counter();
+        err = aos_rpc_send_number(init_rpc, i);
+        uint32_t end = perf_measurement_get_counter();
+        if (err_is_fail(err)) {
+            DEBUG_ERR(err, "could not send a number\n");
+            return err;
+        }
+        if (end > begin) {  // otherwise it overflowed and doesn't make much sense
+            min = MIN(min, end - begin);
+            total += end - begin;
+            ++rounds;
+        }
+    }
+    debug_printf(" *** performance measurement: aos_rpc_send_number: "
+                 "min %u cycles, avg %u cycles over %u rounds\n",
+                 min, rounds > 0 ? total / rounds : 0, rounds);
+
+    min = UINT32_MAX;
+    total = 0;
+    rounds = 0;
+    for (int i = 0; i < RPC_BENCH_ROUNDS; ++i) {
+        uint32_t begin = perf_measurement_get_counter();
+        err = aos_rpc_send_string(init_rpc, str);
+        uint32_t end = perf_measurement_get_counter();
+        if (err_is_fail(err)) {
+            DEBUG_ERR(err, "could not send a string\n");
+            return err;
+        }
+        if (end > begin) {
+            min = MIN(min, end - begin);
+            total += end - begin;
+            ++rounds;
+        }
+    }
+    debug_printf(" *** performance measurement: aos_rpc_send_string: "
+                 "min %u cycles, avg %u cycles over %u rounds\n",
+                 min, rounds > 0 ? total / rounds : 0, rounds);
+
+    return SYS_ERR_OK;
+}
+
 
 int main(int argc, char *argv[])
 {
@@ -145,17 +257,27 @@ int main(int argc, char *argv[])
 
     debug_printf("memeater started....\n");
 
-    // err = aos_rpc_init(&init_rpc, get_default_waitset());
+    // err = aos_rpc_init(init_rpc, get_default_waitset());
     // if (err_is_fail(err)) {
     //     USER_PANIC_ERR(err, "could not initialize RPC\n");
     // }
-    init_rpc = *get_init_rpc();
+    init_rpc = get_init_rpc();
 
     err = test_basic_rpc();
     if (err_is_fail(err)) {
         USER_PANIC_ERR(err, "failure in testing basic RPC\n");
     }
 
+    err = bench_basic_rpc();
+    if (err_is_fail(err)) {
+        USER_PANIC_ERR(err, "failure in benchmarking basic RPC\n");
+    }
+
+    err = request_ram_batch();
+    if (err_is_fail(err)) {
+        USER_PANIC_ERR(err, "could not request RAM in a batch\n");
+    }
+
     err = request_and_map_memory();
     if (err_is_fail(err)) {
         USER_PANIC_ERR(err, "could not request and map memory\n");